@@ -0,0 +1,148 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <openssl/crypto.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Alignment of every allocation: one cache line
+#define ARENA_ALIGN 64
+
+// Size of the first block when none is given
+#define ARENA_DEFAULT_SIZE (64*1024)
+
+/*
+Bump allocator for the data of one proof.
+
+Allocations are carved out of large blocks and are never freed one by one:
+arena_reset releases everything at once. When a round needed more than one
+block, the reset replaces them with a single block of the total size, so
+from the second round on a proof does not call malloc at all.
+
+The memory is wiped on reset, since it holds commitment randomness.
+*/
+
+typedef struct arena_block
+{
+    /* data */
+    struct arena_block* next;
+    unsigned char* data;
+    size_t size;
+    size_t used;
+} ZKP_arena_block;
+
+typedef struct zkp_arena
+{
+    /* data */
+    ZKP_arena_block* head;
+    size_t total;
+} ZKP_arena;
+
+ZKP_arena_block* arena_block_new(size_t size, ZKP_arena_block* next){
+
+    ZKP_arena_block* b = (ZKP_arena_block*) malloc(sizeof(ZKP_arena_block)+size+ARENA_ALIGN);
+    uintptr_t start = (uintptr_t) (b+1);
+
+    b->next = next;
+    b->data = (unsigned char*) ( (start+ARENA_ALIGN-1) & ~(uintptr_t) (ARENA_ALIGN-1) );
+    b->size = size;
+    b->used = 0;
+
+    return b;
+}
+
+/**
+ * Creates an arena
+ * @param size: Size of the first block, 0 for the default
+ */
+ZKP_arena* arena_new(size_t size){
+
+    ZKP_arena* a = (ZKP_arena*) malloc(sizeof(ZKP_arena));
+
+    if (size == 0)
+        size = ARENA_DEFAULT_SIZE;
+
+    a->head = arena_block_new(size,NULL);
+    a->total = 0;
+
+    return a;
+}
+
+/**
+ * Returns bytes of uninitialized memory aligned on a cache line
+ */
+void* arena_alloc(ZKP_arena* a, size_t bytes){
+
+    ZKP_arena_block* b = a->head;
+    void* p;
+
+    bytes = (bytes+ARENA_ALIGN-1) & ~(size_t) (ARENA_ALIGN-1);
+
+    if (b->used + bytes > b->size){
+        // Double the block size, so that a growing round adds few blocks
+        b = arena_block_new(bytes > 2*b->size ? bytes : 2*b->size,b);
+        a->head = b;
+    }
+
+    p = b->data + b->used;
+    b->used += bytes;
+    a->total += bytes;
+
+    return p;
+}
+
+/**
+ * Returns bytes of zeroed memory aligned on a cache line
+ */
+void* arena_calloc(ZKP_arena* a, size_t bytes){
+
+    void* p = arena_alloc(a,bytes);
+    memset(p,0,bytes);
+
+    return p;
+}
+
+/**
+ * Wipes and releases every allocation of the arena at once
+ */
+void arena_reset(ZKP_arena* a){
+
+    ZKP_arena_block* b = a->head;
+    ZKP_arena_block* next;
+
+    if (b->next == NULL){
+        OPENSSL_cleanse(b->data,b->used);
+        b->used = 0;
+        a->total = 0;
+        return;
+    }
+
+    // More than one block: merge them into one that fits a whole round
+    while (b != NULL){
+        next = b->next;
+        OPENSSL_cleanse(b->data,b->used);
+        free(b);
+        b = next;
+    }
+
+    a->head = arena_block_new(a->total,NULL);
+    a->total = 0;
+}
+
+void arena_free(ZKP_arena* a){
+
+    ZKP_arena_block* b = a->head;
+    ZKP_arena_block* next;
+
+    while (b != NULL){
+        next = b->next;
+        OPENSSL_cleanse(b->data,b->used);
+        free(b);
+        b = next;
+    }
+
+    free(a);
+}
+
+#endif
@@ -0,0 +1,596 @@
+/*
+Microbenchmarks of the primitives and of the protocol steps.
+
+Every case is run warmup times untimed, which also sizes a batch of calls
+long enough for the clock, then reps times. Each sample is the time of one
+batch divided by its size. Prints the median, the 99th percentile and the
+throughput of every case, and writes them as JSON for regression tracking.
+
+The timed calls run in a memory window: a case whose calls of the second
+half of the reps leave memory allocated leaks, and fails the run. The first
+half absorbs the one-time growths of pools and caches. Built with
+-DZKP_TRACE, the OpenSSL bytes left allocated are checked, exactly, and the
+OpenSSL allocations and peak bytes per call are reported too. Otherwise the
+heap in use is checked, above BENCH_LEAK_TOLERANCE.
+
+Cases depending on the instance are run for every n, k and modulus size of
+the sweep. The Naor and Goldreich-Levin commitments have a fixed size and
+are run once.
+
+Build: gcc -O2 bench.c -lcrypto -lpthread -o bench
+The fixed-width kernels check for mulx/adx at runtime, no -m flag is needed;
+add -DFIXED_PORTABLE to run them on the portable multiply-accumulate instead.
+Usage: bench [-n 64,256] [-k 16] [-b 2048] [-r reps] [-w warmup] [-f prefix] [-o bench.json]
+*/
+
+#include <openssl/bn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctx_pool.h"
+#include "goldreich_levin.h"
+#include "hmac_drbg.h"
+#include "naor.h"
+#include "zkp_batch.h"
+#include "zkp_session.h"
+#include "zkp_timer.h"
+#include "zkp_trace.h"
+
+#define BENCH_MAX_SWEEP 16
+#define BENCH_DEFAULT_REPS 31
+#define BENCH_DEFAULT_WARMUP 3
+
+// Shortest batch worth timing
+#define BENCH_MIN_SAMPLE_NS 200000
+
+// Proofs of the batch verification case
+#define BENCH_VERIFY_BATCH 8
+
+#ifdef ZKP_TRACE
+// The OpenSSL bytes left allocated are exact
+#define BENCH_LEAK_TOLERANCE 0
+#else
+// The heap in use also moves with the allocator's bins and arenas
+#define BENCH_LEAK_TOLERANCE 4096
+#endif
+
+typedef struct bench_options
+{
+    /* data */
+    int n[BENCH_MAX_SWEEP], nn;
+    int k[BENCH_MAX_SWEEP], nk;
+    int bits[BENCH_MAX_SWEEP], nbits;
+    int reps;
+    int warmup;
+    const char* filter;
+    const char* output;
+} BENCH_options;
+
+/*
+Everything a case needs for one point of the sweep, built before timing
+*/
+typedef struct bench_fixture
+{
+    /* data */
+    int n;
+    int k;
+    int bits;
+    BN_CTX* ctx;
+    PED_params* params;
+    BIGNUM* M;
+    BIGNUM* m;
+    PED_commitment* comm;
+    KSS_instance* inst;
+    BIGNUM** padded;
+    char* solution;
+    permutation p;
+    PROVER_data* P;
+    PROVER_data* Pw;
+    VERIFIER_data* V;
+    BN_view* opened;
+    PED_commit_vector* com;
+    BIT_solution* permuted;
+    BIGNUM* sum;
+    ZKP_batch* batch;
+    BIGNUM* naor_r;
+} BENCH_fixture;
+
+typedef void (*bench_fn)(BENCH_fixture* f);
+
+typedef struct bench_result
+{
+    /* data */
+    const char* name;
+    int n;
+    int k;
+    int bits;
+    int batch;
+    double median;
+    double p99;
+    double mean;
+    double allocs;      // OpenSSL allocations per call
+    int64_t peak;       // Highest OpenSSL bytes held by the timed calls
+    int64_t leaked;     // Bytes left allocated by the second half of the reps
+    long calls;
+} BENCH_result;
+
+/**
+ * Parses a comma-separated list of integers
+ * @return Number of values, 0 if the list is invalid
+ */
+int bench_parse_list(const char* s, int* out){
+
+    int count = 0;
+    char* end;
+
+    while (*s && count < BENCH_MAX_SWEEP){
+
+        out[count++] = (int) strtol(s,&end,10);
+
+        if (end == s || out[count-1] < 1)
+            return 0;
+
+        s = *end == ',' ? end+1 : end;
+    }
+
+    return *s ? 0 : count;
+}
+
+bool bench_options_from_args(BENCH_options* o, int argc, char** argv){
+
+    o->n[0] = 64; o->n[1] = ZKP_DEFAULT_N; o->nn = 2;
+    o->k[0] = ZKP_DEFAULT_K; o->nk = 1;
+    o->bits[0] = ZKP_DEFAULT_BITS; o->nbits = 1;
+    o->reps = BENCH_DEFAULT_REPS;
+    o->warmup = BENCH_DEFAULT_WARMUP;
+    o->filter = "";
+    o->output = "bench.json";
+
+    for(int i=1; i<argc;i+=2){
+
+        if (i+1 == argc || argv[i][0] != '-' || strlen(argv[i]) != 2)
+            return false;
+
+        switch (argv[i][1]){
+            case 'n': if ((o->nn = bench_parse_list(argv[i+1],o->n)) == 0) return false; break;
+            case 'k': if ((o->nk = bench_parse_list(argv[i+1],o->k)) == 0) return false; break;
+            case 'b': if ((o->nbits = bench_parse_list(argv[i+1],o->bits)) == 0) return false; break;
+            case 'r': if ((o->reps = atoi(argv[i+1])) < 1) return false; break;
+            case 'w': if ((o->warmup = atoi(argv[i+1])) < 1) return false; break;
+            case 'f': o->filter = argv[i+1]; break;
+            case 'o': o->output = argv[i+1]; break;
+            default: return false;
+        }
+    }
+
+    return true;
+}
+
+int bench_cmp_double(const void* a, const void* b){
+
+    double x = *(const double*) a, y = *(const double*) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Times fn on the fixture
+ * @return Statistics of the samples, in nanoseconds per call
+ */
+BENCH_result bench_run(const BENCH_options* o, const char* name, bench_fn fn, BENCH_fixture* f){
+
+    BENCH_result r;
+    double* samples = (double*) malloc(sizeof(double)*o->reps);
+    double sum = 0;
+    uint64_t start, t = 0;
+    int batch = 1;
+    int64_t half = 0;
+    ZKP_mem_window w;
+    ZKP_mem_stats m;
+
+    // Warmup, sizing the batch on the last call
+    for(int i=0; i<o->warmup;++i){
+        start = zkp_now_ns();
+        fn(f);
+        t = zkp_now_ns() - start;
+    }
+
+    if (t < BENCH_MIN_SAMPLE_NS)
+        batch = (int) (BENCH_MIN_SAMPLE_NS/(t > 0 ? t : 1)) + 1;
+
+    zkp_mem_begin(&w,true);
+
+    for(int i=0; i<o->reps;++i){
+
+        // Memory in use once the one-time growths are absorbed
+        if (i == o->reps/2){
+#ifdef ZKP_TRACE
+            half = w.thread->live;
+#else
+            half = zkp_heap_in_use();
+#endif
+        }
+
+        start = zkp_now_ns();
+
+        for(int j=0; j<batch;++j)
+            fn(f);
+
+        samples[i] = (double) (zkp_now_ns() - start)/batch;
+        sum += samples[i];
+    }
+
+    zkp_mem_end(&w,&m);
+
+    qsort(samples,o->reps,sizeof(double),bench_cmp_double);
+
+    r.name = name;
+    r.n = f->n;
+    r.k = f->k;
+    r.bits = f->bits;
+    r.batch = batch;
+    r.median = o->reps % 2 ? samples[o->reps/2] : (samples[o->reps/2-1]+samples[o->reps/2])/2;
+    r.p99 = samples[(99*o->reps+99)/100-1];
+    r.mean = sum/o->reps;
+    r.calls = (long) o->reps*batch;
+    r.allocs = (double) m.allocs/r.calls;
+    r.peak = m.peak;
+
+#ifdef ZKP_TRACE
+    r.leaked = w.thread->live - half;
+#else
+    // Zero where the C library does not report the heap
+    r.leaked = m.has_heap ? w.heap+m.heap-half : 0;
+#endif
+
+    free(samples);
+
+    printf("%-28s %6d %4d %5d %14.1f %14.1f %12.1f %10.1f %10lld\n",r.name,r.n,r.k,r.bits,r.median/1e3,r.p99/1e3,1e9/r.mean,r.allocs,(long long) r.leaked);
+    fflush(stdout);
+
+    return r;
+}
+
+/*
+The cases. Each leaves the fixture as it found it, so calls can be repeated.
+*/
+
+void bench_pedersen_commit(BENCH_fixture* f){
+
+    PED_commitment* c = pedersen_commit_params(f->m,f->params,f->ctx);
+
+    BN_free(c->c);
+    BN_clear_free(c->s);
+    free(c);
+}
+
+void bench_pedersen_unveil(BENCH_fixture* f){
+    pedersen_unveil_params(f->comm->c,f->comm->s,f->m,f->params,f->ctx);
+}
+
+void bench_gen_instance(BENCH_fixture* f){
+    kss_free(gen_instance_quiet(f->M,f->ctx,f->n,f->k));
+}
+
+void bench_verify_solution(BENCH_fixture* f){
+    verify_solution(f->inst,f->ctx);
+}
+
+void bench_permutation_apply(BENCH_fixture* f){
+
+    BIGNUM** a = permutation_apply(f->padded,f->p,2*f->n);
+
+    for(int i=0; i<2*f->n;++i)
+        BN_free(a[i]);
+
+    free(a);
+}
+
+void bench_homomorphic_sum(BENCH_fixture* f){
+    BN_free(VERIFIER_homomorphic_sum(f->P->commitment_2,f->solution,f->params,f->ctx));
+}
+
+void bench_homomorphic_sum_variable(BENCH_fixture* f){
+    BN_free(VERIFIER_homomorphic_sum_variable(f->P->commitment_2,f->solution,f->params,f->ctx));
+}
+
+// Prover's first message, refilling the commitments to zero it uses
+void bench_proof_commit(BENCH_fixture* f){
+
+    PROVER_precompute(f->Pw);
+    PROVER_round_commits(f->Pw);
+    PROVER_reset(f->Pw);
+}
+
+// Verifier's checks of the round of the fixture, for a fixed challenge
+void bench_proof_verify(BENCH_fixture* f){
+
+    VERIFIER_checks_opening(f->V,f->com,f->opened);
+    VERIFIER_homomorphic_sum_round(f->V,f->V->index == 0 ? f->P->commitment_2 : f->P->commitment_1,f->permuted);
+    VERIFIER_accepts(f->V,f->sum);
+}
+
+// The same checks deferred to a batch of BENCH_VERIFY_BATCH copies of the round
+void bench_proof_verify_batch(BENCH_fixture* f){
+
+    PED_commit_vector* closed = f->V->index == 0 ? f->P->commitment_2 : f->P->commitment_1;
+
+    for(int j=0; j<BENCH_VERIFY_BATCH;++j)
+        VERIFIER_batch_add(f->batch,f->V,f->com,f->opened,closed,f->permuted,f->sum);
+
+    batch_verify(f->batch);
+    batch_reset(f->batch);
+}
+
+// A round with both sides, in memory
+void bench_proof_round(BENCH_fixture* f){
+
+    PROVER_data* P;
+    PED_commit_vector* com;
+    BN_view* opened;
+    BIT_solution* sol;
+    VERIFIER_data* V;
+    int index;
+
+    P = f->Pw;
+    V = f->V;
+
+    PROVER_precompute(P);
+    PROVER_round_commits(P);
+    index = VERIFIER_challenge(V);
+    PROVER_opening(P,index,&com,&opened);
+    VERIFIER_checks_opening(V,com,opened);
+    sol = PROVER_permuted_solution(P,index);
+    VERIFIER_homomorphic_sum_round(V,index == 0 ? P->commitment_2 : P->commitment_1,sol);
+    VERIFIER_accepts(V,PROVER_sum(P,index));
+    PROVER_reset(P);
+}
+
+void bench_drbg_generate(BENCH_fixture* f){
+    (void) f;
+    free(DRBG_Generate(NULL,32));
+}
+
+void bench_naor_commit(BENCH_fixture* f){
+
+    BN_pair* c = naor_commit(1,f->naor_r);
+
+    BN_free(c->x);
+    BN_free(c->y);
+    free(c);
+}
+
+void bench_naor_verify(BENCH_fixture* f){
+
+    BN_pair* c = naor_commit(1,f->naor_r);
+
+    naor_verify(1,c->x,c->y,f->naor_r);
+
+    BN_free(c->x);
+    BN_free(c->y);
+    free(c);
+}
+
+void bench_gl_commit(BENCH_fixture* f){
+
+    GL_COMMIT* c = gl_commit(1);
+
+    (void) f;
+
+    gl_verify(1,*c);
+
+    BN_free(c->f->x);
+    free(c->f);
+    BN_free(c->inputs->x);
+    BN_free(c->inputs->y);
+    free(c->inputs);
+    free(c);
+}
+
+typedef struct bench_case
+{
+    /* data */
+    const char* name;
+    bench_fn fn;
+    int bits;           // Size of the fixed-size cases
+} BENCH_case;
+
+// Cases run for every point of the sweep
+BENCH_case bench_sweep_cases[] = {
+    {"pedersen_commit",bench_pedersen_commit,0},
+    {"pederesen_unveil",bench_pedersen_unveil,0},
+    {"gen_instance",bench_gen_instance,0},
+    {"verify_solution",bench_verify_solution,0},
+    {"permutation_apply",bench_permutation_apply,0},
+    {"homomorphic_sum",bench_homomorphic_sum,0},
+    {"homomorphic_sum_variable",bench_homomorphic_sum_variable,0},
+    {"proof.commit",bench_proof_commit,0},
+    {"proof.verify",bench_proof_verify,0},
+    {"proof.verify_batch_of_8",bench_proof_verify_batch,0},
+    {"proof.round",bench_proof_round,0}
+};
+
+// Cases run once, with a fixed size
+BENCH_case bench_once_cases[] = {
+    {"drbg.generate",bench_drbg_generate,8*32},
+    {"naor.commit",bench_naor_commit,NAOR_BITS},
+    {"naor.commit_verify",bench_naor_verify,NAOR_BITS},
+    {"gl.commit_verify",bench_gl_commit,GL_BITS}
+};
+
+/**
+ * Builds the fixture of one point of the sweep: a prover that has committed,
+ * a verifier that has drawn its challenge, and a second prover for the cases
+ * that run rounds of their own
+ */
+void bench_fixture_init(BENCH_fixture* f, PED_params* params, int n, int k){
+
+    BN_CTX* ctx = zkp_ctx();
+    BIT_solution* sol;
+
+    f->n = n;
+    f->k = k;
+    f->bits = BN_num_bits(params->p);
+    f->ctx = ctx;
+    f->params = params;
+
+    f->M = BN_new();
+    BN_sub(f->M,params->p,BN_value_one());
+    f->m = BN_new();
+    BN_rand_range(f->m,params->p);
+    f->comm = pedersen_commit_params(f->m,params,ctx);
+
+    f->inst = gen_instance_quiet(f->M,ctx,n,k);
+    f->padded = pad_with_zeros(f->inst->a,n);
+    f->solution = pad_with_zeros_solution(f->inst->solution,n,k);
+    f->p = permutation_get_random(2*n);
+
+    f->P = PROVER_new(params,f->inst,NULL);
+    f->Pw = PROVER_new(params,f->inst,NULL);
+    f->V = VERIFIER_new(params,f->inst);
+
+    PROVER_precompute(f->P);
+    PROVER_round_commits(f->P);
+    VERIFIER_challenge(f->V);
+    PROVER_opening(f->P,f->V->index,&f->com,&f->opened);
+
+    // Own copy, PROVER_sum rewrites the one of the session
+    sol = PROVER_permuted_solution(f->P,f->V->index);
+    f->permuted = bitsol_new(sol->n);
+    memcpy(f->permuted->w,sol->w,sizeof(uint64_t)*sol->words);
+    f->sum = BN_dup(PROVER_sum(f->P,f->V->index));
+    f->batch = batch_new(params,BENCH_VERIFY_BATCH);
+}
+
+void bench_fixture_free(BENCH_fixture* f){
+
+    PROVER_free(f->P);
+    PROVER_free(f->Pw);
+    VERIFIER_free(f->V);
+    bitsol_free(f->permuted);
+    BN_free(f->sum);
+    batch_free(f->batch);
+    permutation_free(f->p);
+    free(f->solution);
+
+    for(int i=0; i<2*f->n;++i)
+        BN_free(f->padded[i]);
+
+    free(f->padded);
+    kss_free(f->inst);
+    BN_free(f->comm->c);
+    BN_clear_free(f->comm->s);
+    free(f->comm);
+    BN_free(f->m);
+    BN_free(f->M);
+}
+
+void bench_json_result(FILE* out, const BENCH_result* r, bool first){
+    fprintf(out,"%s\n    {\"name\": \"%s\", \"n\": %d, \"k\": %d, \"bits\": %d, \"batch\": %d, "
+        "\"median_ns\": %.1f, \"p99_ns\": %.1f, \"mean_ns\": %.1f, \"ops_per_sec\": %.3f, "
+        "\"allocs_per_call\": %.1f, \"peak_bytes\": %lld, \"leaked_bytes\": %lld, \"calls\": %ld}",
+        first ? "" : ",",r->name,r->n,r->k,r->bits,r->batch,r->median,r->p99,r->mean,1e9/r->mean,
+        r->allocs,(long long) r->peak,(long long) r->leaked,r->calls);
+}
+
+bool bench_selected(const BENCH_options* o, const char* name){
+    return strncmp(name,o->filter,strlen(o->filter)) == 0;
+}
+
+int main(int argc, char** argv){
+
+    BENCH_options o;
+    BENCH_fixture f;
+    BENCH_result r;
+    PED_params* params;
+    FILE* out;
+    bool first = true;
+    int leaks = 0;
+
+    zkp_trace_init();
+
+    if (!bench_options_from_args(&o,argc,argv)){
+        puts("Usage: bench [-n 64,256] [-k 16] [-b 2048] [-r reps] [-w warmup] [-f prefix] [-o bench.json]");
+        exit(1);
+    }
+
+    if ((out = fopen(o.output,"w")) == NULL){
+        printf("Cannot open %s\n",o.output);
+        exit(1);
+    }
+
+    fprintf(out,"{\n  \"reps\": %d,\n  \"warmup\": %d,\n  \"results\": [",o.reps,o.warmup);
+    printf("%-28s %6s %4s %5s %14s %14s %12s %10s %10s\n","case","n","k","bits","median (us)","p99 (us)","ops/s","allocs","leaked (B)");
+
+    view_init(NULL,0,NULL,0);
+
+    for(int b=0; b<o.nbits;++b){
+
+        if (o.bits[b] < 512 || o.bits[b] % 64 != 0){
+            printf("Skipping unsupported modulus size %d\n",o.bits[b]);
+            continue;
+        }
+
+        params = pedersen_get_param(o.bits[b],zkp_ctx());
+        pedersen_save_param(params);
+        pedersen_precompute(params,FB_DEFAULT_WINDOW,zkp_ctx());
+
+        for(int i=0; i<o.nn;++i){
+            for(int j=0; j<o.nk;++j){
+
+                if (o.k[j] > o.n[i] || o.n[i] > ZKP_MAX_N)
+                    continue;
+
+                bench_fixture_init(&f,params,o.n[i],o.k[j]);
+
+                for(size_t c=0; c<sizeof(bench_sweep_cases)/sizeof(BENCH_case);++c){
+                    if (bench_selected(&o,bench_sweep_cases[c].name)){
+                        r = bench_run(&o,bench_sweep_cases[c].name,bench_sweep_cases[c].fn,&f);
+                        bench_json_result(out,&r,first);
+                        leaks += r.leaked > BENCH_LEAK_TOLERANCE;
+                        first = false;
+                    }
+                }
+
+                // The fixed-size cases, once, with the first parameters
+                if (b == 0 && i == 0 && j == 0){
+
+                    DRBG_Instantiate(NULL);
+                    f.naor_r = gen_R();
+
+                    // Skips the safe prime search of the one-way permutation
+                    safeprime = BN_dup(params->p);
+
+                    for(size_t c=0; c<sizeof(bench_once_cases)/sizeof(BENCH_case);++c){
+                        if (bench_selected(&o,bench_once_cases[c].name)){
+                            f.n = f.k = 0;
+                            f.bits = bench_once_cases[c].bits;
+                            r = bench_run(&o,bench_once_cases[c].name,bench_once_cases[c].fn,&f);
+                            bench_json_result(out,&r,first);
+                            leaks += r.leaked > BENCH_LEAK_TOLERANCE;
+                            first = false;
+                        }
+                    }
+
+                    f.n = o.n[i];
+                    f.k = o.k[j];
+                    BN_free(f.naor_r);
+                }
+
+                bench_fixture_free(&f);
+            }
+        }
+    }
+
+    fprintf(out,"\n  ]\n}\n");
+    fclose(out);
+    zkp_ctx_release();
+
+    if (leaks > 0){
+        printf("%d cases leaked memory\n",leaks);
+        return 1;
+    }
+
+    return 0;
+}
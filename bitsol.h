@@ -0,0 +1,170 @@
+#ifndef BITSOL_H
+#define BITSOL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+/*
+Bit-packed solution vectors.
+
+Bit i of word i/64 is set iff element i is part of the solution. The weight
+is a popcount per word, and the selected elements are enumerated with a
+count of trailing zeros per set bit, so a pass over a solution of weight K
+costs n/64 word loads and K iterations instead of n byte tests.
+*/
+
+typedef struct bit_solution
+{
+    /* data */
+    int n;
+    int words;
+    uint64_t* w;
+} BIT_solution;
+
+int bitsol_popcount64(uint64_t x){
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return (int) __popcnt64(x);
+#else
+    int c = 0;
+
+    for(; x; x &= x-1) c++;
+
+    return c;
+#endif
+}
+
+// x must not be 0
+int bitsol_ctz64(uint64_t x){
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+
+    _BitScanForward64(&i,x);
+
+    return (int) i;
+#else
+    int c = 0;
+
+    for(; !(x & 1); x >>= 1) c++;
+
+    return c;
+#endif
+}
+
+/**
+ * Creates an empty solution over n elements
+ */
+BIT_solution* bitsol_new(int n){
+
+    BIT_solution* s = (BIT_solution*) malloc(sizeof(BIT_solution));
+
+    s->n = n;
+    s->words = (n+63)/64;
+    s->w = (uint64_t*) calloc(s->words > 0 ? s->words : 1,sizeof(uint64_t));
+
+    return s;
+}
+
+void bitsol_free(BIT_solution* s){
+    free(s->w);
+    free(s);
+}
+
+void bitsol_clear(BIT_solution* s){
+    memset(s->w,0,sizeof(uint64_t)*s->words);
+}
+
+int bitsol_get(const BIT_solution* s, int i){
+    return (int) ( (s->w[i >> 6] >> (i & 63)) & 1 );
+}
+
+void bitsol_set(BIT_solution* s, int i){
+    s->w[i >> 6] |= (uint64_t) 1 << (i & 63);
+}
+
+/**
+ * Packs a solution of one byte per element, a[i]==1 meaning selected
+ */
+BIT_solution* bitsol_from_chars(BIT_solution* s, const char* a){
+
+    uint64_t w;
+    int i, j;
+
+    for(j=0; j<s->words;++j){
+
+        w = 0;
+
+        for(i=0; i<64 && 64*j+i<s->n;++i)
+            w |= (uint64_t) (a[64*j+i] == 1) << i;
+
+        s->w[j] = w;
+    }
+
+    return s;
+}
+
+/**
+ * Unpacks into one byte per element
+ */
+char* bitsol_to_chars(const BIT_solution* s, char* out){
+
+    for(int i=0; i<s->n;++i)
+        out[i] = (char) bitsol_get(s,i);
+
+    return out;
+}
+
+/**
+ * Number of selected elements
+ */
+int bitsol_weight(const BIT_solution* s){
+
+    int k = 0;
+
+    for(int j=0; j<s->words;++j)
+        k += bitsol_popcount64(s->w[j]);
+
+    return k;
+}
+
+/**
+ * Writes the selected positions in increasing order
+ * @param out: Where to write them, room for the weight of s
+ * @return Number of positions written
+ */
+int bitsol_indices(const BIT_solution* s, int* out){
+
+    uint64_t w;
+    int k = 0;
+
+    for(int j=0; j<s->words;++j){
+        for(w = s->w[j]; w; w &= w-1)
+            out[k++] = 64*j + bitsol_ctz64(w);
+    }
+
+    return k;
+}
+
+/**
+ * Prints the solution in binary form
+ */
+void bitsol_print(const BIT_solution* s){
+
+    fputs("Solution: ",stdout);
+
+    for(int i=0; i<s->n;++i)
+        putchar('0' + bitsol_get(s,i));
+
+    putchar('\n');
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef COMMIT_VECTOR_H
+#define COMMIT_VECTOR_H
+
+#include <openssl/bn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "pedersen.h"
+
+/*
+Structure-of-arrays storage for the commitments of one round.
+
+All the c values live in one contiguous array and all the s values in
+another, each entry being words 64-bit words holding the value as
+little-endian bytes (the layout of the fixed-base tables). Both arrays and
+the vector itself come from an arena, so a whole round is released with one
+arena_reset, without a BN_free per value.
+*/
+
+typedef struct pedersen_commit_vector
+{
+    /* data */
+    int count;
+    int words;
+    uint64_t* c;
+    uint64_t* s;
+} PED_commit_vector;
+
+/**
+ * Creates a zeroed vector of count commitments modulo p
+ * @param arena: Arena owning the vector
+ * @param count: Number of commitments
+ * @param p: Modulus of the commitments
+ */
+PED_commit_vector* commit_vector_new(ZKP_arena* arena, int count, const BIGNUM* p){
+
+    PED_commit_vector* v = (PED_commit_vector*) arena_alloc(arena,sizeof(PED_commit_vector));
+
+    v->count = count;
+    v->words = (BN_num_bytes(p)+7)/8;
+    v->c = (uint64_t*) arena_calloc(arena,sizeof(uint64_t)*v->words*count);
+    v->s = (uint64_t*) arena_calloc(arena,sizeof(uint64_t)*v->words*count);
+
+    return v;
+}
+
+uint64_t* commit_vector_c(const PED_commit_vector* v, int i){
+    return v->c + (size_t) i*v->words;
+}
+
+uint64_t* commit_vector_s(const PED_commit_vector* v, int i){
+    return v->s + (size_t) i*v->words;
+}
+
+void commit_vector_set_c(PED_commit_vector* v, int i, const BIGNUM* c){
+    BN_bn2lebinpad(c,(unsigned char*) commit_vector_c(v,i),v->words*8);
+}
+
+void commit_vector_set_s(PED_commit_vector* v, int i, const BIGNUM* s){
+    BN_bn2lebinpad(s,(unsigned char*) commit_vector_s(v,i),v->words*8);
+}
+
+/**
+ * Stores commitment i
+ */
+void commit_vector_set(PED_commit_vector* v, int i, const BIGNUM* c, const BIGNUM* s){
+    commit_vector_set_c(v,i,c);
+    commit_vector_set_s(v,i,s);
+}
+
+/**
+ * Stores commitment i and frees com, wiping its randomness
+ */
+void commit_vector_take(PED_commit_vector* v, int i, PED_commitment* com){
+    commit_vector_set(v,i,com->c,com->s);
+    BN_free(com->c);
+    BN_clear_free(com->s);
+    free(com);
+}
+
+BIGNUM* commit_vector_get_c(const PED_commit_vector* v, int i, BIGNUM* out){
+    return BN_lebin2bn((const unsigned char*) commit_vector_c(v,i),v->words*8,out);
+}
+
+BIGNUM* commit_vector_get_s(const PED_commit_vector* v, int i, BIGNUM* out){
+    return BN_lebin2bn((const unsigned char*) commit_vector_s(v,i),v->words*8,out);
+}
+
+#endif
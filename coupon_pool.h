@@ -0,0 +1,428 @@
+#ifndef COUPON_POOL_H
+#define COUPON_POOL_H
+
+#include <openssl/bn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "ctx_pool.h"
+#include "pedersen.h"
+
+/*
+Offline/online split of Pedersen commitments.
+
+The h^s half of a commitment does not depend on the message, so it can be
+computed ahead of time. A coupon is a pair (s, h^s). The pool keeps a ring of
+coupons, filled synchronously or by background refill threads, and the online
+commitment only costs g^m and one multiplication.
+
+A coupon must be used at most once: reusing s makes two commitments share
+their randomness. Coupons taken from the pool are removed from it, and a
+pool file is deleted as soon as it is loaded.
+*/
+
+typedef struct pedersen_coupon
+{
+    /* data */
+    BIGNUM* s;
+    BIGNUM* hs;
+} PED_coupon;
+
+typedef struct pedersen_coupon_stats
+{
+    /* data */
+    unsigned long produced;
+    unsigned long served;
+    unsigned long exhausted;
+    int level;
+    int low_water;
+} PED_coupon_stats;
+
+typedef struct pedersen_coupon_pool
+{
+    /* data */
+    PED_params* params;
+    PED_coupon* ring;
+    int size;
+    int head;
+    int count;
+    int pending;
+    PED_coupon_stats stats;
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;
+    pthread_t* threads;
+    int nthreads;
+    bool stop;
+} PED_coupon_pool;
+
+/**
+ * Computes a fresh coupon (s, h^s)
+ */
+void coupon_compute(PED_params* params, PED_coupon* c, BN_CTX* ctx){
+
+    c->s = BN_new();
+    c->hs = BN_new();
+
+    BN_rand_range(c->s,params->p);
+    BN_set_flags(c->s,BN_FLG_CONSTTIME);
+    pedersen_exp(c->hs,params->h,c->s,PED_SECRET,params->h_table,params,ctx);
+
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,BN_num_bytes(params->p));
+    ZKP_COUNT(ZKP_CNT_MODEXP,1);
+}
+
+/**
+ * Creates an empty pool
+ * @param params: Pedersen parameters the coupons are computed for
+ * @param size: Maximum number of coupons kept
+ */
+PED_coupon_pool* coupon_pool_new(PED_params* params, int size){
+
+    PED_coupon_pool* pool = (PED_coupon_pool*) malloc(sizeof(PED_coupon_pool));
+
+    pool->params = params;
+    pool->ring = (PED_coupon*) malloc(sizeof(PED_coupon)*size);
+    pool->size = size;
+    pool->head = 0;
+    pool->count = 0;
+    pool->pending = 0;
+    memset(&pool->stats,0,sizeof(PED_coupon_stats));
+    pool->stats.low_water = size;
+
+    pthread_mutex_init(&pool->lock,NULL);
+    pthread_cond_init(&pool->not_full,NULL);
+    pool->threads = NULL;
+    pool->nthreads = 0;
+    pool->stop = false;
+
+    return pool;
+}
+
+/**
+ * Adds a coupon to the pool. Must be called with the lock held.
+ * Returns false, and frees the coupon, if the pool is full.
+ */
+bool coupon_pool_put_locked(PED_coupon_pool* pool, PED_coupon* c){
+
+    if (pool->count == pool->size){
+        BN_clear_free(c->s);
+        BN_free(c->hs);
+        return false;
+    }
+
+    pool->ring[(pool->head+pool->count)%pool->size] = *c;
+    pool->count++;
+    pool->stats.produced++;
+
+    return true;
+}
+
+/**
+ * Fills the pool up to its capacity from the calling thread
+ */
+void coupon_pool_fill(PED_coupon_pool* pool, BN_CTX* ctx){
+
+    PED_coupon c;
+
+    pthread_mutex_lock(&pool->lock);
+
+    // The slot is reserved before the exponentiation, which a full pool skips
+    while (pool->count + pool->pending < pool->size){
+
+        pool->pending++;
+        pthread_mutex_unlock(&pool->lock);
+
+        coupon_compute(pool->params,&c,ctx);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        coupon_pool_put_locked(pool,&c);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Takes a coupon out of the pool
+ * @return false if the pool was empty
+ */
+bool coupon_pool_take(PED_coupon_pool* pool, PED_coupon* out){
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->count == 0){
+        pool->stats.exhausted++;
+        pthread_mutex_unlock(&pool->lock);
+        return false;
+    }
+
+    *out = pool->ring[pool->head];
+    pool->head = (pool->head+1)%pool->size;
+    pool->count--;
+    pool->stats.served++;
+
+    if (pool->count < pool->stats.low_water)
+        pool->stats.low_water = pool->count;
+
+    pthread_cond_signal(&pool->not_full);
+    pthread_mutex_unlock(&pool->lock);
+
+    return true;
+}
+
+void* coupon_pool_worker(void* arg){
+
+    PED_coupon_pool* pool = (PED_coupon_pool*) arg;
+    // Freed with the thread
+    BN_CTX* ctx = zkp_ctx();
+    PED_coupon c;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (!pool->stop){
+
+        if (pool->count + pool->pending >= pool->size){
+            pthread_cond_wait(&pool->not_full,&pool->lock);
+            continue;
+        }
+
+        pool->pending++;
+        pthread_mutex_unlock(&pool->lock);
+
+        coupon_compute(pool->params,&c,ctx);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        coupon_pool_put_locked(pool,&c);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * Starts background threads that keep the pool full
+ * @param pool: The pool
+ * @param nthreads: Number of refill threads
+ */
+void coupon_pool_start(PED_coupon_pool* pool, int nthreads){
+
+    pool->stop = false;
+    pool->nthreads = nthreads;
+    pool->threads = (pthread_t*) malloc(sizeof(pthread_t)*nthreads);
+
+    for(int i=0; i<nthreads;++i){
+        pthread_create(&pool->threads[i],NULL,coupon_pool_worker,pool);
+    }
+}
+
+/**
+ * Stops the refill threads, waiting for the coupons in progress
+ */
+void coupon_pool_stop(PED_coupon_pool* pool){
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->not_full);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(int i=0; i<pool->nthreads;++i){
+        pthread_join(pool->threads[i],NULL);
+    }
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->nthreads = 0;
+}
+
+/**
+ * Stops the refill threads and destroys the pool and the coupons left in it
+ */
+void coupon_pool_free(PED_coupon_pool* pool){
+
+    if (pool->nthreads > 0)
+        coupon_pool_stop(pool);
+
+    for(int i=0; i<pool->count;++i){
+        BN_clear_free(pool->ring[(pool->head+i)%pool->size].s);
+        BN_free(pool->ring[(pool->head+i)%pool->size].hs);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->not_full);
+    free(pool->ring);
+    free(pool);
+}
+
+/**
+ * Copies the current counters of the pool
+ */
+void coupon_pool_get_stats(PED_coupon_pool* pool, PED_coupon_stats* out){
+
+    pthread_mutex_lock(&pool->lock);
+    *out = pool->stats;
+    out->level = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void coupon_pool_print_stats(PED_coupon_pool* pool){
+
+    PED_coupon_stats st;
+    coupon_pool_get_stats(pool,&st);
+
+    printf("Coupons: %d/%d available, %lu produced, %lu served, %lu misses, low water %d\n",
+            st.level,pool->size,st.produced,st.served,st.exhausted,st.low_water);
+}
+
+/**
+ * Moves every coupon of the pool to a file, leaving the pool empty
+ * @param pool: The pool
+ * @param path: Destination file, it holds secret randomness
+ */
+int coupon_pool_save(PED_coupon_pool* pool, const char* path){
+
+    FILE* f = fopen(path,"wb");
+    int width = BN_num_bytes(pool->params->p);
+    unsigned char* buf = (unsigned char*) malloc(width);
+    PED_coupon c;
+
+    if (f == NULL){
+        free(buf);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    fwrite(&width,sizeof(int),1,f);
+    fwrite(&pool->count,sizeof(int),1,f);
+
+    while (pool->count > 0){
+        c = pool->ring[pool->head];
+        pool->head = (pool->head+1)%pool->size;
+        pool->count--;
+
+        BN_bn2binpad(c.s,buf,width);
+        fwrite(buf,width,1,f);
+        BN_bn2binpad(c.hs,buf,width);
+        fwrite(buf,width,1,f);
+
+        BN_clear_free(c.s);
+        BN_free(c.hs);
+    }
+
+    pthread_cond_broadcast(&pool->not_full);
+    pthread_mutex_unlock(&pool->lock);
+
+    OPENSSL_cleanse(buf,width);
+    free(buf);
+    fclose(f);
+
+    return 0;
+}
+
+/**
+ * Loads coupons saved with coupon_pool_save and deletes the file, so that
+ * they can never be loaded twice. Coupons that do not fit are discarded.
+ * @return number of coupons added to the pool, -1 if the file cannot be read
+ */
+int coupon_pool_load(PED_coupon_pool* pool, const char* path){
+
+    FILE* f = fopen(path,"rb");
+    int width, count, added=0;
+    unsigned char* buf;
+    PED_coupon c;
+
+    if (f == NULL)
+        return -1;
+
+    if (fread(&width,sizeof(int),1,f) != 1 || fread(&count,sizeof(int),1,f) != 1 || width != BN_num_bytes(pool->params->p)){
+        fclose(f);
+        return -1;
+    }
+
+    buf = (unsigned char*) malloc(width);
+
+    pthread_mutex_lock(&pool->lock);
+
+    for(int i=0; i<count;++i){
+
+        if (fread(buf,width,1,f) != 1)
+            break;
+        c.s = BN_bin2bn(buf,width,NULL);
+        BN_set_flags(c.s,BN_FLG_CONSTTIME);
+
+        if (fread(buf,width,1,f) != 1){
+            BN_clear_free(c.s);
+            break;
+        }
+        c.hs = BN_bin2bn(buf,width,NULL);
+
+        if (coupon_pool_put_locked(pool,&c))
+            added++;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    OPENSSL_cleanse(buf,width);
+    free(buf);
+    fclose(f);
+    remove(path);
+
+    return added;
+}
+
+/**
+ * Commits to m using a coupon for h^s. Falls back to a full commitment
+ * when the pool is NULL or empty.
+ * @param m: Value to commit to
+ * @param params: Pedersen parameters
+ * @param pool: Coupon pool, may be NULL
+ * @param ctx: OpenSSL context
+ */
+PED_commitment* pedersen_commit_coupon(BIGNUM* m, PED_params* params, PED_coupon_pool* pool, BN_CTX* ctx){
+
+    PED_commitment* result;
+    PED_coupon c;
+
+    if (pool == NULL || !coupon_pool_take(pool,&c))
+        return pedersen_commit_params(m,params,ctx);
+
+    result = (PED_commitment*) malloc(sizeof(PED_commitment));
+
+    BN_CTX_start(ctx);
+    BIGNUM* x1 = BN_CTX_get(ctx);
+
+    pedersen_exp(x1,params->g,m,PED_SECRET,params->g_table,params,ctx);
+    ZKP_COUNT(ZKP_CNT_MODEXP,1);
+    pedersen_mod_mul(c.hs,x1,c.hs,params,ctx);
+
+    result->c = c.hs;
+    result->s = c.s;
+
+    BN_CTX_end(ctx);
+
+    return result;
+}
+
+/**
+ * Commits to 0 using a coupon: the commitment is h^s itself
+ */
+PED_commitment* pedersen_commit_zero_coupon(PED_params* params, PED_zero_pool* zeros, PED_coupon_pool* pool, BN_CTX* ctx){
+
+    PED_commitment* result;
+    PED_coupon c;
+
+    if ( (zeros != NULL && zeros->count > 0) || pool == NULL || !coupon_pool_take(pool,&c))
+        return pedersen_commit_zero(params,zeros,ctx);
+
+    result = (PED_commitment*) malloc(sizeof(PED_commitment));
+    result->c = c.hs;
+    result->s = c.s;
+
+    return result;
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef CTX_POOL_H
+#define CTX_POOL_H
+
+#include <openssl/bn.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+One long-lived BN_CTX per thread.
+
+zkp_ctx() returns the context of the calling thread, created on first use
+and freed when the thread exits, so code without a context parameter does
+not need a BN_CTX_new of its own. Temporaries are taken from that context
+inside a scratch scope:
+
+    ZKP_scratch sc = zkp_scratch_begin();
+    BIGNUM* t = zkp_scratch_get(&sc);
+    ...
+    zkp_scratch_end(&sc);
+
+BN_CTX_get reuses the BIGNUMs of previous scopes, so in steady state a
+scope allocates nothing. BIGNUMs returned to the caller must not come from
+a scratch scope. The main thread does not run key destructors: it calls
+zkp_ctx_release before exiting.
+*/
+
+typedef struct zkp_ctx_stats
+{
+    /* data */
+    unsigned long created;
+    unsigned long freed;
+} ZKP_ctx_stats;
+
+typedef struct zkp_scratch
+{
+    /* data */
+    BN_CTX* ctx;
+} ZKP_scratch;
+
+pthread_key_t zkp_ctx_key;
+pthread_once_t zkp_ctx_once = PTHREAD_ONCE_INIT;
+pthread_mutex_t zkp_ctx_lock = PTHREAD_MUTEX_INITIALIZER;
+ZKP_ctx_stats zkp_ctx_counters = {0,0};
+
+void zkp_ctx_destroy(void* ctx){
+
+    BN_CTX_free((BN_CTX*) ctx);
+
+    pthread_mutex_lock(&zkp_ctx_lock);
+    zkp_ctx_counters.freed++;
+    pthread_mutex_unlock(&zkp_ctx_lock);
+}
+
+void zkp_ctx_key_init(){
+    pthread_key_create(&zkp_ctx_key,zkp_ctx_destroy);
+}
+
+/**
+ * Returns the BN_CTX of the calling thread
+ */
+BN_CTX* zkp_ctx(){
+
+    BN_CTX* ctx;
+
+    pthread_once(&zkp_ctx_once,zkp_ctx_key_init);
+
+    ctx = (BN_CTX*) pthread_getspecific(zkp_ctx_key);
+
+    if (ctx == NULL){
+        ctx = BN_CTX_new();
+        pthread_setspecific(zkp_ctx_key,ctx);
+
+        pthread_mutex_lock(&zkp_ctx_lock);
+        zkp_ctx_counters.created++;
+        pthread_mutex_unlock(&zkp_ctx_lock);
+    }
+
+    return ctx;
+}
+
+/**
+ * Frees the BN_CTX of the calling thread now. A later zkp_ctx creates a new one
+ */
+void zkp_ctx_release(){
+
+    BN_CTX* ctx;
+
+    pthread_once(&zkp_ctx_once,zkp_ctx_key_init);
+
+    ctx = (BN_CTX*) pthread_getspecific(zkp_ctx_key);
+
+    if (ctx != NULL){
+        pthread_setspecific(zkp_ctx_key,NULL);
+        zkp_ctx_destroy(ctx);
+    }
+}
+
+/**
+ * Number of contexts created and freed so far, to watch for leaks
+ */
+void zkp_ctx_get_stats(ZKP_ctx_stats* out){
+
+    pthread_mutex_lock(&zkp_ctx_lock);
+    *out = zkp_ctx_counters;
+    pthread_mutex_unlock(&zkp_ctx_lock);
+}
+
+/**
+ * Opens a scratch scope on the context of the calling thread
+ */
+ZKP_scratch zkp_scratch_begin(){
+
+    ZKP_scratch sc;
+
+    sc.ctx = zkp_ctx();
+    BN_CTX_start(sc.ctx);
+
+    return sc;
+}
+
+/**
+ * Returns a zeroed temporary, valid until zkp_scratch_end
+ */
+BIGNUM* zkp_scratch_get(ZKP_scratch* sc){
+    return BN_CTX_get(sc->ctx);
+}
+
+/**
+ * Closes the scope, giving its temporaries back to the context
+ */
+void zkp_scratch_end(ZKP_scratch* sc){
+    BN_CTX_end(sc->ctx);
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef FIXED_BASE_H
+#define FIXED_BASE_H
+
+#include <openssl/bn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixed_mont.h"
+
+// Default window size: 2^4 entries per window
+#define FB_DEFAULT_WINDOW 4
+
+/*
+Fixed-base exponentiation with a precomputed table.
+
+For a base b and window w, entry (i,j) of the table holds b^(j*2^(w*i)) in
+Montgomery form. b^e is then the product of one entry per w-bit digit of e,
+with no squarings. Entries are stored as fixed-width little-endian bytes and
+read with a masked scan of the whole row, so the memory access pattern does
+not depend on the (secret) exponent.
+
+When fixed-width kernels of the same size are attached, the products run on
+the table words directly instead of going through a BIGNUM per window.
+*/
+
+typedef struct fixed_base_table
+{
+    /* data */
+    BN_MONT_CTX* mont;
+    uint64_t* table;
+    int window;
+    int windows;
+    int entries;
+    int words;
+    bool is_short;
+    const FIXED_ops* fx;
+} FB_table;
+
+/**
+ * Precomputes the table for base modulo p, for exponents of at most ebits bits
+ * @param base: The fixed base
+ * @param p: Odd modulus
+ * @param window: Bits of exponent consumed per multiplication
+ * @param ebits: Size of the largest exponent
+ * @param ctx: OpenSSL context
+ */
+FB_table* fixed_base_new_bits(const BIGNUM* base, const BIGNUM* p, int window, int ebits, BN_CTX* ctx){
+
+    FB_table* fb = (FB_table*) malloc(sizeof(FB_table));
+    int i,j;
+
+    BN_CTX_start(ctx);
+    BIGNUM* power = BN_CTX_get(ctx);
+    BIGNUM* cur = BN_CTX_get(ctx);
+
+    fb->mont = BN_MONT_CTX_new();
+    BN_MONT_CTX_set(fb->mont,p,ctx);
+
+    fb->window = window;
+    fb->entries = 1 << window;
+    fb->windows = (ebits+window-1)/window;
+    fb->is_short = ebits < BN_num_bits(p);
+    fb->words = (BN_num_bytes(p)+7)/8;
+    fb->fx = NULL;
+    fb->table = (uint64_t*) malloc(sizeof(uint64_t)*fb->words*fb->entries*fb->windows);
+
+    // power = base^(2^(w*i)) in Montgomery form
+    BN_to_montgomery(power,base,fb->mont,ctx);
+
+    for(i=0; i<fb->windows;++i){
+
+        BN_to_montgomery(cur,BN_value_one(),fb->mont,ctx);
+
+        for(j=0; j<fb->entries;++j){
+            BN_bn2lebinpad(cur,(unsigned char*) (fb->table + (i*fb->entries+j)*fb->words),fb->words*8);
+            BN_mod_mul_montgomery(cur,cur,power,fb->mont,ctx);
+        }
+
+        // After the last entry cur = power^(2^w), the base of the next window
+        BN_copy(power,cur);
+    }
+
+    BN_CTX_end(ctx);
+
+    return fb;
+}
+
+/**
+ * Precomputes the table for base modulo p, for exponents up to the size of p
+ */
+FB_table* fixed_base_new(const BIGNUM* base, const BIGNUM* p, int window, BN_CTX* ctx){
+    return fixed_base_new_bits(base,p,window,BN_num_bits(p),ctx);
+}
+
+/**
+ * Runs the products of fixed_base_exp on fx, if it has the width of the table.
+ * fx uses R = 2^(64*limbs) like the BN_MONT_CTX the table was built with.
+ */
+void fixed_base_attach(FB_table* fb, const FIXED_ops* fx){
+    fb->fx = (FIXED_LITTLE_ENDIAN && fx != NULL && fx->limbs == fb->words) ? fx : NULL;
+}
+
+void fixed_base_free(FB_table* fb){
+    BN_MONT_CTX_free(fb->mont);
+    free(fb->table);
+    free(fb);
+}
+
+/**
+ * Copies entry d of window i into out, reading every entry of the row
+ */
+void fixed_base_select(const FB_table* fb, int i, int d, uint64_t* out){
+
+    const uint64_t* row = fb->table + i*fb->entries*fb->words;
+    uint64_t mask;
+    int j,k;
+
+    memset(out,0,sizeof(uint64_t)*fb->words);
+
+    for(j=0; j<fb->entries;++j){
+        // All ones iff j==d, without branching on d
+        mask = (uint64_t) 0 - (uint64_t) ( ( (uint32_t) (j^d) - 1 ) >> 31 );
+
+        for(k=0; k<fb->words;++k){
+            out[k] |= row[j*fb->words+k] & mask;
+        }
+    }
+}
+
+/**
+ * Digit of window i of the little-endian exponent
+ */
+int fixed_base_digit(const FB_table* fb, const unsigned char* digits, int nbytes, int i){
+
+    int b,bit,d=0;
+
+    for(b=0; b<fb->window;++b){
+        bit = i*fb->window+b;
+        if (bit < nbytes*8)
+            d |= ( (digits[bit>>3] >> (bit&7)) & 1 ) << b;
+    }
+
+    return d;
+}
+
+/**
+ * fixed_base_exp on the fixed-width kernels, entry is scratch of one table entry
+ */
+void fixed_base_exp_words(BIGNUM* r, const FB_table* fb, const unsigned char* digits, uint64_t* entry){
+
+    int nbytes = fb->words*8;
+    uint64_t* acc = (uint64_t*) malloc(nbytes);
+
+    // Window 0 gives the starting value, already in Montgomery form
+    fixed_base_select(fb,0,fixed_base_digit(fb,digits,nbytes,0),acc);
+
+    for(int i=1; i<fb->windows;++i){
+        fixed_base_select(fb,i,fixed_base_digit(fb,digits,nbytes,i),entry);
+        fb->fx->mont_mul(acc,acc,entry,fb->fx->mont);
+    }
+
+    // Multiplying by 1 leaves the Montgomery domain
+    memset(entry,0,nbytes);
+    entry[0] = 1;
+    fb->fx->mont_mul(acc,acc,entry,fb->fx->mont);
+
+    BN_lebin2bn((unsigned char*) acc,nbytes,r);
+    free(acc);
+}
+
+/**
+ * Computes r = base^e mod p using the table. e must have at most the size of p
+ * @param r: Where to store the result
+ * @param fb: Table of the base
+ * @param e: Exponent
+ * @param ctx: OpenSSL context
+ */
+int fixed_base_exp(BIGNUM* r, const FB_table* fb, const BIGNUM* e, BN_CTX* ctx){
+
+    int nbytes = fb->words*8;
+    int i,d;
+
+    uint64_t* entry = (uint64_t*) malloc(nbytes);
+    unsigned char* digits = (unsigned char*) malloc(nbytes);
+
+    if (BN_num_bits(e) > fb->windows*fb->window){
+        free(entry);
+        free(digits);
+        return 0;
+    }
+
+    BN_bn2lebinpad(e,digits,nbytes);
+
+    if (fb->fx != NULL){
+        fixed_base_exp_words(r,fb,digits,entry);
+        OPENSSL_cleanse(digits,nbytes);
+        free(entry);
+        free(digits);
+        return 1;
+    }
+
+    BN_CTX_start(ctx);
+    BIGNUM* t = BN_CTX_get(ctx);
+
+    BN_to_montgomery(r,BN_value_one(),fb->mont,ctx);
+
+    for(i=0; i<fb->windows;++i){
+
+        d = fixed_base_digit(fb,digits,nbytes,i);
+
+        fixed_base_select(fb,i,d,entry);
+        BN_lebin2bn((unsigned char*) entry,nbytes,t);
+        BN_mod_mul_montgomery(r,r,t,fb->mont,ctx);
+    }
+
+    BN_from_montgomery(r,r,fb->mont,ctx);
+
+    BN_CTX_end(ctx);
+
+    // The digits are those of a secret exponent
+    OPENSSL_cleanse(digits,nbytes);
+    free(entry);
+    free(digits);
+
+    return 1;
+}
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef FIXED_MONT_H
+#define FIXED_MONT_H
+
+#include <openssl/bn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+Fixed-width integers and Montgomery arithmetic, specialized by limb count.
+
+FIXED_DEFINE(L) generates a type fixed_uint_L of L 64-bit limbs held inline,
+a Montgomery context fixed_mont_L and the functions fixedL_*. The limb count
+is a compile-time constant in every loop, nothing is heap-allocated and
+there is no dynamic size to track, unlike BIGNUM. Multiplication does not
+branch on the values, so it can take secrets.
+
+With GCC or Clang on x86-64, each row of the Montgomery product can run as
+one unrolled mulx/adcx/adox block with two independent carry chains. The
+block is inline assembly, so no -mbmi2 -madx is needed: the context checks
+the CPU once and falls back to the portable 128-bit multiply-accumulate when
+BMI2 or ADX is missing, as every other target does. Build with
+-DFIXED_PORTABLE to force the portable kernel.
+
+FIXED_ops wraps one specialization behind function pointers, so protocol code
+picks the kernel from the modulus size at runtime.
+*/
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(FIXED_PORTABLE)
+#define FIXED_HAVE_ADX 1
+#else
+#define FIXED_HAVE_ADX 0
+#endif
+
+#if defined(_MSC_VER) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define FIXED_LITTLE_ENDIAN 1
+#else
+#define FIXED_LITTLE_ENDIAN 0
+#endif
+
+/**
+ * (carry, *t) = *t + a*b + carry
+ */
+static inline void fixed_mac(uint64_t* t, uint64_t a, uint64_t b, uint64_t* carry){
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128) a * b + *t + *carry;
+    *t = (uint64_t) p;
+    *carry = (uint64_t) (p >> 64);
+#else
+    uint64_t hi, lo = _umul128(a,b,&hi);
+    unsigned char c = _addcarry_u64(0,lo,*t,&lo);
+    _addcarry_u64(c,hi,0,&hi);
+    c = _addcarry_u64(0,lo,*carry,&lo);
+    _addcarry_u64(c,hi,0,&hi);
+    *t = lo;
+    *carry = hi;
+#endif
+}
+
+/**
+ * (carry, *t) = *t + carry
+ */
+static inline void fixed_adc(uint64_t* t, uint64_t* carry){
+    uint64_t v = *t + *carry;
+    *carry = v < *t;
+    *t = v;
+}
+
+/**
+ * Tells whether the mulx/adcx/adox rows can run on this CPU
+ */
+bool fixed_has_adx(){
+#if FIXED_HAVE_ADX
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+#else
+    return false;
+#endif
+}
+
+/*
+Bodies of the Montgomery product: both copy a*b/R to r->d and leave the top
+limb, 0 or 1, in top. The ADX version keeps a 2L-limb accumulator and slides
+the row window instead of shifting after each reduction step.
+*/
+#if FIXED_HAVE_ADX
+#define FIXED_DEFINE_ROW(L) \
+/* t[0..L+1] += a*b, t[L+1] must not overflow */ \
+static inline void fixed##L##_row(uint64_t* t, const uint64_t* a, uint64_t b){ \
+    __asm__ volatile( \
+        "xorl %%r10d, %%r10d\n\t" \
+        ".set .Lfixed_off, 0\n\t" \
+        ".rept %c[limbs]\n\t" \
+        "mulxq .Lfixed_off(%[a]), %%rax, %%r11\n\t" \
+        "movq .Lfixed_off(%[t]), %%r9\n\t" \
+        "adcxq %%rax, %%r9\n\t" \
+        "adoxq %%r10, %%r9\n\t" \
+        "movq %%r9, .Lfixed_off(%[t])\n\t" \
+        "movq %%r11, %%r10\n\t" \
+        ".set .Lfixed_off, .Lfixed_off+8\n\t" \
+        ".endr\n\t" \
+        "movq $0, %%r11\n\t" \
+        "movq .Lfixed_off(%[t]), %%r9\n\t" \
+        "adcxq %%r11, %%r9\n\t" \
+        "adoxq %%r10, %%r9\n\t" \
+        "movq %%r9, .Lfixed_off(%[t])\n\t" \
+        "movq .Lfixed_off+8(%[t]), %%r9\n\t" \
+        "adcxq %%r11, %%r9\n\t" \
+        "adoxq %%r11, %%r9\n\t" \
+        "movq %%r9, .Lfixed_off+8(%[t])\n\t" \
+        : "+d"(b) \
+        : [t] "r"(t), [a] "r"(a), [limbs] "i"(L) \
+        : "rax", "r9", "r10", "r11", "cc", "memory"); \
+}
+
+#define FIXED_MONT_MUL_ADX(L) \
+    uint64_t acc[2*L+2]; \
+    uint64_t* t = acc+L; \
+    memset(acc,0,sizeof(acc)); \
+    for(int i=0; i<L;++i){ \
+        fixed##L##_row(acc+i,a->d,b->d[i]); \
+        fixed##L##_row(acc+i,m->n.d,acc[i]*m->n0); \
+    } \
+    memcpy(r->d,t,8*L); \
+    top = t[L];
+
+#define FIXED_MONT_MUL_BODY(L) \
+    if (m->use_adx){ \
+        FIXED_MONT_MUL_ADX(L) \
+    } \
+    else{ \
+        FIXED_MONT_MUL_CIOS(L) \
+    }
+#else
+#define FIXED_DEFINE_ROW(L)
+
+#define FIXED_MONT_MUL_BODY(L) \
+    { \
+        FIXED_MONT_MUL_CIOS(L) \
+    }
+#endif
+
+#define FIXED_MONT_MUL_CIOS(L) \
+    uint64_t t[L+2]; \
+    uint64_t q; \
+    memset(t,0,sizeof(t)); \
+    for(int i=0; i<L;++i){ \
+        c = 0; \
+        for(int j=0; j<L;++j) fixed_mac(&t[j],a->d[j],b->d[i],&c); \
+        fixed_adc(&t[L],&c); \
+        t[L+1] = c; \
+        q = t[0]*m->n0; \
+        c = 0; \
+        fixed_mac(&t[0],q,m->n.d[0],&c); \
+        for(int j=1; j<L;++j){ \
+            fixed_mac(&t[j],q,m->n.d[j],&c); \
+            t[j-1] = t[j]; \
+        } \
+        fixed_adc(&t[L],&c); \
+        t[L-1] = t[L]; \
+        t[L] = t[L+1] + c; \
+    } \
+    memcpy(r->d,t,8*L); \
+    top = t[L];
+
+#define FIXED_DEFINE(L) \
+\
+typedef struct { uint64_t d[L]; } fixed_uint_##L; \
+\
+typedef struct \
+{ \
+    fixed_uint_##L n; \
+    fixed_uint_##L rr; \
+    fixed_uint_##L one; \
+    uint64_t n0; \
+    bool use_adx; \
+} fixed_mont_##L; \
+\
+void fixed##L##_from_bn(fixed_uint_##L* r, const BIGNUM* x){ \
+    unsigned char b[8*L]; \
+    if (FIXED_LITTLE_ENDIAN){ \
+        BN_bn2lebinpad(x,(unsigned char*) r->d,8*L); \
+        return; \
+    } \
+    BN_bn2lebinpad(x,b,8*L); \
+    for(int i=0; i<L;++i){ \
+        uint64_t v = 0; \
+        for(int k=7; k>=0;--k) v = (v << 8) | b[8*i+k]; \
+        r->d[i] = v; \
+    } \
+} \
+\
+void fixed##L##_to_bn(BIGNUM* r, const fixed_uint_##L* x){ \
+    unsigned char b[8*L]; \
+    if (FIXED_LITTLE_ENDIAN){ \
+        BN_lebin2bn((const unsigned char*) x->d,8*L,r); \
+        return; \
+    } \
+    for(int i=0; i<L;++i){ \
+        for(int k=0; k<8;++k) b[8*i+k] = (unsigned char) (x->d[i] >> (8*k)); \
+    } \
+    BN_lebin2bn(b,8*L,r); \
+} \
+\
+/* r = a - b, returns the borrow */ \
+uint64_t fixed##L##_sub(fixed_uint_##L* r, const fixed_uint_##L* a, const fixed_uint_##L* b){ \
+    uint64_t borrow = 0, x, y; \
+    for(int i=0; i<L;++i){ \
+        x = a->d[i]; \
+        y = b->d[i] + borrow; \
+        borrow = (y < borrow) | (x < y); \
+        r->d[i] = x - y; \
+    } \
+    return borrow; \
+} \
+\
+FIXED_DEFINE_ROW(L) \
+/* r = a*b/R mod n, for a, b < n */ \
+void fixed##L##_mont_mul(fixed_uint_##L* r, const fixed_uint_##L* a, const fixed_uint_##L* b, const fixed_mont_##L* m){ \
+    uint64_t c, mask, top; \
+    fixed_uint_##L s; \
+    FIXED_MONT_MUL_BODY(L) \
+    /* r < 2n: subtract n unless that borrows past the top limb */ \
+    c = fixed##L##_sub(&s,r,&m->n); \
+    mask = (uint64_t) 0 - (uint64_t) ( (top | (c ^ 1)) & 1 ); \
+    for(int i=0; i<L;++i) r->d[i] = (s.d[i] & mask) | (r->d[i] & ~mask); \
+} \
+\
+/* Returns false if n is even or does not fit L limbs */ \
+bool fixed##L##_mont_init(fixed_mont_##L* m, const BIGNUM* n, BN_CTX* ctx){ \
+    uint64_t inv = 1; \
+    if (!BN_is_odd(n) || BN_num_bits(n) > 64*L) \
+        return false; \
+    BN_CTX_start(ctx); \
+    BIGNUM* t = BN_CTX_get(ctx); \
+    fixed##L##_from_bn(&m->n,n); \
+    for(int i=0; i<6;++i) inv = inv * (2 - m->n.d[0]*inv); \
+    m->n0 = 0 - inv; \
+    m->use_adx = fixed_has_adx(); \
+    BN_zero(t); \
+    BN_set_bit(t,2*64*L); \
+    BN_mod(t,t,n,ctx); \
+    fixed##L##_from_bn(&m->rr,t); \
+    BN_zero(t); \
+    BN_set_bit(t,64*L); \
+    BN_mod(t,t,n,ctx); \
+    fixed##L##_from_bn(&m->one,t); \
+    BN_CTX_end(ctx); \
+    return true; \
+} \
+\
+int fixed##L##_bn_mod_mul(BIGNUM* r, const BIGNUM* a, const BIGNUM* b, const void* mont){ \
+    const fixed_mont_##L* m = (const fixed_mont_##L*) mont; \
+    fixed_uint_##L x, y; \
+    fixed##L##_from_bn(&x,a); \
+    fixed##L##_from_bn(&y,b); \
+    fixed##L##_mont_mul(&x,&x,&y,m); \
+    fixed##L##_mont_mul(&x,&x,&m->rr,m); \
+    fixed##L##_to_bn(r,&x); \
+    return 1; \
+} \
+\
+/* r = product of the k entries idx[j] of c, c holding values of L \
+   limbs back to back. The factors are not converted to \
+   the Montgomery domain: after k of them acc is the product times R^-k, and \
+   a single multiplication by R^(k+1) in Montgomery form fixes it. k is \
+   public, so R^(k+1) is computed by plain square-and-multiply. */ \
+int fixed##L##_mod_prod(BIGNUM* r, const uint64_t* c, const int* idx, int k, const void* mont){ \
+    const fixed_mont_##L* m = (const fixed_mont_##L*) mont; \
+    fixed_uint_##L acc, rk; \
+    int b = 30; \
+    memset(&acc,0,sizeof(acc)); \
+    acc.d[0] = 1; \
+    for(int j=0; j<k;++j){ \
+        fixed##L##_mont_mul(&acc,&acc,(const fixed_uint_##L*) (c + (size_t) idx[j]*L),m); \
+    } \
+    rk = m->one; \
+    while (b > 0 && !( (k >> b) & 1 )) --b; \
+    for(; b>=0;--b){ \
+        fixed##L##_mont_mul(&rk,&rk,&rk,m); \
+        if ( (k >> b) & 1 ) fixed##L##_mont_mul(&rk,&rk,&m->rr,m); \
+    } \
+    fixed##L##_mont_mul(&acc,&acc,&rk,m); \
+    fixed##L##_to_bn(r,&acc); \
+    return 1; \
+} \
+\
+/* Montgomery product on raw little-endian limbs, e.g. BN_MONT_CTX tables of the same modulus */ \
+void fixed##L##_mont_mul_words(uint64_t* r, const uint64_t* a, const uint64_t* b, const void* mont){ \
+    fixed##L##_mont_mul((fixed_uint_##L*) r,(const fixed_uint_##L*) a,(const fixed_uint_##L*) b,(const fixed_mont_##L*) mont); \
+} \
+\
+void* fixed##L##_ctx_new(const BIGNUM* n, BN_CTX* ctx){ \
+    fixed_mont_##L* m = (fixed_mont_##L*) malloc(sizeof(fixed_mont_##L)); \
+    if (!fixed##L##_mont_init(m,n,ctx)){ \
+        free(m); \
+        return NULL; \
+    } \
+    return m; \
+}
+
+FIXED_DEFINE(32)    // 2048 bits
+FIXED_DEFINE(48)    // 3072 bits
+FIXED_DEFINE(64)    // 4096 bits
+
+/*
+Runtime handle on one specialization
+*/
+typedef struct fixed_ops
+{
+    /* data */
+    int limbs;
+    void* mont;
+    int (*mod_mul)(BIGNUM* r, const BIGNUM* a, const BIGNUM* b, const void* mont);
+    int (*mod_prod)(BIGNUM* r, const uint64_t* c, const int* idx, int k, const void* mont);
+    void (*mont_mul)(uint64_t* r, const uint64_t* a, const uint64_t* b, const void* mont);
+} FIXED_ops;
+
+/**
+ * Returns the kernels specialized for the size of n, or NULL if there are none
+ * @param n: Odd modulus
+ * @param ctx: OpenSSL context
+ */
+FIXED_ops* fixed_ops_new(const BIGNUM* n, BN_CTX* ctx){
+
+    FIXED_ops* ops;
+    int limbs = (BN_num_bits(n)+63)/64;
+
+    // The word arrays the kernels share with the tables are little-endian bytes
+    if (!FIXED_LITTLE_ENDIAN)
+        return NULL;
+
+    ops = (FIXED_ops*) malloc(sizeof(FIXED_ops));
+    ops->limbs = limbs;
+
+    switch (limbs)
+    {
+    case 32:
+        ops->mont = fixed32_ctx_new(n,ctx);
+        ops->mod_mul = fixed32_bn_mod_mul;
+        ops->mod_prod = fixed32_mod_prod;
+        ops->mont_mul = fixed32_mont_mul_words;
+        break;
+    case 48:
+        ops->mont = fixed48_ctx_new(n,ctx);
+        ops->mod_mul = fixed48_bn_mod_mul;
+        ops->mod_prod = fixed48_mod_prod;
+        ops->mont_mul = fixed48_mont_mul_words;
+        break;
+    case 64:
+        ops->mont = fixed64_ctx_new(n,ctx);
+        ops->mod_mul = fixed64_bn_mod_mul;
+        ops->mod_prod = fixed64_mod_prod;
+        ops->mont_mul = fixed64_mont_mul_words;
+        break;
+    default:
+        ops->mont = NULL;
+    }
+
+    if (ops->mont == NULL){
+        free(ops);
+        return NULL;
+    }
+
+    return ops;
+}
+
+void fixed_ops_free(FIXED_ops* ops){
+    free(ops->mont);
+    free(ops);
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include <openssl/bn.h>
 
 #include "utils.h"
+#include "ctx_pool.h"
+#include "zkp_trace.h"
 
 #define GL_BITS 2048
 
@@ -35,8 +37,6 @@ BIGNUM* one_way_permutation(BIGNUM* x){
         BN_dec2bn(&gen,"2");
 
 
-    BN_CTX* ctx = BN_CTX_new();
-
     if (safeprime==NULL){
         DEBUG_PRINT("Searching for safe prime...\n");
         safeprime=BN_new();
@@ -45,7 +45,9 @@ BIGNUM* one_way_permutation(BIGNUM* x){
 
     BIGNUM* r=BN_new();
 
-    BN_mod_exp(r,gen,x,safeprime,ctx);
+    // x is the secret input of the one-way permutation
+    BN_mod_exp_mont_consttime(r,gen,x,safeprime,zkp_ctx(),NULL);
+    ZKP_COUNT(ZKP_CNT_MODEXP,1);
 
     return r;
 }
@@ -91,9 +93,12 @@ GL_COMMIT* gl_commit(char b){
     BIGNUM* x = BN_new();
     BIGNUM* r = BN_new();
 
+    ZKP_SPAN_BEGIN(span,"gl.commit");
+
     DEBUG_PRINT("Generating random inputs\n");
     BN_rand(x,GL_BITS,0,0);
     BN_rand(r,GL_BITS,0,0);
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,2*GL_BITS/8);
 
     // Compute g(x,r)
     DEBUG_PRINT("Computing one-way function\n");
@@ -115,6 +120,8 @@ GL_COMMIT* gl_commit(char b){
     commitment->masked_b = masked;
     commitment->inputs = inputs;
 
+    ZKP_SPAN_END(span);
+
     return commitment;
 }
 
@@ -123,18 +130,20 @@ GL_COMMIT* gl_commit(char b){
 */
 bool gl_verify( char b, GL_COMMIT comm){
 
+    ZKP_SPAN_BEGIN(span,"gl.verify");
+
     BN_pair* computed_f = g(comm.inputs);
     int computed_h = H_predicate(comm.inputs->x,comm.inputs->y);
+    bool res = true;
 
     if (b ^ ((char) computed_h) != comm.masked_b){
         int c1,c2;
         c1 = (int) (b ^ ((char) computed_h));
         c2 = (int) comm.masked_b;
         DEBUG_PRINT("Masked commitment values do not match! %d vs %d\n",c1,c2);
-        return false;
+        res = false;
     }
-
-    if (BN_cmp(computed_f->x,comm.f->x) != 0 || BN_cmp(computed_f->y,comm.f->y) != 0)
+    else if (BN_cmp(computed_f->x,comm.f->x) != 0 || BN_cmp(computed_f->y,comm.f->y) != 0)
     {
         DEBUG_PRINT("One-way permutation does not match!\n");
 
@@ -145,10 +154,16 @@ bool gl_verify( char b, GL_COMMIT comm){
         if (BN_cmp(computed_f->y,comm.f->y) != 0){
             DEBUG_PRINT("Failed y comparison\n");
         }
-        return false;
+        res = false;
     }
-    
-    return true;
+
+    // The y of g is the r of the commitment, not a copy
+    BN_free(computed_f->x);
+    free(computed_f);
+
+    ZKP_SPAN_END(span);
+
+    return res;
 }
 
 
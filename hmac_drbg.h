@@ -45,20 +45,30 @@ unsigned char* concatenate(unsigned char* x, unsigned char* y, unsigned int len1
 
 }
 
+/**
+ * Replaces the key and value of the state, freeing the previous ones
+*/
+void drbg_set_state(PRNG_STATE* state, unsigned char* K, unsigned char* V){
+
+    free(state->K);
+    free(state->V);
+
+    state->K = K;
+    state->V = V;
+}
+
 /**
  * Update function used in the HMAC_DRBG NIST specification
 */
 int Update(PRNG_STATE* state, unsigned char* addin){
 
-    unsigned char* K = (unsigned char*) malloc(sizeof(KEY_SIZE));
-    unsigned char* V = (unsigned char*) malloc(sizeof(V_SIZE));
+    unsigned char* K = (unsigned char*) malloc(KEY_SIZE);
+    unsigned char* V = (unsigned char*) malloc(V_SIZE);
     unsigned char* res;
     unsigned int md_len, tot_size;
 
     res = (addin != NULL)? concatenate(state->V,addin,V_SIZE,ADDIN_SIZE,0x00) : concatenate(state->V,addin,V_SIZE,0,0x00);
 
-    printf("%s\n",res);
-
     DEBUG_PRINT("Concatenated\n");
 
     tot_size = addin==NULL ? V_SIZE + 1 : V_SIZE + 1 + ADDIN_SIZE;
@@ -80,19 +90,20 @@ int Update(PRNG_STATE* state, unsigned char* addin){
 
         DEBUG_PRINT("Null addin\n");
 
-        state->K = K;
-        state->V = V;
+        free(res);
+        drbg_set_state(state,K,V);
 
         return 0;
     }
     else{
+        free(res);
         res = concatenate(V,addin,V_SIZE,ADDIN_SIZE,0x01);
 
         K = HMAC(EVP_GET_HASH(),K,KEY_SIZE,res,V_SIZE +1+ ADDIN_SIZE,K,&md_len);
         V = HMAC(EVP_GET_HASH(),K,KEY_SIZE,V,V_SIZE,V,&md_len);
 
-        state->K = K;
-        state->V = V;
+        free(res);
+        drbg_set_state(state,K,V);
 
         return 0;
     }
@@ -131,14 +142,15 @@ unsigned char* DRBG_Generate(unsigned char* addin, int requested){
     int len=0;
     unsigned int md_len;
     unsigned char* tmp=NULL;
+    unsigned char* grown;
 
-    printf("%d %d",len,requested);
     while (len < requested)
     {
         /* code */
-        puts("updating");
         HMAC(EVP_GET_HASH(),drbg_state->K,KEY_SIZE,drbg_state->V,V_SIZE,drbg_state->V,&md_len);
-        tmp=concatenate(tmp,drbg_state->V,len,V_SIZE,CONCAT_NO_MIDDLE_VAL);
+        grown=concatenate(tmp,drbg_state->V,len,V_SIZE,CONCAT_NO_MIDDLE_VAL);
+        free(tmp);
+        tmp=grown;
         len += V_SIZE;
     }
 
@@ -146,6 +158,7 @@ unsigned char* DRBG_Generate(unsigned char* addin, int requested){
 
     //Extract leftmost bits of tmp
     s = leftmost(tmp,requested);
+    free(tmp);
     Update(drbg_state,addin);
 
     // Update counter
@@ -163,8 +176,8 @@ void DRBG_Instantiate(unsigned char* addin){
 
     drbg_state = (PRNG_STATE*) malloc(sizeof(PRNG_STATE));
 
-    unsigned char* key = (unsigned char*) malloc(sizeof(KEY_SIZE));
-    unsigned char* V = (unsigned char*) malloc(sizeof(V_SIZE));
+    unsigned char* key = (unsigned char*) malloc(KEY_SIZE);
+    unsigned char* V = (unsigned char*) malloc(V_SIZE);
 
     memset(key,0,KEY_SIZE);
     memset(V,0x01,V_SIZE);
@@ -1,26 +1,34 @@
 #include <openssl/bn.h>
+#include "ctx_pool.h"
 
-#define BITS 1024
+#define FACT_BITS 1024
 
 BIGNUM* commit(BIGNUM* m){
 
-    BIGNUM* p = BN_new();
-    BIGNUM* q = BN_new();
-    BIGNUM* r = BN_new();
-    BIGNUM* s = BN_new();
+    ZKP_scratch sc = zkp_scratch_begin();
+
+    BIGNUM* p = zkp_scratch_get(&sc);
+    BIGNUM* q = zkp_scratch_get(&sc);
+    BIGNUM* r = zkp_scratch_get(&sc);
+    BIGNUM* s = zkp_scratch_get(&sc);
+    BIGNUM* M = zkp_scratch_get(&sc);
     BIGNUM* N = BN_new();
-    BIGNUM* M = BN_new();
 
-    BN_CTX* ctx1 = BN_CTX_new();
-    BN_CTX* ctx2 = BN_CTX_new();
+    BN_generate_prime_ex(p,FACT_BITS,0,NULL,NULL,NULL);
+    BN_generate_prime_ex(q,FACT_BITS,0,NULL,NULL,NULL);
+    BN_generate_prime_ex(r,FACT_BITS,0,NULL,NULL,NULL);
+    BN_generate_prime_ex(s,FACT_BITS,0,NULL,NULL,NULL);
+
+    BN_mul(N,p,q,sc.ctx);
+    BN_mul(M,p,q,sc.ctx);
 
-    BN_generate_prime_ex(p,BITS,0,NULL,NULL,NULL);
-    BN_generate_prime_ex(q,BITS,0,NULL,NULL,NULL);
-    BN_generate_prime_ex(r,BITS,0,NULL,NULL,NULL);
-    BN_generate_prime_ex(s,BITS,0,NULL,NULL,NULL);
+    // The factors are secret
+    BN_clear(p);
+    BN_clear(q);
+    BN_clear(r);
+    BN_clear(s);
 
-    BN_mul(N,p,q,ctx1);
-    BN_mul(M,p,q,ctx2);
+    zkp_scratch_end(&sc);
 
     return N;
 }
\ No newline at end of file
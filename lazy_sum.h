@@ -0,0 +1,314 @@
+#ifndef LAZY_SUM_H
+#define LAZY_SUM_H
+
+#include <openssl/bn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Additions a column can absorb before its pending carries must be folded
+#define LAZY_MAX_ADDS 0xFFFFFFFFUL
+
+// Below this many elements the parallel split costs more than it saves
+#define LAZY_PARALLEL_MIN 1024
+
+/*
+Lazy-reduction accumulator for sums of BIGNUMs modulo M.
+
+Values are split into 32-bit digits and each digit is added into its own
+64-bit column without propagating carries (carry-save form). Columns are
+independent of each other, so the inner loop is a plain element-wise add
+the compiler turns into vector code. Carries are folded once, and the
+modular reduction is done once, when the sum is extracted.
+*/
+
+typedef void (*lazy_add_kernel)(uint64_t* cols, const unsigned char* b, int nd);
+
+typedef struct lazy_accumulator
+{
+    /* data */
+    uint64_t* cols;
+    unsigned char* buf;
+    int ndigits;
+    int ncols;
+    unsigned long adds;
+    lazy_add_kernel add;
+} LAZY_acc;
+
+#define LAZY_LOAD32(b) ( (uint64_t) (b)[0] | (uint64_t) (b)[1] << 8 | \
+                         (uint64_t) (b)[2] << 16 | (uint64_t) (b)[3] << 24 )
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define LAZY_UNROLL _Pragma("GCC unroll 128")
+#elif defined(__clang__)
+#define LAZY_UNROLL _Pragma("unroll")
+#else
+#define LAZY_UNROLL
+#endif
+
+/**
+ * Generic column add, for any number of digits
+ */
+void lazy_add_digits_any(uint64_t* cols, const unsigned char* b, int nd){
+
+    for(int j=0; j<nd;++j){
+        cols[j] += LAZY_LOAD32(b+4*j);
+    }
+}
+
+/*
+Column adds specialized for the common modulus sizes. The digit count is a
+compile-time constant, so the loop is fully unrolled.
+*/
+#define LAZY_DEFINE_FIXED_ADD(ND) \
+void lazy_add_digits_##ND(uint64_t* cols, const unsigned char* b, int nd){ \
+    (void) nd; \
+    LAZY_UNROLL \
+    for(int j=0; j<ND;++j){ \
+        cols[j] += LAZY_LOAD32(b+4*j); \
+    } \
+}
+
+LAZY_DEFINE_FIXED_ADD(64)   // 2048 bits
+LAZY_DEFINE_FIXED_ADD(96)   // 3072 bits
+LAZY_DEFINE_FIXED_ADD(128)  // 4096 bits
+
+/**
+ * Selects the column add kernel for a given number of digits
+ */
+lazy_add_kernel lazy_select_kernel(int ndigits){
+
+    switch (ndigits)
+    {
+    case 64:
+        return lazy_add_digits_64;
+    case 96:
+        return lazy_add_digits_96;
+    case 128:
+        return lazy_add_digits_128;
+    default:
+        return lazy_add_digits_any;
+    }
+}
+
+/**
+ * Creates an empty accumulator for values of at most bits bits
+ * @param bits: Maximum size of the added values
+ */
+LAZY_acc* lazy_acc_new(int bits){
+
+    LAZY_acc* acc = (LAZY_acc*) malloc(sizeof(LAZY_acc));
+
+    acc->ndigits = (bits+31)/32;
+    // Two spare columns hold the carries of up to 2^64 additions
+    acc->ncols = acc->ndigits + 2;
+    acc->cols = (uint64_t*) calloc(acc->ncols,sizeof(uint64_t));
+    acc->buf = (unsigned char*) malloc(acc->ncols*4);
+    acc->adds = 0;
+    acc->add = lazy_select_kernel(acc->ndigits);
+
+    return acc;
+}
+
+void lazy_acc_free(LAZY_acc* acc){
+    free(acc->cols);
+    free(acc->buf);
+    free(acc);
+}
+
+void lazy_acc_reset(LAZY_acc* acc){
+    memset(acc->cols,0,acc->ncols*sizeof(uint64_t));
+    acc->adds = 0;
+}
+
+/**
+ * Folds the pending carries so that every column holds a single digit again
+ */
+void lazy_acc_normalize(LAZY_acc* acc){
+
+    uint64_t carry = 0, v;
+
+    for(int j=0; j<acc->ncols;++j){
+        v = acc->cols[j] + carry;
+        acc->cols[j] = v & 0xFFFFFFFFULL;
+        carry = v >> 32;
+    }
+
+    acc->adds = 0;
+}
+
+/**
+ * Adds a BIGNUM to the accumulator, without reducing
+ * @param acc: The accumulator
+ * @param x: Value to add, at most the size given to lazy_acc_new
+ */
+void lazy_acc_add(LAZY_acc* acc, const BIGNUM* x){
+
+    if (acc->adds == LAZY_MAX_ADDS)
+        lazy_acc_normalize(acc);
+
+    BN_bn2lebinpad(x,acc->buf,acc->ndigits*4);
+    acc->add(acc->cols,acc->buf,acc->ndigits);
+
+    acc->adds++;
+}
+
+/**
+ * Adds a value stored as little-endian bytes, at least 4*ndigits of them
+ */
+void lazy_acc_add_bytes(LAZY_acc* acc, const unsigned char* b){
+
+    if (acc->adds == LAZY_MAX_ADDS)
+        lazy_acc_normalize(acc);
+
+    acc->add(acc->cols,b,acc->ndigits);
+
+    acc->adds++;
+}
+
+/**
+ * Adds the content of src to dst. Both must have been created with the same size
+ */
+void lazy_acc_merge(LAZY_acc* dst, LAZY_acc* src){
+
+    lazy_acc_normalize(dst);
+    lazy_acc_normalize(src);
+
+    for(int j=0; j<dst->ncols;++j){
+        dst->cols[j] += src->cols[j];
+    }
+
+    dst->adds = 1;
+}
+
+/**
+ * Extracts the accumulated sum reduced modulo M. The accumulator is left normalized
+ * @param acc: The accumulator
+ * @param r: Where to store the result
+ * @param M: Modulus
+ * @param ctx: OpenSSL context
+ */
+int lazy_acc_reduce(LAZY_acc* acc, BIGNUM* r, const BIGNUM* M, BN_CTX* ctx){
+
+    unsigned char* b = acc->buf;
+
+    lazy_acc_normalize(acc);
+
+    for(int j=0; j<acc->ncols;++j){
+        b[4*j] = (unsigned char) acc->cols[j];
+        b[4*j+1] = (unsigned char) (acc->cols[j] >> 8);
+        b[4*j+2] = (unsigned char) (acc->cols[j] >> 16);
+        b[4*j+3] = (unsigned char) (acc->cols[j] >> 24);
+    }
+
+    if (BN_lebin2bn(b,acc->ncols*4,r) == NULL)
+        return 0;
+
+    return BN_nnmod(r,r,M,ctx);
+}
+
+/**
+ * Computes the sum modulo M of the elements of a selected by sel.
+ * Large arrays are split in chunks summed in parallel when OpenMP is enabled.
+ * @param r: Where to store the result
+ * @param a: Array of values, each smaller than M
+ * @param sel: sel[i]==1 iff a[i] is part of the sum
+ * @param n: Size of a and sel
+ * @param M: Modulus
+ * @param ctx: OpenSSL context
+ */
+int lazy_sum_selected(BIGNUM* r, BIGNUM** a, const char* sel, int n, const BIGNUM* M, BN_CTX* ctx){
+
+    int bits = BN_num_bits(M);
+    LAZY_acc* acc = lazy_acc_new(bits);
+    int res;
+
+#ifdef _OPENMP
+    if (n >= LAZY_PARALLEL_MIN){
+
+        #pragma omp parallel
+        {
+            LAZY_acc* local = lazy_acc_new(bits);
+
+            #pragma omp for schedule(static)
+            for(int i=0; i<n;++i){
+                if (sel[i]==1)
+                    lazy_acc_add(local,a[i]);
+            }
+
+            #pragma omp critical
+            lazy_acc_merge(acc,local);
+
+            lazy_acc_free(local);
+        }
+    }
+    else
+#endif
+    {
+        for(int i=0; i<n;++i){
+            if (sel[i]==1)
+                lazy_acc_add(acc,a[i]);
+        }
+    }
+
+    res = lazy_acc_reduce(acc,r,M,ctx);
+    lazy_acc_free(acc);
+
+    return res;
+}
+
+/**
+ * Sums into acc, then extracts modulo M, the values of a selected by sel.
+ * a holds n values back to back as little-endian bytes, words 64-bit words
+ * each, as in a commitment vector. acc is reset first, so it can be reused.
+ */
+int lazy_acc_sum_selected_words(LAZY_acc* acc, BIGNUM* r, const uint64_t* a, int words, const char* sel, int n, const BIGNUM* M, BN_CTX* ctx){
+
+    if (acc->ndigits > 2*words)
+        return 0;
+
+    lazy_acc_reset(acc);
+
+    for(int i=0; i<n;++i){
+        if (sel[i]==1)
+            lazy_acc_add_bytes(acc,(const unsigned char*) (a + (size_t) i*words));
+    }
+
+    return lazy_acc_reduce(acc,r,M,ctx);
+}
+
+/**
+ * lazy_acc_sum_selected_words over the k values at positions idx, without
+ * scanning the unselected ones
+ */
+int lazy_acc_sum_indexed_words(LAZY_acc* acc, BIGNUM* r, const uint64_t* a, int words, const int* idx, int k, const BIGNUM* M, BN_CTX* ctx){
+
+    if (acc->ndigits > 2*words)
+        return 0;
+
+    lazy_acc_reset(acc);
+
+    for(int j=0; j<k;++j)
+        lazy_acc_add_bytes(acc,(const unsigned char*) (a + (size_t) idx[j]*words));
+
+    return lazy_acc_reduce(acc,r,M,ctx);
+}
+
+/**
+ * lazy_sum_selected over values stored as in a commitment vector
+ */
+int lazy_sum_selected_words(BIGNUM* r, const uint64_t* a, int words, const char* sel, int n, const BIGNUM* M, BN_CTX* ctx){
+
+    LAZY_acc* acc = lazy_acc_new(BN_num_bits(M));
+    int res = lazy_acc_sum_selected_words(acc,r,a,words,sel,n,M,ctx);
+
+    lazy_acc_free(acc);
+
+    return res;
+}
+
+#endif
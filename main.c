@@ -1,17 +1,26 @@
 #include "pedersen.h"
 #include "zkp_fixed_size.h"
 #include "zkp_variable_size.h"
+#include "zkp_engine.h"
+#include "zkp_batch.h"
+#include "zkp_ipa.h"
+#include "zkp_multi.h"
 #include <openssl/bn.h>
 
 #include <time.h>
 #include <stdlib.h>
-#include <intrin.h>
-
-#pragma intrinsic(__rdtsc)
+#include "zkp_timer.h"
 
 #define SHOTS 1000
 
-#define CPU_FREQ 2100000000
+// Refill threads of the coupon pool
+#define COUPON_THREADS 2
+
+// Rounds run through the protocol engine, in memory
+#define ENGINE_ROUNDS 4
+
+// Provers of the same statement verified in one batch
+#define BATCH_PROVERS 4
 
 //#define DEBUG
 
@@ -23,11 +32,26 @@
 #define PUTS // macros
 #endif
 
-int main(){
+void variable_length(PROVER_data* prover, VERIFIER_data* verifier, ZKP_transcript transcript);
+void batch_of_proofs(PED_params* param, KSS_instance* inst, PED_coupon_pool* coupons, VERIFIER_data* verifier);
+void inner_product_proof(PED_params* param, KSS_instance* inst, BN_CTX* ctx);
+void multi_challenge_round(PROVER_data* prover, VERIFIER_data* verifier, int soundness);
+
+int main(int argc, char** argv){
+
+    ZKP_config cfg;
+
+    // Before OpenSSL allocates, for the allocation counter
+    zkp_trace_init();
+
+    if (!zkp_config_from_args(&cfg,argc,argv)){
+        puts("Usage: main [n] [k] [bits] [full|merkle] [mbits] [depth] [shards] [soundness]");
+        exit(1);
+    }
 
-    BN_CTX* ctx = BN_CTX_new();
+    BN_CTX* ctx = zkp_ctx();
 
-    PED_params* param = pedersen_get_param(ctx); //pedersen_init(ctx);
+    PED_params* param = pedersen_get_param(cfg.bits,ctx); //pedersen_init(cfg.bits,ctx);
 
     BIGNUM* m = BN_new();
     BIGNUM* t= BN_new();
@@ -37,18 +61,28 @@ int main(){
 
     BN_rand_range(m,param->p);
     
-    PED_commitment* comm = pedersen_commit(m,param->p,param->g,param->h,ctx);
-    bool res = pederesen_unveil(comm->c,comm->s,m,param->p,param->g,param->h,ctx);
+    PED_commitment* comm = pedersen_commit_params(m,param,ctx);
+    bool res = pedersen_unveil_params(comm->c,comm->s,m,param,ctx);
     
     if (res){
         PUTS("Test SUCCESS!\n");
     }
 
     pedersen_save_param(param);
+    pedersen_precompute(param,FB_DEFAULT_WINDOW,ctx);
     
     BIGNUM* M = BN_new();
-    BN_sub(M,param->p,BN_value_one());
-    KSS_instance* inst=gen_instance(M,ctx,N_VAR);
+
+    if (cfg.mbits > 0){
+        // Short instance modulus, independent of the commitment group
+        BN_rand(M,cfg.mbits,BN_RAND_TOP_ONE,BN_RAND_BOTTOM_ANY);
+        // The carry entries M*2^j of the padded instance are up to log2(n) bits longer
+        pedersen_precompute_short(param,cfg.mbits+kss_bits(cfg.n-1),ctx);
+    }
+    else
+        BN_sub(M,param->p,BN_value_one());
+
+    KSS_instance* inst=gen_instance(M,ctx,cfg.n,cfg.k);
 
     
     if(verify_solution(inst,ctx))
@@ -58,19 +92,86 @@ int main(){
         exit(0);
     }
 
-    //fixed_length();
-    variable_length(param,inst,ctx);
-    variable_length(param,inst,ctx);
+    // Offline: coupons for the 2n non-zero commitments of two proofs
+    PED_coupon_pool* coupons = coupon_pool_new(param,4*cfg.n);
+    coupon_pool_fill(coupons,ctx);
+
+    // Forked before any thread runs, the workers share the precomputed tables
+    ZKP_shards* shards = cfg.shards > 0 ? shards_new(param,cfg.shards,2*(cfg.n+kss_carry_bits(inst,param->p))) : NULL;
+
+    // Sessions keep their buffers from one proof of the statement to the next
+    PROVER_data* prover = PROVER_new(param,inst,coupons);
+    VERIFIER_data* verifier = VERIFIER_new(param,inst);
+
+    prover->shards = shards;
+    verifier->shards = shards;
+
+    ZKP_mem_window window;
+    ZKP_mem_stats mem;
+
+    //fixed_length(&cfg);
+    for(int i=0; i<2;++i){
+        // The second proof reuses the buffers of the first, it should not grow the heap
+        zkp_mem_begin(&window,true);
+        variable_length(prover,verifier,cfg.transcript);
+        zkp_mem_end(&window,&mem);
+        zkp_mem_print("Proof memory",&mem);
+    }
+
+    // Same statement, through the state machines the daemon runs
+    PROVER_machine pm;
+    VERIFIER_machine vm;
+    ZKP_error err;
+
+    PROVER_machine_init(&pm,prover,ENGINE_ROUNDS,cfg.depth);
+    VERIFIER_machine_init(&vm,param);
+
+    zkp_mem_begin(&window,true);
+
+    if ((err = zkp_run_local(&pm,&vm)) != ZKP_OK)
+        printf("Engine failed after %d rounds: %s\n",pm.round,zkp_error_string(err));
+    else
+        printf("Engine: %d/%d rounds accepted, depth %d\n",pm.accepted,pm.rounds,pm.depth);
+
+    zkp_mem_end(&window,&mem);
+    zkp_mem_print("Engine memory",&mem);
+
+    PROVER_machine_free(&pm);
+    VERIFIER_machine_free(&vm);
+
+    // Refills start after the heap windows above, which read the whole process
+    coupon_pool_start(coupons,COUPON_THREADS);
+
+    batch_of_proofs(param,inst,coupons,verifier);
+
+    inner_product_proof(param,inst,ctx);
+
+    multi_challenge_round(prover,verifier,cfg.soundness);
+
+    coupon_pool_print_stats(coupons);
+
+#ifdef ZKP_TRACE
+    zkp_trace_print();
+    zkp_trace_write_json("zkp_trace.json");
+#endif
+
+    PROVER_free(prover);
+    VERIFIER_free(verifier);
+    coupon_pool_free(coupons);
+
+    if (shards != NULL)
+        shards_free(shards);
+    zkp_ctx_release();
 
     return 0;
 }
 
-void fixed_length(){
-    int i;
+void fixed_length(ZKP_config* cfg){
+    int n = cfg->n;
 
-    BN_CTX* ctx = BN_CTX_new();
+    BN_CTX* ctx = zkp_ctx();
 
-    PED_params* param = pedersen_init(ctx);
+    PED_params* param = pedersen_init(cfg->bits,ctx);
 
     BIGNUM* m = BN_new();
     BIGNUM* t= BN_new();
@@ -80,8 +181,8 @@ void fixed_length(){
 
     BN_rand_range(m,param->p);
     
-    PED_commitment* comm = pedersen_commit(m,param->p,param->g,param->h,ctx);
-    bool res = pederesen_unveil(comm->c,comm->s,m,param->p,param->g,param->h,ctx);
+    PED_commitment* comm = pedersen_commit_params(m,param,ctx);
+    bool res = pedersen_unveil_params(comm->c,comm->s,m,param,ctx);
     
     if (res){
         PUTS("Test SUCCESS!\n");
@@ -89,39 +190,37 @@ void fixed_length(){
     
     BIGNUM* M = BN_new();
     BN_sub(M,param->p,BN_value_one());
-    KSS_instance* inst=gen_instance(M,ctx,N_FIXED);
+    KSS_instance* inst=gen_instance(M,ctx,n,cfg->k);
 
     
     if(verify_solution(inst,ctx))
         PUTS("KSS yes-instance is correct");
 
     
-    unsigned __int64 begin, end;
+    uint64_t begin;
 
-    BIGNUM** comm_array0 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_FIXED);
-    BIGNUM** comm_array1 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_FIXED);
-    BIGNUM** randomnesses0 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_FIXED);
-    BIGNUM** randomnesses1 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_FIXED);
+    ZKP_arena* arena = arena_new(0);
 
-    begin = __rdtsc();
+    begin = zkp_now_ns();
 
     puts("\n########## FIRST STEP: PROVER ##########");
     puts("Prover generates random permutations...");
-    permutation p1 = permutation_get_random(N_FIXED);
-    permutation p2 = permutation_get_random(N_FIXED);
+    permutation p1 = permutation_get_random(n);
+    permutation p2 = permutation_get_random(n);
     printf("p1: ");
-    permutation_print(p1,N_FIXED);
+    permutation_print(p1,n);
     printf("p2: ");
-    permutation_print(p2,N_FIXED);
+    permutation_print(p2,n);
 
     PUTS("Prover's first commitment...");
-    BIGNUM** perm_a_1 = permutation_apply(inst->a,p1,N_FIXED);
-    PED_commitment** comm0 = PROVER_commits(perm_a_1,param,ctx);
+    BN_view instance = view_init(inst->a,n,NULL,n);
+    BN_view perm_a_1 = view_permute(&instance,p1);
+    PED_commit_vector* comm0 = PROVER_commits(arena,&perm_a_1,param,NULL,ctx);
     PUTS("Done");
 
     PUTS("Prover's second commitment...");
-    BIGNUM** perm_a_2 = permutation_apply(inst->a,p2,N_FIXED);
-    PED_commitment** comm1 = PROVER_commits(perm_a_2,param,ctx);
+    BN_view perm_a_2 = view_permute(&instance,p2);
+    PED_commit_vector* comm1 = PROVER_commits(arena,&perm_a_2,param,NULL,ctx);
     PUTS("Done");
 
     PUTS("\n########## SECOND STEP: VERIFIER ##########");
@@ -131,26 +230,17 @@ void fixed_length(){
 
     PUTS("\n########## THIRD STEP: PROVER ##########");
 
-    // Prepare commitments to be opened
-
-    for(i=0; i<N_FIXED;++i){
-        comm_array0[i]=comm0[i]->c;
-        comm_array1[i]=comm1[i]->c;
-        randomnesses0[i]=comm0[i]->s;
-        randomnesses1[i]=comm1[i]->s;
-    }
-
     PUTS("Prover opens chosen commitment...");
 
     bool are_commitments_correct, is_permutation_correct;
 
     if ( index ==0 ){
-        are_commitments_correct= PROVER_opens(comm_array0,perm_a_1,randomnesses0,param->p,param->g,param->h,ctx);
-        is_permutation_correct = VERIFIER_check_permutation(perm_a_1, inst->a,p1,N_FIXED);
+        are_commitments_correct= PROVER_opens(comm0,&perm_a_1,param,ctx);
+        is_permutation_correct = VERIFIER_check_permutation(&perm_a_1,&instance,p1);
     }
     else if ( index == 1 ){
-        are_commitments_correct= PROVER_opens(comm_array1,perm_a_2,randomnesses1,param->p,param->g,param->h,ctx);
-        is_permutation_correct = VERIFIER_check_permutation(perm_a_2, inst->a,p2,N_FIXED);
+        are_commitments_correct= PROVER_opens(comm1,&perm_a_2,param,ctx);
+        is_permutation_correct = VERIFIER_check_permutation(&perm_a_2,&instance,p2);
     }
     else {
         PUTS("ERROR! Verifier selected invalid index. Aborting.");
@@ -178,40 +268,40 @@ void fixed_length(){
     PUTS("\n########## FIFTH STEP: PROVER ##########");
     PUTS("Prover sending permuted solution to Verifier");
     printf("Verifier receiving ");
-    char* permuted_sol = (index == 0 ? permutation_apply_sol(inst->solution,p2,N_FIXED) : permutation_apply_sol(inst->solution,p1,N_FIXED) );
-    print_solution(permuted_sol,N_FIXED);
+    char* permuted_sol = (index == 0 ? permutation_apply_sol(inst->solution,p2,n) : permutation_apply_sol(inst->solution,p1,n) );
+    print_solution(permuted_sol,n);
 
     PUTS("\n########## SIXTH STEP: VERIFIER ##########");
-    BIGNUM** leftover_comms = index == 0 ? comm_array1 : comm_array0;
-    BIGNUM* commitment_to_sum = VERIFIER_homomorphic_sum(leftover_comms,permuted_sol,param->p,ctx);
+    PED_commit_vector* leftover = index == 0 ? comm1 : comm0;
+    BIGNUM* commitment_to_sum = VERIFIER_homomorphic_sum(leftover,permuted_sol,param,ctx);
 
     PUTS("\n########## SEVENTH STEP: PROVER ##########");
     PUTS("Prover opens commitment");
     BIGNUM* sum=BN_new();
-    BIGNUM** leftover_rands = index == 0 ? randomnesses1 : randomnesses0;
     char* solution= permuted_sol;
 
-    for(i=0;i<N_FIXED;++i){
-        if( solution[i]==1)
-            BN_mod_add(sum,sum,leftover_rands[i], inst->M,ctx);
-    }
+    lazy_sum_selected_words(sum,leftover->s,leftover->words,solution,n,inst->M,ctx);
 
-    if ( pederesen_unveil(commitment_to_sum,sum,inst->S,param->p,param->g,param->h,ctx))
+    if ( pedersen_unveil_params(commitment_to_sum,sum,inst->S,param,ctx))
         PUTS("Verifier accepted final commitment. Proof concluded. Verifier ACCEPTS");
     else
         PUTS("Verifier rejected final commitment. Proof concluded. Verifier REJECTS");
     
-    end = __rdtsc();
-
-    printf_s("%I64d ticks\n", end-begin);
+    printf("%.3f ms\n",zkp_elapsed_ms(begin));
+
+    BN_free(commitment_to_sum);
+    BN_free(sum);
+    free(permuted_sol);
+    permutation_free(p1);
+    permutation_free(p2);
+    arena_free(arena);
 }
 
-void variable_length(PED_params* param, KSS_instance* inst, BN_CTX* ctx){
-    int i;
+void variable_length(PROVER_data* prover, VERIFIER_data* verifier, ZKP_transcript transcript){
 
     /*BN_CTX* ctx = BN_CTX_new();
 
-    PED_params* param = pedersen_get_param(ctx); //pedersen_init(ctx);
+    PED_params* param = pedersen_get_param(cfg.bits,ctx); //pedersen_init(cfg.bits,ctx);
 
     BIGNUM* m = BN_new();
     BIGNUM* t= BN_new();
@@ -221,18 +311,19 @@ void variable_length(PED_params* param, KSS_instance* inst, BN_CTX* ctx){
 
     BN_rand_range(m,param->p);
     
-    PED_commitment* comm = pedersen_commit(m,param->p,param->g,param->h,ctx);
-    bool res = pederesen_unveil(comm->c,comm->s,m,param->p,param->g,param->h,ctx);
+    PED_commitment* comm = pedersen_commit_params(m,param,ctx);
+    bool res = pedersen_unveil_params(comm->c,comm->s,m,param,ctx);
     
     if (res){
         PUTS("Test SUCCESS!\n");
     }
 
     pedersen_save_param(param);
+    pedersen_precompute(param,FB_DEFAULT_WINDOW,ctx);
     
     BIGNUM* M = BN_new();
     BN_sub(M,param->p,BN_value_one());
-    KSS_instance* inst=gen_instance(M,ctx,N_VAR);
+    KSS_instance* inst=gen_instance(M,ctx,cfg.n,cfg.k);
 
     
     if(verify_solution(inst,ctx))
@@ -243,118 +334,243 @@ void variable_length(PED_params* param, KSS_instance* inst, BN_CTX* ctx){
     }
     */
     
-    unsigned __int64 begin, end;
+    uint64_t begin;
 
-    BIGNUM** comm_array0 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_VAR*2);
-    BIGNUM** comm_array1 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_VAR*2);
-    BIGNUM** randomnesses0 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_VAR*2);
-    BIGNUM** randomnesses1 = (BIGNUM**) malloc(sizeof(BIGNUM*)*N_VAR*2);
+    // Offline: both commitments need n commitments to zero each
+    PROVER_precompute(prover);
 
-    begin = __rdtsc();
+    begin = zkp_now_ns();
 
     puts("\n########## FIRST STEP: PROVER ##########");
+    ZKP_SPAN_BEGIN(step_1,"prover.commits");
     puts("Prover generates random permutations...");
-    permutation p1 = permutation_get_random(2*N_VAR);
-    permutation p2 = permutation_get_random(2*N_VAR);
-    printf("p1: ");
-    permutation_print(p1,2*N_VAR);
-    printf("p2: ");
-    permutation_print(p2,2*N_VAR);
+    PUTS("Prover commits to both permuted instances...");
+    PROVER_round_commits(prover);
 
-    BIGNUM** padded_instance = pad_with_zeros(inst->a,N_VAR);
-    BIGNUM** padded_solution = pad_with_zeros_solution(inst->solution,N_VAR);
+    if (transcript == ZKP_TRANSCRIPT_MERKLE){
+        unsigned char root_1[MERKLE_HASH_BYTES], root_2[MERKLE_HASH_BYTES];
 
-    PUTS("Prover's first commitment...");
-    BIGNUM** perm_a_1 = permutation_apply(padded_instance,p1,2*N_VAR);
+        PUTS("Prover sends the Merkle roots of both commitments...");
+        PROVER_round_roots(prover,root_1,root_2);
+        VERIFIER_receives_roots(verifier,root_1,root_2);
+    }
 
-    PED_commitment** comm0 = PROVER_commits_variable(perm_a_1,param,ctx);
+    printf("p1: ");
+    permutation_print(prover->p1,prover->len);
+    printf("p2: ");
+    permutation_print(prover->p2,prover->len);
     PUTS("Done");
 
-    PUTS("Prover's second commitment...");
-    BIGNUM** perm_a_2 = permutation_apply(padded_instance,p2,2*N_VAR);
-    PED_commitment** comm1 = PROVER_commits_variable(perm_a_2,param,ctx);
-    PUTS("Done");
+    ZKP_SPAN_END(step_1);
 
     PUTS("\n########## SECOND STEP: VERIFIER ##########");
+    ZKP_SPAN_BEGIN(step_2,"verifier.challenge");
     PUTS("Verifier selects random index");
-    int index = VERIFIER_selects_index();
+    int index = VERIFIER_challenge(verifier);
     printf("Verifier selected: %d\n",index);
 
-    PUTS("\n########## THIRD STEP: PROVER ##########");
-
-    // Prepare commitments to be opened
-
-    for(i=0; i<N_VAR*2;++i){
-        comm_array0[i]=comm0[i]->c;
-        comm_array1[i]=comm1[i]->c;
-        randomnesses0[i]=comm0[i]->s;
-        randomnesses1[i]=comm1[i]->s;
+    if ( index != 0 && index != 1 ){
+        PUTS("ERROR! Verifier selected invalid index. Aborting.");
+        exit(1);
     }
 
+    ZKP_SPAN_END(step_2);
+
+    PUTS("\n########## THIRD STEP: PROVER ##########");
+    ZKP_SPAN_BEGIN(step_3,"prover.opening");
     PUTS("Prover opens chosen commitment...");
 
-    bool are_commitments_correct, is_permutation_correct;
+    PED_commit_vector* opened_comms;
+    BN_view* opened;
 
-    if ( index ==0 ){
-        are_commitments_correct= PROVER_opens_variable(comm_array0,perm_a_1,randomnesses0,param->p,param->g,param->h,ctx);
-        is_permutation_correct = VERIFIER_check_permutation(perm_a_1,padded_instance,p1,2*N_VAR);
-    }
-    else if ( index == 1 ){
-        are_commitments_correct= PROVER_opens_variable(comm_array1,perm_a_2,randomnesses1,param->p,param->g,param->h,ctx);
-        is_permutation_correct = VERIFIER_check_permutation(perm_a_2,padded_instance,p2,2*N_VAR);
-    }
-    else {
-        PUTS("ERROR! Verifier selected invalid index. Aborting.");
-        exit(1);
-    }
+    PROVER_opening(prover,index,&opened_comms,&opened);
     PUTS("Done");
 
+    ZKP_SPAN_END(step_3);
+
     PUTS("\n########## FOURTH STEP: VERIFIER ##########");
+    ZKP_SPAN_BEGIN(step_4,"verifier.opening");
     PUTS("Verifier checks commitments...");
 
-    if (are_commitments_correct)
-        PUTS("Commitments successfully opened. No cheating detected.");
-    else{
-        PUTS("At least one opening failed. Aborting.");
-        exit(1);
-    }
+    bool opening_ok = transcript == ZKP_TRANSCRIPT_MERKLE ? VERIFIER_checks_opening_root(verifier,opened_comms,opened) : VERIFIER_checks_opening(verifier,opened_comms,opened);
 
-    if (is_permutation_correct)
-        PUTS("Checked is unveiled value is a permutation of original instance padded with 0. No cheating detected.");
+    if (opening_ok)
+        PUTS("Commitments successfully opened to a permutation of original instance padded with 0. No cheating detected.");
     else{
-        PUTS("The committed array is not a permutation of the original instance padded with 0. Aborting.");
+        PUTS("Opening failed or the committed array is not a permutation of the original instance padded with 0. Aborting.");
         exit(1);
     }
 
+    ZKP_SPAN_END(step_4);
+
     PUTS("\n########## FIFTH STEP: PROVER ##########");
+    ZKP_SPAN_BEGIN(step_5,"prover.solution");
     PUTS("Prover sending permuted solution to Verifier");
     printf("Verifier receiving ");
-    char* permuted_sol = (index == 0 ? permutation_apply_sol(padded_solution,p2,2*N_VAR) : permutation_apply_sol(padded_solution,p1,2*N_VAR) );
-    print_solution(permuted_sol, 2*N_VAR);
+    BIT_solution* permuted_sol = PROVER_permuted_solution(prover,index);
+    bitsol_print(permuted_sol);
 
     
+    ZKP_SPAN_END(step_5);
+
     PUTS("\n########## SIXTH STEP: VERIFIER ##########");
-    BIGNUM** leftover_comms = index == 0 ? comm_array1 : comm_array0;
-    BIGNUM* commitment_to_sum = VERIFIER_homomorphic_sum_variable(leftover_comms,permuted_sol,param->p,ctx);
+    ZKP_SPAN_BEGIN(step_6,"verifier.sum");
+    if (transcript == ZKP_TRANSCRIPT_MERKLE){
+        PED_commit_vector* selected;
+        unsigned char* proof;
+        int nproof = PROVER_selected_commitments(prover,index,&selected,&proof);
+
+        printf("Prover sends %d selected commitments and %d hashes of multiproof\n",selected->count,nproof);
+
+        if (VERIFIER_homomorphic_sum_root(verifier,selected,permuted_sol,proof,nproof) == NULL){
+            PUTS("Selected commitments do not match the Merkle root. Aborting.");
+            exit(1);
+        }
+    }
+    else{
+        PED_commit_vector* leftover = index == 0 ? prover->commitment_2 : prover->commitment_1;
+        if (VERIFIER_homomorphic_sum_round(verifier,leftover,permuted_sol) == NULL){
+            PUTS("The permuted solution does not select n elements. Aborting.");
+            exit(1);
+        }
+    }
 
 
+    ZKP_SPAN_END(step_6);
+
     PUTS("\n########## SEVENTH STEP: PROVER ##########");
+    ZKP_SPAN_BEGIN(step_7,"prover.sum");
     PUTS("Prover opens commitment");
-    BIGNUM* sum=BN_new();
-    BIGNUM** leftover_rands = index == 0 ? randomnesses1 : randomnesses0;
-    char* solution= permuted_sol;
+    BIGNUM* sum = PROVER_sum(prover,index);
+    bool accepts = VERIFIER_accepts(verifier,sum);
 
-    for(i=0;i<2*N_VAR;++i){
-        if( solution[i]==1)
-            BN_mod_add(sum,sum,leftover_rands[i], inst->M,ctx);
-    }
+    ZKP_SPAN_END(step_7);
 
-    if ( pederesen_unveil(commitment_to_sum,sum,inst->S,param->p,param->g,param->h,ctx))
+    if ( accepts )
         PUTS("Verifier accepted final commitment. Proof concluded. Verifier ACCEPTS");
     else
         PUTS("Verifier rejected final commitment. Proof concluded. Verifier REJECTS");
     
-    end = __rdtsc();
+    printf("%.3f ms\n",zkp_elapsed_ms(begin));
+
+    PROVER_reset(prover);
+}
+
+/**
+ * BATCH_PROVERS provers run one round each against the same verifier, whose
+ * exponentiations are deferred to a single batch
+ */
+void batch_of_proofs(PED_params* param, KSS_instance* inst, PED_coupon_pool* coupons, VERIFIER_data* verifier){
+
+    PROVER_data* provers[BATCH_PROVERS];
+    ZKP_batch* batch = batch_new(param,BATCH_PROVERS);
+    PED_commit_vector* opened_comms;
+    BN_view* opened;
+    BIT_solution* permuted_sol;
+    int index, accepted;
+    uint64_t begin;
+
+    for(int j=0; j<BATCH_PROVERS;++j){
+        provers[j] = PROVER_new(param,inst,coupons);
+        provers[j]->shards = verifier->shards;
+        PROVER_precompute(provers[j]);
+    }
+
+    begin = zkp_now_ns();
+
+    for(int j=0; j<BATCH_PROVERS;++j){
+
+        PROVER_round_commits(provers[j]);
+        index = VERIFIER_challenge(verifier);
+
+        PROVER_opening(provers[j],index,&opened_comms,&opened);
+        permuted_sol = PROVER_permuted_solution(provers[j],index);
+
+        if (!VERIFIER_batch_add(batch,verifier,opened_comms,opened,index == 0 ? provers[j]->commitment_2 : provers[j]->commitment_1,permuted_sol,PROVER_sum(provers[j],index)))
+            printf("Proof %d rejected before the batch\n",j);
+    }
+
+    accepted = batch_verify(batch);
+
+    printf("Batch: %d/%d proofs accepted, %.3f ms per proof\n",accepted,BATCH_PROVERS,zkp_elapsed_ms(begin)/BATCH_PROVERS);
+
+    batch_free(batch);
 
-    printf_s("%I64d ticks\n", end-begin);
-}
\ No newline at end of file
+    for(int j=0; j<BATCH_PROVERS;++j)
+        PROVER_free(provers[j]);
+}
+
+/**
+ * The same kind of statement through the inner-product argument: a single
+ * proof of logarithmic size. It needs a short instance modulus, so without
+ * one a 64-bit instance of the same size is proven instead.
+ */
+void inner_product_proof(PED_params* param, KSS_instance* inst, BN_CTX* ctx){
+
+    IPA_params* pp = ipa_params_new(param,inst->n);
+    KSS_instance* short_inst = NULL;
+    BIGNUM* M = NULL;
+    IPA_proof* proof;
+    IPA_proof* received;
+    WIRE_buf buf;
+    WIRE_reader r;
+    uint64_t begin;
+    bool accepts;
+
+    if (!ipa_supports(pp,inst)){
+        M = BN_new();
+        BN_rand(M,64,BN_RAND_TOP_ONE,BN_RAND_BOTTOM_ANY);
+        short_inst = gen_instance_quiet(M,ctx,inst->n,inst->k);
+        inst = short_inst;
+    }
+
+    begin = zkp_now_ns();
+    proof = ipa_prove(pp,inst);
+    printf("Inner-product proof: %.3f ms to prove",zkp_elapsed_ms(begin));
+
+    wire_buf_init(&buf);
+    ipa_proof_put(&buf,proof,pp);
+    r.p = buf.data;
+    r.left = buf.len;
+    r.ok = true;
+    received = ipa_proof_get(&r,pp);
+
+    begin = zkp_now_ns();
+    accepts = received != NULL && ipa_verify(pp,inst,received);
+    printf(", %.3f ms to verify, %zu bytes, %s\n",zkp_elapsed_ms(begin),buf.len,accepts ? "accepted" : "rejected");
+
+    ipa_proof_free(proof);
+    if (received != NULL)
+        ipa_proof_free(received);
+    wire_buf_free(&buf);
+    ipa_params_free(pp);
+
+    if (short_inst != NULL){
+        kss_free(short_inst);
+        BN_free(M);
+    }
+}
+
+/**
+ * Plans the rounds for the soundness target and runs the first one
+ */
+void multi_challenge_round(PROVER_data* prover, VERIFIER_data* verifier, int soundness){
+
+    ZKP_round_cost cost = zkp_round_cost_modexp(prover->instance->n);
+    ZKP_plan plan = zkp_plan(soundness,&cost,ZKP_MAX_COPIES);
+    ZKP_plan classic = zkp_plan(soundness,&cost,2);
+    PROVER_multi* multi = PROVER_multi_new(prover,plan.copies);
+    uint64_t begin;
+    bool accepts;
+
+    zkp_plan_print(&plan);
+    printf("Two copies per round: %d rounds, cost %.0f\n",classic.rounds,classic.cost);
+
+    PROVER_multi_precompute(multi);
+
+    begin = zkp_now_ns();
+    accepts = zkp_multi_round(multi,verifier,plan.summed);
+    printf("Multi-challenge round: %s, %.3f ms\n",accepts ? "accepted" : "rejected",zkp_elapsed_ms(begin));
+
+    PROVER_multi_free(multi);
+}
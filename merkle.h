@@ -0,0 +1,256 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <openssl/evp.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define MERKLE_HASH_BYTES 32
+
+/*
+SHA-256 Merkle trees over fixed-size leaves, with multiproofs.
+
+A leaf hashes as SHA-256(0x00 || data) and an inner node as
+SHA-256(0x01 || left || right), so a leaf can never pass for a node. The
+leaves are padded with all-zero hashes up to a power of two.
+
+The tree is stored as a heap: node 1 is the root, the children of node i
+are 2i and 2i+1, and leaf i is node width+i.
+
+A multiproof opens k leaves at once. It holds, level by level from the
+leaves up and by increasing position, the siblings that cannot be computed
+from the opened leaves: at most k*log2(width) hashes, far fewer when the
+leaves are close to each other.
+*/
+
+typedef struct merkle_tree
+{
+    /* data */
+    int leaves;
+    int width;
+    int depth;
+    unsigned char* nodes;
+} ZKP_merkle;
+
+void merkle_hash_leaf(EVP_MD_CTX* md, unsigned char* out, const unsigned char* data, size_t len){
+
+    unsigned char tag = 0x00;
+
+    EVP_DigestInit_ex(md,EVP_sha256(),NULL);
+    EVP_DigestUpdate(md,&tag,1);
+    EVP_DigestUpdate(md,data,len);
+    EVP_DigestFinal_ex(md,out,NULL);
+}
+
+void merkle_hash_node(EVP_MD_CTX* md, unsigned char* out, const unsigned char* left, const unsigned char* right){
+
+    unsigned char tag = 0x01;
+
+    EVP_DigestInit_ex(md,EVP_sha256(),NULL);
+    EVP_DigestUpdate(md,&tag,1);
+    EVP_DigestUpdate(md,left,MERKLE_HASH_BYTES);
+    EVP_DigestUpdate(md,right,MERKLE_HASH_BYTES);
+    EVP_DigestFinal_ex(md,out,NULL);
+}
+
+/**
+ * Number of leaves of a tree over count leaves, padding included
+ */
+int merkle_width(int count){
+
+    int width = 1;
+
+    while (width < count) width <<= 1;
+
+    return width;
+}
+
+unsigned char* merkle_node(const ZKP_merkle* t, int i){
+    return t->nodes + (size_t) i*MERKLE_HASH_BYTES;
+}
+
+const unsigned char* merkle_root(const ZKP_merkle* t){
+    return merkle_node(t,1);
+}
+
+/**
+ * Builds the tree over count leaves of len bytes each
+ * @param arena: Arena owning the tree
+ * @param data: The leaves, stride bytes apart
+ * @param stride: Distance between two leaves
+ * @param len: Bytes hashed per leaf
+ * @param count: Number of leaves
+ */
+ZKP_merkle* merkle_build(ZKP_arena* arena, const unsigned char* data, size_t stride, size_t len, int count){
+
+    ZKP_merkle* t = (ZKP_merkle*) arena_alloc(arena,sizeof(ZKP_merkle));
+    EVP_MD_CTX* md = EVP_MD_CTX_new();
+
+    t->leaves = count;
+    t->width = merkle_width(count);
+    t->depth = 0;
+    while ((1 << t->depth) < t->width) t->depth++;
+
+    // Node 0 is unused, padding leaves stay zero
+    t->nodes = (unsigned char*) arena_calloc(arena,(size_t) 2*t->width*MERKLE_HASH_BYTES);
+
+    for(int i=0; i<count;++i)
+        merkle_hash_leaf(md,merkle_node(t,t->width+i),data + (size_t) i*stride,len);
+
+    for(int i=t->width-1; i>=1;--i)
+        merkle_hash_node(md,merkle_node(t,i),merkle_node(t,2*i),merkle_node(t,2*i+1));
+
+    EVP_MD_CTX_free(md);
+
+    return t;
+}
+
+/**
+ * Computes the root over count leaves of len bytes each, without keeping the tree
+ * @param root: Where to store the root
+ */
+void merkle_root_of(unsigned char* root, const unsigned char* data, size_t stride, size_t len, int count){
+
+    int width = merkle_width(count);
+    unsigned char* level = (unsigned char*) calloc(width,MERKLE_HASH_BYTES);
+    EVP_MD_CTX* md = EVP_MD_CTX_new();
+
+    for(int i=0; i<count;++i)
+        merkle_hash_leaf(md,level + (size_t) i*MERKLE_HASH_BYTES,data + (size_t) i*stride,len);
+
+    // Each level overwrites the first half of the previous one
+    for(int w=width/2; w>=1; w/=2){
+        for(int i=0; i<w;++i)
+            merkle_hash_node(md,level + (size_t) i*MERKLE_HASH_BYTES,level + (size_t) 2*i*MERKLE_HASH_BYTES,level + (size_t) (2*i+1)*MERKLE_HASH_BYTES);
+    }
+
+    memcpy(root,level,MERKLE_HASH_BYTES);
+
+    EVP_MD_CTX_free(md);
+    free(level);
+}
+
+/**
+ * Largest number of hashes in a multiproof of k leaves of t
+ */
+int merkle_multiproof_bound(const ZKP_merkle* t, int k){
+    return k*t->depth;
+}
+
+/**
+ * Writes the multiproof of k leaves
+ * @param t: The tree
+ * @param idx: Positions of the leaves, strictly increasing
+ * @param k: Number of leaves
+ * @param out: Where to write the hashes, merkle_multiproof_bound hashes at most
+ * @return Number of hashes written
+ */
+int merkle_multiproof(const ZKP_merkle* t, const int* idx, int k, unsigned char* out){
+
+    int* cur = (int*) malloc(sizeof(int)*(k > 0 ? k : 1));
+    int m = k, next, written = 0, node;
+
+    for(int j=0; j<k;++j) cur[j] = t->width + idx[j];
+
+    for(int level=0; level<t->depth;++level){
+
+        next = 0;
+
+        for(int j=0; j<m;++j){
+
+            node = cur[j];
+
+            // Both children known: the sibling is not sent
+            if (j+1 < m && cur[j+1] == (node^1))
+                j++;
+            else
+                memcpy(out + (size_t) (written++)*MERKLE_HASH_BYTES,merkle_node(t,node^1),MERKLE_HASH_BYTES);
+
+            cur[next++] = node >> 1;
+        }
+
+        m = next;
+    }
+
+    free(cur);
+
+    return written;
+}
+
+/**
+ * Checks a multiproof against a root
+ * @param root: The root the leaves must hash to
+ * @param count: Number of leaves of the tree
+ * @param idx: Positions of the opened leaves, strictly increasing
+ * @param leaf: Hashes of the opened leaves, in the order of idx
+ * @param k: Number of opened leaves
+ * @param proof: The multiproof
+ * @param nproof: Number of hashes in the multiproof
+ */
+bool merkle_verify_multiproof(const unsigned char* root, int count, const int* idx, const unsigned char* leaf, int k, const unsigned char* proof, int nproof){
+
+    int width = merkle_width(count);
+    int* cur = (int*) malloc(sizeof(int)*(k > 0 ? k : 1));
+    unsigned char* h = (unsigned char*) malloc((size_t) (k > 0 ? k : 1)*MERKLE_HASH_BYTES);
+    EVP_MD_CTX* md = EVP_MD_CTX_new();
+    const unsigned char *left, *right;
+    int m = k, next, used = 0, node;
+    bool res = false;
+
+    if (k == 0){
+        res = nproof == 0;
+        goto end;
+    }
+
+    for(int j=0; j<k;++j){
+        if (idx[j] < 0 || idx[j] >= count || (j > 0 && idx[j] <= idx[j-1]))
+            goto end;
+
+        cur[j] = width + idx[j];
+    }
+
+    memcpy(h,leaf,(size_t) k*MERKLE_HASH_BYTES);
+
+    while (cur[0] > 1){
+
+        next = 0;
+
+        for(int j=0; j<m;++j){
+
+            node = cur[j];
+
+            if (j+1 < m && cur[j+1] == (node^1)){
+                left = h + (size_t) j*MERKLE_HASH_BYTES;
+                right = h + (size_t) (j+1)*MERKLE_HASH_BYTES;
+                j++;
+            }
+            else{
+                if (used == nproof)
+                    goto end;
+
+                left = node & 1 ? proof + (size_t) used*MERKLE_HASH_BYTES : h + (size_t) j*MERKLE_HASH_BYTES;
+                right = node & 1 ? h + (size_t) j*MERKLE_HASH_BYTES : proof + (size_t) used*MERKLE_HASH_BYTES;
+                used++;
+            }
+
+            // Parents are written behind the children they are computed from
+            merkle_hash_node(md,h + (size_t) next*MERKLE_HASH_BYTES,left,right);
+            cur[next++] = node >> 1;
+        }
+
+        m = next;
+    }
+
+    res = used == nproof && memcmp(h,root,MERKLE_HASH_BYTES) == 0;
+
+end:
+    EVP_MD_CTX_free(md);
+    free(h);
+    free(cur);
+
+    return res;
+}
+
+#endif
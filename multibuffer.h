@@ -0,0 +1,549 @@
+#ifndef MULTIBUFFER_H
+#define MULTIBUFFER_H
+
+#include <openssl/bn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define MB_HAVE_IFMA
+#define MB_TARGET_IFMA __attribute__((target("avx512f,avx512ifma")))
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+Multi-buffer modular exponentiation.
+
+MB_LANES exponentiations with the same modulus and the same base run together,
+one per vector lane. Numbers are held in radix 2^52, digit-major and
+lane-minor (x[j*MB_LANES+l] is digit j of lane l), which is the layout of the
+AVX-512 IFMA instructions: one 52x52-bit multiply-add covers digit j of all
+lanes. Products are accumulated without carries (52-bit digits in 64-bit
+words leave 12 spare bits) and normalized once per multiplication.
+
+The kernel is an almost-Montgomery multiplication: inputs and outputs are
+below 2N rather than N, which is fine because R = 2^(52*nd) > 4N. Full
+reduction happens only when converting back to a BIGNUM.
+
+The IFMA kernel is picked at runtime when the CPU has it; the scalar kernel
+computes the same thing one lane at a time and serves as portable fallback.
+*/
+
+#ifndef MB_LANES
+#define MB_LANES 8
+#endif
+
+// The vector kernel holds exactly 8 lanes of 64 bits
+#if defined(MB_HAVE_IFMA) && MB_LANES != 8
+#undef MB_HAVE_IFMA
+#endif
+#define MB_WINDOW 5
+#define MB_ENTRIES (1 << MB_WINDOW)
+#define MB_DIGIT_BITS 52
+#define MB_MASK52 ( ((uint64_t) 1 << MB_DIGIT_BITS) - 1 )
+// Enough digits for a 4096-bit modulus
+#define MB_MAX_DIGITS 80
+
+typedef struct multibuffer_ctx
+{
+    /* data */
+    BIGNUM* N;
+    BIGNUM* RR;
+    uint64_t* n;
+    uint64_t n0;
+    int nd;
+    int nbytes;
+    bool use_ifma;
+} MB_ctx;
+
+typedef struct multibuffer_base
+{
+    /* data */
+    uint64_t* table;
+} MB_base;
+
+/**
+ * Splits little-endian bytes into nd digits of 52 bits
+ */
+void mb_digits_from_bytes(uint64_t* d, const unsigned char* b, int nbytes, int nd){
+
+    int k,t,bit,byte,shift;
+    uint64_t v;
+
+    for(k=0; k<nd;++k){
+        bit = k*MB_DIGIT_BITS;
+        byte = bit >> 3;
+        shift = bit & 7;
+
+        v = 0;
+        for(t=7; t>=0;--t){
+            v = (v << 8) | (byte+t < nbytes ? b[byte+t] : 0);
+        }
+
+        d[k] = (v >> shift) & MB_MASK52;
+    }
+}
+
+/**
+ * Joins nd normalized digits of 52 bits into little-endian bytes
+ */
+void mb_digits_to_bytes(unsigned char* b, int nbytes, const uint64_t* d, int nd){
+
+    int k,bit;
+
+    memset(b,0,nbytes);
+
+    for(k=0; k<nd;++k){
+        for(bit=0; bit<MB_DIGIT_BITS;++bit){
+            int pos = k*MB_DIGIT_BITS+bit;
+            if ((pos >> 3) < nbytes)
+                b[pos >> 3] |= (unsigned char) ( ( (d[k] >> bit) & 1 ) << (pos & 7) );
+        }
+    }
+}
+
+/**
+ * 52x52-bit product split in its low and high 52 bits
+ */
+static inline void mb_mul52(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi){
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128) a * b;
+    *lo = (uint64_t) p & MB_MASK52;
+    *hi = (uint64_t) (p >> MB_DIGIT_BITS);
+#elif defined(_MSC_VER)
+    uint64_t h;
+    uint64_t l = _umul128(a,b,&h);
+    *lo = l & MB_MASK52;
+    *hi = (h << (64-MB_DIGIT_BITS)) | (l >> MB_DIGIT_BITS);
+#else
+    // Schoolbook on 26-bit halves
+    uint64_t a0 = a & 0x3FFFFFF, a1 = a >> 26, b0 = b & 0x3FFFFFF, b1 = b >> 26;
+    uint64_t mid = a0*b1 + a1*b0;
+    uint64_t l = a0*b0 + ((mid & 0x3FFFFFF) << 26);
+    *lo = l & MB_MASK52;
+    *hi = a1*b1 + (mid >> 26) + (l >> MB_DIGIT_BITS);
+#endif
+}
+
+/**
+ * Scalar almost-Montgomery multiplication of all lanes: r = a*b/R mod N, r < 2N
+ * @param r: Result, may alias a or b
+ * @param a: First operand, digit-major
+ * @param b: Second operand, digit-major
+ * @param mb: Modulus context
+ */
+void mb_amm_scalar(uint64_t* r, const uint64_t* a, const uint64_t* b, const MB_ctx* mb){
+
+    uint64_t acc[2*MB_MAX_DIGITS+1];
+    uint64_t lo, hi, m, carry, v;
+    int nd = mb->nd;
+    int i,j,l;
+
+    for(l=0; l<MB_LANES;++l){
+
+        memset(acc,0,sizeof(uint64_t)*(2*nd+1));
+
+        for(i=0; i<nd;++i){
+
+            // Only a[0]*b[i] reaches digit i, so m is known before the row
+            mb_mul52(a[l],b[i*MB_LANES+l],&lo,&hi);
+            m = ( ((acc[i] + lo) & MB_MASK52) * mb->n0 ) & MB_MASK52;
+
+            for(j=0; j<nd;++j){
+                mb_mul52(a[j*MB_LANES+l],b[i*MB_LANES+l],&lo,&hi);
+                acc[i+j] += lo;
+                acc[i+j+1] += hi;
+                mb_mul52(mb->n[j],m,&lo,&hi);
+                acc[i+j] += lo;
+                acc[i+j+1] += hi;
+            }
+
+            // The low digit is now a multiple of 2^52
+            acc[i+1] += acc[i] >> MB_DIGIT_BITS;
+        }
+
+        carry = 0;
+        for(j=0; j<nd;++j){
+            v = acc[nd+j] + carry;
+            r[j*MB_LANES+l] = v & MB_MASK52;
+            carry = v >> MB_DIGIT_BITS;
+        }
+    }
+}
+
+#ifdef MB_HAVE_IFMA
+
+/**
+ * AVX-512 IFMA almost-Montgomery multiplication, one lane per 64-bit element
+ */
+MB_TARGET_IFMA
+void mb_amm_ifma(uint64_t* r, const uint64_t* a, const uint64_t* b, const MB_ctx* mb){
+
+    __m512i acc[2*MB_MAX_DIGITS+1];
+    __m512i zero = _mm512_setzero_si512();
+    __m512i mask = _mm512_set1_epi64(MB_MASK52);
+    __m512i n0 = _mm512_set1_epi64(mb->n0);
+    __m512i bi, aj, nj, m, lo, hi, carry, v;
+    int nd = mb->nd;
+    int i,j;
+
+    for(j=0; j<2*nd+1;++j){
+        acc[j] = zero;
+    }
+
+    for(i=0; i<nd;++i){
+
+        bi = _mm512_loadu_si512((const void*) (b+i*MB_LANES));
+
+        // Only a[0]*b[i] reaches digit i, so m is known before the row
+        aj = _mm512_loadu_si512((const void*) a);
+        m = _mm512_madd52lo_epu64(acc[i],aj,bi);
+        m = _mm512_and_si512(_mm512_madd52lo_epu64(zero,m,n0),mask);
+
+        for(j=0; j<nd;++j){
+            aj = _mm512_loadu_si512((const void*) (a+j*MB_LANES));
+            nj = _mm512_set1_epi64(mb->n[j]);
+            lo = _mm512_madd52lo_epu64(acc[i+j],aj,bi);
+            hi = _mm512_madd52hi_epu64(acc[i+j+1],aj,bi);
+            acc[i+j] = _mm512_madd52lo_epu64(lo,nj,m);
+            acc[i+j+1] = _mm512_madd52hi_epu64(hi,nj,m);
+        }
+
+        acc[i+1] = _mm512_add_epi64(acc[i+1],_mm512_srli_epi64(acc[i],MB_DIGIT_BITS));
+    }
+
+    carry = zero;
+    for(j=0; j<nd;++j){
+        v = _mm512_add_epi64(acc[nd+j],carry);
+        _mm512_storeu_si512((void*) (r+j*MB_LANES),_mm512_and_si512(v,mask));
+        carry = _mm512_srli_epi64(v,MB_DIGIT_BITS);
+    }
+}
+
+/**
+ * AVX-512 version of mb_gather
+ */
+MB_TARGET_IFMA
+void mb_gather_ifma(uint64_t* x, const uint64_t* table, const int* d, int nd){
+
+    __m512i idx = _mm512_set_epi64(d[7],d[6],d[5],d[4],d[3],d[2],d[1],d[0]);
+    __m512i v;
+    __mmask8 k;
+    int e,j;
+
+    for(j=0; j<nd;++j){
+        _mm512_storeu_si512((void*) (x+j*MB_LANES),_mm512_setzero_si512());
+    }
+
+    for(e=0; e<MB_ENTRIES;++e){
+
+        k = _mm512_cmpeq_epi64_mask(idx,_mm512_set1_epi64(e));
+
+        for(j=0; j<nd;++j){
+            v = _mm512_loadu_si512((const void*) (x+j*MB_LANES));
+            v = _mm512_mask_mov_epi64(v,k,_mm512_set1_epi64(table[e*nd+j]));
+            _mm512_storeu_si512((void*) (x+j*MB_LANES),v);
+        }
+    }
+}
+
+#endif
+
+/**
+ * Almost-Montgomery multiplication of all lanes with the best available kernel
+ */
+void mb_amm(uint64_t* r, const uint64_t* a, const uint64_t* b, const MB_ctx* mb){
+#ifdef MB_HAVE_IFMA
+    if (mb->use_ifma){
+        mb_amm_ifma(r,a,b,mb);
+        return;
+    }
+#endif
+    mb_amm_scalar(r,a,b,mb);
+}
+
+/**
+ * Tells whether the vector kernel can run on this CPU
+ */
+bool mb_has_ifma(){
+#ifdef MB_HAVE_IFMA
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+#else
+    return false;
+#endif
+}
+
+/**
+ * Creates the context for an odd modulus N
+ * @param N: The modulus, at most 4096 bits
+ * @param ctx: OpenSSL context
+ */
+MB_ctx* mb_ctx_new(const BIGNUM* N, BN_CTX* ctx){
+
+    MB_ctx* mb;
+    unsigned char* buf;
+    uint64_t inv;
+    int i;
+
+    if (!BN_is_odd(N) || BN_num_bits(N) > MB_DIGIT_BITS*MB_MAX_DIGITS-2)
+        return NULL;
+
+    mb = (MB_ctx*) malloc(sizeof(MB_ctx));
+    // R = 2^(52*nd) must exceed 4N
+    mb->nd = (BN_num_bits(N)+2+MB_DIGIT_BITS-1)/MB_DIGIT_BITS;
+    mb->nbytes = (mb->nd*MB_DIGIT_BITS+7)/8;
+    mb->N = BN_dup(N);
+    mb->n = (uint64_t*) malloc(sizeof(uint64_t)*mb->nd);
+    mb->use_ifma = mb_has_ifma();
+
+    buf = (unsigned char*) malloc(mb->nbytes);
+    BN_bn2lebinpad(N,buf,mb->nbytes);
+    mb_digits_from_bytes(mb->n,buf,mb->nbytes,mb->nd);
+    free(buf);
+
+    // n0 = -N^-1 mod 2^52, by Newton iteration
+    inv = 1;
+    for(i=0; i<6;++i){
+        inv = inv * (2 - mb->n[0]*inv);
+    }
+    mb->n0 = (0 - inv) & MB_MASK52;
+
+    // RR = R^2 mod N, to enter the Montgomery domain
+    mb->RR = BN_new();
+    BN_set_bit(mb->RR,2*MB_DIGIT_BITS*mb->nd);
+    BN_mod(mb->RR,mb->RR,N,ctx);
+
+    return mb;
+}
+
+void mb_ctx_free(MB_ctx* mb){
+    BN_free(mb->N);
+    BN_free(mb->RR);
+    free(mb->n);
+    free(mb);
+}
+
+/**
+ * Loads up to MB_LANES BIGNUMs in the lanes of x. Missing lanes are zero
+ */
+void mb_load(uint64_t* x, BIGNUM** v, int count, const MB_ctx* mb){
+
+    unsigned char* buf = (unsigned char*) malloc(mb->nbytes);
+    uint64_t d[MB_MAX_DIGITS];
+    int l,j;
+
+    for(l=0; l<MB_LANES;++l){
+
+        if (l < count)
+            BN_bn2lebinpad(v[l],buf,mb->nbytes);
+        else
+            memset(buf,0,mb->nbytes);
+
+        mb_digits_from_bytes(d,buf,mb->nbytes,mb->nd);
+
+        for(j=0; j<mb->nd;++j){
+            x[j*MB_LANES+l] = d[j];
+        }
+    }
+
+    free(buf);
+}
+
+/**
+ * Stores the first count lanes of x, fully reduced modulo N
+ */
+void mb_store(BIGNUM** v, int count, const uint64_t* x, const MB_ctx* mb){
+
+    unsigned char* buf = (unsigned char*) malloc(mb->nbytes);
+    uint64_t d[MB_MAX_DIGITS];
+    int l,j;
+
+    for(l=0; l<count;++l){
+
+        for(j=0; j<mb->nd;++j){
+            d[j] = x[j*MB_LANES+l];
+        }
+
+        mb_digits_to_bytes(buf,mb->nbytes,d,mb->nd);
+        BN_lebin2bn(buf,mb->nbytes,v[l]);
+
+        // Outputs of the kernel are below 2N
+        if (BN_cmp(v[l],mb->N) >= 0)
+            BN_sub(v[l],v[l],mb->N);
+    }
+
+    free(buf);
+}
+
+/**
+ * Precomputes base^j, j < 2^MB_WINDOW, in the Montgomery domain
+ */
+MB_base* mb_base_new(const BIGNUM* base, const MB_ctx* mb, BN_CTX* ctx){
+
+    MB_base* mbb = (MB_base*) malloc(sizeof(MB_base));
+    unsigned char* buf = (unsigned char*) malloc(mb->nbytes);
+    int j;
+
+    BN_CTX_start(ctx);
+    BIGNUM* cur = BN_CTX_get(ctx);
+    BIGNUM* bm = BN_CTX_get(ctx);
+    BIGNUM* R = BN_CTX_get(ctx);
+
+    // Entry j is base^j * R mod N, with R = 2^(52*nd)
+    BN_zero(R);
+    BN_set_bit(R,MB_DIGIT_BITS*mb->nd);
+    BN_mod(R,R,mb->N,ctx);
+    BN_nnmod(bm,base,mb->N,ctx);
+    BN_copy(cur,R);
+
+    mbb->table = (uint64_t*) malloc(sizeof(uint64_t)*MB_ENTRIES*mb->nd);
+
+    for(j=0; j<MB_ENTRIES;++j){
+        BN_bn2lebinpad(cur,buf,mb->nbytes);
+        mb_digits_from_bytes(mbb->table+j*mb->nd,buf,mb->nbytes,mb->nd);
+        BN_mod_mul(cur,cur,bm,mb->N,ctx);
+    }
+
+    BN_CTX_end(ctx);
+    free(buf);
+
+    return mbb;
+}
+
+void mb_base_free(MB_base* mbb){
+    free(mbb->table);
+    free(mbb);
+}
+
+/**
+ * Gathers table entry d[l] into lane l of x, scanning every entry
+ */
+void mb_gather(uint64_t* x, const MB_base* mbb, const int* d, const MB_ctx* mb){
+
+    uint64_t mask[MB_LANES];
+    int e,j,l;
+
+#ifdef MB_HAVE_IFMA
+    if (mb->use_ifma){
+        mb_gather_ifma(x,mbb->table,d,mb->nd);
+        return;
+    }
+#endif
+
+    memset(x,0,sizeof(uint64_t)*mb->nd*MB_LANES);
+
+    for(e=0; e<MB_ENTRIES;++e){
+
+        for(l=0; l<MB_LANES;++l){
+            mask[l] = (uint64_t) 0 - (uint64_t) ( ( (uint32_t) (e^d[l]) - 1 ) >> 31 );
+        }
+
+        for(j=0; j<mb->nd;++j){
+            for(l=0; l<MB_LANES;++l){
+                x[j*MB_LANES+l] |= mbb->table[e*mb->nd+j] & mask[l];
+            }
+        }
+    }
+}
+
+/**
+ * Computes r[l] = base^e[l] mod N for up to MB_LANES exponents at once,
+ * with a fixed window so that the sequence of operations does not depend on e.
+ * @param r: count results
+ * @param mbb: Table of the base
+ * @param e: count exponents, each at most the size of N
+ * @param count: Number of exponentiations, at most MB_LANES
+ * @param mb: Modulus context
+ */
+void mb_mod_exp(BIGNUM** r, const MB_base* mbb, BIGNUM** e, int count, const MB_ctx* mb){
+
+    int nd = mb->nd;
+    int windows = (BN_num_bits(mb->N)+MB_WINDOW-1)/MB_WINDOW;
+    int ebytes = (windows*MB_WINDOW+7)/8 + 1;
+    int i,k,l,bit,d[MB_LANES];
+
+    uint64_t* acc = (uint64_t*) malloc(sizeof(uint64_t)*nd*MB_LANES);
+    uint64_t* t = (uint64_t*) malloc(sizeof(uint64_t)*nd*MB_LANES);
+    unsigned char* ebuf = (unsigned char*) calloc(MB_LANES,ebytes);
+
+    for(l=0; l<count;++l){
+        BN_bn2lebinpad(e[l],ebuf+l*ebytes,ebytes);
+    }
+
+    for(i=windows-1; i>=0;--i){
+
+        for(l=0; l<MB_LANES;++l){
+            d[l] = 0;
+            for(k=0; k<MB_WINDOW;++k){
+                bit = i*MB_WINDOW+k;
+                d[l] |= ( (ebuf[l*ebytes+(bit>>3)] >> (bit&7)) & 1 ) << k;
+            }
+        }
+
+        if (i == windows-1){
+            mb_gather(acc,mbb,d,mb);
+            continue;
+        }
+
+        for(k=0; k<MB_WINDOW;++k){
+            mb_amm(acc,acc,acc,mb);
+        }
+
+        mb_gather(t,mbb,d,mb);
+        mb_amm(acc,acc,t,mb);
+    }
+
+    // Leave the Montgomery domain: multiply by 1
+    memset(t,0,sizeof(uint64_t)*nd*MB_LANES);
+    for(l=0; l<MB_LANES;++l){
+        t[l] = 1;
+    }
+    mb_amm(acc,acc,t,mb);
+
+    mb_store(r,count,acc,mb);
+
+    OPENSSL_cleanse(ebuf,MB_LANES*ebytes);
+    free(ebuf);
+    free(acc);
+    free(t);
+}
+
+/**
+ * Computes r[i] = base^e[i] mod N for any number of exponents, MB_LANES at a time.
+ * Exponents larger than N are handled by BN_mod_exp_mont_consttime.
+ */
+void mb_mod_exp_batch(BIGNUM** r, const BIGNUM* base, const MB_base* mbb, BIGNUM** e, int count, const MB_ctx* mb, BN_CTX* ctx){
+
+    BIGNUM* lane_e[MB_LANES];
+    BIGNUM* lane_r[MB_LANES];
+    int i,filled=0;
+
+    for(i=0; i<count;++i){
+
+        if (BN_num_bits(e[i]) > BN_num_bits(mb->N)){
+            BN_mod_exp_mont_consttime(r[i],base,e[i],mb->N,ctx,NULL);
+            continue;
+        }
+
+        lane_e[filled] = e[i];
+        lane_r[filled] = r[i];
+        filled++;
+
+        if (filled == MB_LANES){
+            mb_mod_exp(lane_r,mbb,lane_e,filled,mb);
+            filled = 0;
+        }
+    }
+
+    if (filled > 0)
+        mb_mod_exp(lane_r,mbb,lane_e,filled,mb);
+}
+
+#endif
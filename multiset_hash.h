@@ -0,0 +1,134 @@
+#ifndef MULTISET_HASH_H
+#define MULTISET_HASH_H
+
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zkp_trace.h"
+
+// Bytes of the key and of each element hash
+#define MSET_KEY_BYTES 32
+#define MSET_WORDS 4
+
+/*
+Keyed additive multiset hash (MSet-Add-Hash).
+
+The digest of a multiset is the sum modulo 2^256 of SHA-256(key || x) over
+its elements, each x encoded on a fixed number of bytes. The sum does not
+depend on the order, so two vectors have the same digest iff, except with
+negligible probability, they are permutations of each other. This relies on
+the key staying secret to the party that checks: the verifier draws it and
+never sends it.
+
+The digest of a fixed multiset, such as the padded instance, is computed
+once and compared against the digest of every opened vector.
+*/
+
+typedef struct multiset_key
+{
+    /* data */
+    unsigned char key[MSET_KEY_BYTES];
+    EVP_MD_CTX* prefix;
+    EVP_MD_CTX* work;
+    unsigned char* buf;
+    int width;
+} MSET_key;
+
+typedef struct multiset_digest
+{
+    /* data */
+    uint64_t w[MSET_WORDS];
+} MSET_digest;
+
+/**
+ * Draws a fresh secret key
+ * @param width: Bytes every element is encoded on, at least the size of the largest one
+ */
+MSET_key* mset_key_new(int width){
+
+    MSET_key* k = (MSET_key*) malloc(sizeof(MSET_key));
+
+    RAND_bytes(k->key,MSET_KEY_BYTES);
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,MSET_KEY_BYTES);
+
+    // The key is absorbed once, every element starts from a copy of this state
+    k->prefix = EVP_MD_CTX_new();
+    k->work = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(k->prefix,EVP_sha256(),NULL);
+    EVP_DigestUpdate(k->prefix,k->key,MSET_KEY_BYTES);
+
+    k->width = width;
+    k->buf = (unsigned char*) malloc(width);
+
+    return k;
+}
+
+void mset_key_free(MSET_key* k){
+
+    OPENSSL_cleanse(k->key,MSET_KEY_BYTES);
+    EVP_MD_CTX_free(k->prefix);
+    EVP_MD_CTX_free(k->work);
+    free(k->buf);
+    free(k);
+}
+
+/**
+ * Digest of the empty multiset
+ */
+void mset_digest_init(MSET_digest* d){
+    memset(d->w,0,sizeof(d->w));
+}
+
+/**
+ * Adds x to the multiset of d
+ * @return false if x does not fit the width of the key
+ */
+bool mset_add(const MSET_key* k, MSET_digest* d, const BIGNUM* x){
+
+    unsigned char h[32];
+    uint64_t v, carry = 0;
+
+    if (BN_bn2binpad(x,k->buf,k->width) < 0)
+        return false;
+
+    EVP_MD_CTX_copy_ex(k->work,k->prefix);
+    EVP_DigestUpdate(k->work,k->buf,k->width);
+    EVP_DigestFinal_ex(k->work,h,NULL);
+
+    // d += h mod 2^256, h read as a little-endian integer
+    for(int i=0; i<MSET_WORDS;++i){
+        v = 0;
+        for(int j=7; j>=0;--j) v = (v << 8) | h[8*i+j];
+
+        v += carry;
+        carry = v < carry;
+        d->w[i] += v;
+        carry |= d->w[i] < v;
+    }
+
+    return true;
+}
+
+/**
+ * Adds the n elements of a to the multiset of d
+ */
+bool mset_add_array(const MSET_key* k, MSET_digest* d, BIGNUM** a, int n){
+
+    for(int i=0; i<n;++i){
+        if (!mset_add(k,d,a[i]))
+            return false;
+    }
+
+    return true;
+}
+
+bool mset_equal(const MSET_digest* a, const MSET_digest* b){
+    return CRYPTO_memcmp(a->w,b->w,sizeof(a->w)) == 0;
+}
+
+#endif
@@ -5,8 +5,15 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include "fixed_base.h"
+#include "fixed_mont.h"
+#include "multibuffer.h"
+#include "zkp_trace.h"
 
-#define BITS 2048
+#define PED_DEFAULT_BITS 2048
+
+// Window of the table for g over short values: 2^8 entries per window
+#define FB_SHORT_WINDOW 8
 
 typedef struct pedersen_commitment
 {
@@ -21,17 +28,53 @@ typedef struct pedersen_parameters
     BIGNUM* p;
     BIGNUM* g;
     BIGNUM* h;
+    FB_table* h_table;
+    FB_table* g_table;
+    MB_ctx* mb;
+    MB_base* mb_g;
+    MB_base* mb_h;
+    FIXED_ops* fx;
+    BN_MONT_CTX* mont;
 } PED_params;
 
-BIGNUM* get_generator(BIGNUM* p, BN_CTX* ctx){
+/*
+Secrecy of an exponent, which selects the exponentiation code.
 
-    BIGNUM* g = BN_new();
-    BIGNUM* q = BN_new();
-    BIGNUM* power_2 = BN_new();
-    BIGNUM* power_q = BN_new();
+Secret exponents only go through code whose sequence of operations and
+memory accesses do not depend on them: the masked fixed-window tables, the
+multi-buffer kernel, else BN_mod_exp_mont_consttime. Randomnesses are
+secret, and so are the values the prover commits to: they are public as a
+set, but their order is the secret permutation.
+
+Public exponents take the fastest code, variable-time sliding windows
+included. Everything the verifier recomputes from an opening is public.
+*/
+typedef enum ped_secrecy
+{
+    PED_PUBLIC = 0,
+    PED_SECRET = 1
+} PED_secrecy;
+
+/*
+Pool of precomputed commitments to zero, c = h^s
+*/
+typedef struct pedersen_zero_pool
+{
+    /* data */
+    PED_commitment** items;
+    int size;
+    int count;
+} PED_zero_pool;
+
+BIGNUM* get_generator(BIGNUM* p, BN_CTX* ctx){
 
     BN_CTX_start(ctx);
 
+    BIGNUM* g = BN_new();
+    BIGNUM* q = BN_CTX_get(ctx);
+    BIGNUM* power_2 = BN_CTX_get(ctx);
+    BIGNUM* power_q = BN_CTX_get(ctx);
+
     BN_sub(q,p,BN_value_one());
     BN_rshift(q,q,1);
 
@@ -44,16 +87,13 @@ BIGNUM* get_generator(BIGNUM* p, BN_CTX* ctx){
 
         if ( (BN_cmp(power_2,BN_value_one()) != 0) && (BN_cmp(power_q,BN_value_one()) != 0) ){
 
-            BN_free(q);
-            BN_free(power_2);
-            BN_free(power_q);
             BN_CTX_end(ctx);
             return g;
         }
     }
 }
 
-PED_params* pedersen_init(BN_CTX* ctx){
+PED_params* pedersen_init(int bits, BN_CTX* ctx){
 
     BIGNUM* p = BN_new();
     BIGNUM* g;
@@ -65,7 +105,7 @@ PED_params* pedersen_init(BN_CTX* ctx){
 
     puts("Generating commitment parameters...");
 
-    BN_generate_prime(p,BITS,1,NULL,NULL,NULL,NULL);
+    BN_generate_prime(p,bits,1,NULL,NULL,NULL,NULL);
     
     g = get_generator(p,ctx);
     do{
@@ -75,6 +115,12 @@ PED_params* pedersen_init(BN_CTX* ctx){
     param->g=g;
     param->h=h;
     param->p=p;
+    param->h_table=NULL;
+    param->g_table=NULL;
+    param->mb=NULL;
+    param->fx=NULL;
+    param->mont=BN_MONT_CTX_new();
+    BN_MONT_CTX_set(param->mont,p,ctx);
 
     BN_CTX_end(ctx);
 
@@ -92,13 +138,8 @@ PED_params* pedersen_init(BN_CTX* ctx){
  */
 int pedersen_save_param(PED_params* p){
 
-    char size[5];
-    itoa(BITS,size,10);
-
-    char prefix[20]="PED_";
-
-    char* fullpath =strcat(prefix,size);
-    fullpath=strcat(fullpath,".dat");
+    char fullpath[20];
+    snprintf(fullpath,sizeof(fullpath),"PED_%d.dat",BN_num_bits(p->p));
 
     FILE* f = fopen(fullpath,"wb");
     char* buf;
@@ -132,14 +173,14 @@ int pedersen_save_param(PED_params* p){
     return 0;
 }
 
-PED_params* pedersen_get_param(BN_CTX* ctx){
-    char size[5];
-    itoa(BITS,size,10);
-
-    char prefix[20]="PED_";
-
-    char* fullpath =strcat(prefix,size);
-    fullpath=strcat(fullpath,".dat");
+/**
+ * Loads the parameters for a modulus of the given size, generating and saving them if needed
+ * @param bits: Size of the prime p
+ * @param ctx: OpenSSL context
+ */
+PED_params* pedersen_get_param(int bits, BN_CTX* ctx){
+    char fullpath[20];
+    snprintf(fullpath,sizeof(fullpath),"PED_%d.dat",bits);
 
     PED_params* param;
     char* buf;
@@ -168,68 +209,352 @@ PED_params* pedersen_get_param(BN_CTX* ctx){
         param->p = BN_bin2bn(buf,sp,NULL);
         free(buf);
 
+        param->h_table = NULL;
+        param->g_table = NULL;
+        param->mb = NULL;
+        param->fx = NULL;
+        param->mont = BN_MONT_CTX_new();
+        BN_MONT_CTX_set(param->mont,param->p,ctx);
+
         fclose(file);
     }
     else{
-        param =pedersen_init(ctx);
+        param =pedersen_init(bits,ctx);
         pedersen_save_param(param);
     }
 
     return param;
 }
 
+/**
+ * r = base^e mod p on the code allowed by the secrecy of e
+ * @param fb: Fixed-base table of base, may be NULL
+ */
+void pedersen_exp(BIGNUM* r, const BIGNUM* base, const BIGNUM* e, PED_secrecy secrecy, const FB_table* fb, PED_params* params, BN_CTX* ctx){
+
+    // The table is constant-time, and faster than a full-width exponentiation
+    if (fb != NULL && fixed_base_exp(r,fb,e,ctx))
+        return;
+
+    // Without a table OpenSSL's exponentiation, with its dedicated squaring,
+    // is faster than params->fx even on mulx/adx
+    if (secrecy == PED_SECRET)
+        BN_mod_exp_mont_consttime(r,base,e,params->p,ctx,params->mont);
+    else
+        BN_mod_exp_mont(r,base,e,params->p,ctx,params->mont);
+}
+
+/**
+ * Commits to m under standalone p, g and h, setting up a Montgomery context
+ * per call. Holders of a PED_params use pedersen_commit_params.
+ */
 PED_commitment* pedersen_commit(BIGNUM* m, BIGNUM* p, BIGNUM* g, BIGNUM* h,BN_CTX* ctx){
 
     BN_CTX_start(ctx);
 
     BIGNUM* s = BN_new();
-    BIGNUM* x1 = BN_new();
-    BIGNUM* x2 = BN_new();
+    BIGNUM* x1 = BN_CTX_get(ctx);
+    BIGNUM* x2 = BN_CTX_get(ctx);
     BIGNUM* commitment = BN_new();
+    BN_MONT_CTX* mont = BN_MONT_CTX_new();
 
     PED_commitment* result;
     result=(PED_commitment*) malloc(sizeof(PED_commitment));
 
+    ZKP_SPAN_BEGIN(span,"pedersen.commit");
+
+    // The randomness and the committed value are both secret
     BN_rand_range(s,p);
-    BN_mod_exp(x1,g,m,p,ctx);
-    BN_mod_exp(x2,h,s,p,ctx);
+    BN_set_flags(s,BN_FLG_CONSTTIME);
+    BN_MONT_CTX_set(mont,p,ctx);
+    BN_mod_exp_mont_consttime(x1,g,m,p,ctx,mont);
+    BN_mod_exp_mont_consttime(x2,h,s,p,ctx,mont);
     BN_mod_mul(commitment,x1,x2,p,ctx);
+    BN_MONT_CTX_free(mont);
+
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,BN_num_bytes(p));
+    ZKP_COUNT(ZKP_CNT_MODEXP,2);
+    ZKP_COUNT(ZKP_CNT_MODMUL,1);
+    ZKP_SPAN_END(span);
 
     result->c=commitment;
     result->s=s;
 
-    //cleaning
-    BN_free(x1);
-    BN_free(x2);
+    // Both halves depend on the secrets
+    BN_clear(x1);
+    BN_clear(x2);
     
     BN_CTX_end(ctx);
 
     return result;
 }
 
+/**
+ * Checks an opening under standalone p, g and h, see pedersen_commit.
+ * Holders of a PED_params use pedersen_unveil_params.
+ */
 bool pederesen_unveil(BIGNUM* c, BIGNUM* s, BIGNUM* m, BIGNUM* p, BIGNUM* g, BIGNUM* h, BN_CTX* ctx){
 
     BN_CTX_start(ctx);
     
-    BIGNUM* x1 = BN_new();
-    BIGNUM* x2 = BN_new();
-    BIGNUM* local_c = BN_new();
+    BIGNUM* x1 = BN_CTX_get(ctx);
+    BIGNUM* x2 = BN_CTX_get(ctx);
+    BIGNUM* local_c = BN_CTX_get(ctx);
+    BN_MONT_CTX* mont = BN_MONT_CTX_new();
     bool res;
 
-    BN_mod_exp(x1,g,m,p,ctx);
-    BN_mod_exp(x2,h,s,p,ctx);
+    ZKP_SPAN_BEGIN(span,"pedersen.unveil");
+
+    // The opening is public, both exponentiations may be variable-time
+    BN_MONT_CTX_set(mont,p,ctx);
+    BN_mod_exp_mont(x1,g,m,p,ctx,mont);
+    BN_mod_exp_mont(x2,h,s,p,ctx,mont);
     BN_mod_mul(local_c,x1,x2,p,ctx);
+    BN_MONT_CTX_free(mont);
 
     res = BN_cmp(local_c,c) == 0;
+
+    ZKP_COUNT(ZKP_CNT_MODEXP,2);
+    ZKP_COUNT(ZKP_CNT_MODMUL,1);
+    ZKP_SPAN_END(span);
     
-    //cleaning
-    BN_free(x1);
-    BN_free(x2);
-    BN_free(local_c);
-    
     BN_CTX_end(ctx);
 
     return res;
 }
 
+/**
+ * Precomputes the fixed-base table for h, the multi-buffer tables for
+ * g and h when the CPU has a vector kernel for them, and the fixed-width
+ * kernels when the CPU has mulx/adx or FIXED_PORTABLE forces them
+ * @param param: Pedersen parameters
+ * @param window: Window size of the table
+ * @param ctx: OpenSSL context
+ */
+void pedersen_precompute(PED_params* param, int window, BN_CTX* ctx){
+
+    bool use_fx;
+
+    if (param->h_table != NULL)
+        fixed_base_free(param->h_table);
+
+    param->h_table = fixed_base_new(param->h,param->p,window,ctx);
+
+    if (param->fx != NULL){
+        fixed_ops_free(param->fx);
+        param->fx = NULL;
+    }
+
+    // The portable fixed-width kernel is about 3x slower than OpenSSL's
+    // assembly, it only runs when forced
+#ifdef FIXED_PORTABLE
+    use_fx = true;
+#else
+    use_fx = fixed_has_adx();
+#endif
+
+    if (use_fx){
+        param->fx = fixed_ops_new(param->p,ctx);
+        fixed_base_attach(param->h_table,param->fx);
+    }
+
+    if (param->g_table != NULL)
+        fixed_base_attach(param->g_table,param->fx);
+
+    if (param->mb != NULL){
+        mb_base_free(param->mb_g);
+        mb_base_free(param->mb_h);
+        mb_ctx_free(param->mb);
+        param->mb = NULL;
+    }
+
+    // The scalar multi-buffer kernel is slower than BN_mod_exp
+    if (mb_has_ifma()){
+        param->mb = mb_ctx_new(param->p,ctx);
+        if (param->mb != NULL){
+            param->mb_g = mb_base_new(param->g,param->mb,ctx);
+            param->mb_h = mb_base_new(param->h,param->mb,ctx);
+        }
+    }
+}
+
+/**
+ * Precomputes a fixed-base table for g over exponents of at most ebits bits,
+ * for instances whose modulus is much smaller than p. Call it after
+ * pedersen_precompute so the table runs on the fixed-width kernels.
+ * @param param: Pedersen parameters
+ * @param ebits: Size of the largest committed value
+ * @param ctx: OpenSSL context
+ */
+void pedersen_precompute_short(PED_params* param, int ebits, BN_CTX* ctx){
+
+    if (param->g_table != NULL)
+        fixed_base_free(param->g_table);
+
+    param->g_table = fixed_base_new_bits(param->g,param->p,FB_SHORT_WINDOW,ebits,ctx);
+    fixed_base_attach(param->g_table,param->fx);
+}
+
+/**
+ * r = a*b mod p, on the fixed-width kernels when the parameters have them
+ */
+void pedersen_mod_mul(BIGNUM* r, BIGNUM* a, BIGNUM* b, PED_params* params, BN_CTX* ctx){
+
+    if (params->fx != NULL)
+        params->fx->mod_mul(r,a,b,params->fx->mont);
+    else
+        BN_mod_mul(r,a,b,params->p,ctx);
+
+    ZKP_COUNT(ZKP_CNT_MODMUL,1);
+}
+
+/**
+ * Commits to m like pedersen_commit, on the Montgomery context and the
+ * tables of the parameters
+ * @param m: Value to commit to, secret
+ * @param params: Pedersen parameters
+ * @param ctx: OpenSSL context
+ */
+PED_commitment* pedersen_commit_params(BIGNUM* m, PED_params* params, BN_CTX* ctx){
+
+    PED_commitment* result = (PED_commitment*) malloc(sizeof(PED_commitment));
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* x1 = BN_CTX_get(ctx);
+    BIGNUM* s = BN_new();
+    BIGNUM* commitment = BN_new();
+
+    ZKP_SPAN_BEGIN(span,"pedersen.commit");
+
+    BN_rand_range(s,params->p);
+    BN_set_flags(s,BN_FLG_CONSTTIME);
+    pedersen_exp(x1,params->g,m,PED_SECRET,params->g_table,params,ctx);
+    pedersen_exp(commitment,params->h,s,PED_SECRET,params->h_table,params,ctx);
+    pedersen_mod_mul(commitment,x1,commitment,params,ctx);
+
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,BN_num_bytes(params->p));
+    ZKP_COUNT(ZKP_CNT_MODEXP,2);
+    ZKP_SPAN_END(span);
+
+    result->c=commitment;
+    result->s=s;
+
+    BN_clear(x1);
+
+    BN_CTX_end(ctx);
+
+    return result;
+}
+
+/**
+ * Checks the opening (m, s) of c like pederesen_unveil, on the Montgomery
+ * context and the tables of the parameters
+ * @param c: Commitment
+ * @param s: Randomness of the opening
+ * @param m: Committed value of the opening
+ * @param params: Pedersen parameters
+ * @param ctx: OpenSSL context
+ */
+bool pedersen_unveil_params(BIGNUM* c, BIGNUM* s, BIGNUM* m, PED_params* params, BN_CTX* ctx){
+
+    bool res;
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* x1 = BN_CTX_get(ctx);
+    BIGNUM* x2 = BN_CTX_get(ctx);
+
+    ZKP_SPAN_BEGIN(span,"pedersen.unveil");
+
+    pedersen_exp(x1,params->g,m,PED_PUBLIC,params->g_table,params,ctx);
+    pedersen_exp(x2,params->h,s,PED_PUBLIC,params->h_table,params,ctx);
+    pedersen_mod_mul(x1,x1,x2,params,ctx);
+
+    res = BN_cmp(x1,c) == 0;
+
+    ZKP_COUNT(ZKP_CNT_MODEXP,2);
+    ZKP_SPAN_END(span);
+
+    BN_CTX_end(ctx);
+
+    return res;
+}
+
+/**
+ * Computes a fresh commitment to 0, i.e. h^s, skipping g^0.
+ * Uses the fixed-base table for h when it was precomputed.
+ */
+PED_commitment* pedersen_commit_zero_fresh(PED_params* param, BN_CTX* ctx){
+
+    PED_commitment* result = (PED_commitment*) malloc(sizeof(PED_commitment));
+    BIGNUM* s = BN_new();
+    BIGNUM* commitment = BN_new();
+
+    BN_rand_range(s,param->p);
+    BN_set_flags(s,BN_FLG_CONSTTIME);
+    pedersen_exp(commitment,param->h,s,PED_SECRET,param->h_table,param,ctx);
+
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,BN_num_bytes(param->p));
+    ZKP_COUNT(ZKP_CNT_MODEXP,1);
+
+    result->c=commitment;
+    result->s=s;
+
+    return result;
+}
+
+/**
+ * Creates an empty pool for up to size commitments to zero
+ */
+PED_zero_pool* pedersen_zero_pool_new(int size){
+
+    PED_zero_pool* pool = (PED_zero_pool*) malloc(sizeof(PED_zero_pool));
+
+    pool->items = (PED_commitment**) malloc(sizeof(PED_commitment*)*size);
+    pool->size = size;
+    pool->count = 0;
+
+    return pool;
+}
+
+/**
+ * Destroys the pool and the commitments left in it
+ */
+void pedersen_zero_pool_free(PED_zero_pool* pool){
+
+    for(int i=0; i<pool->count;++i){
+        BN_free(pool->items[i]->c);
+        BN_clear_free(pool->items[i]->s);
+        free(pool->items[i]);
+    }
+
+    free(pool->items);
+    free(pool);
+}
+
+/**
+ * Fills the pool up to its capacity
+ */
+void pedersen_zero_pool_fill(PED_zero_pool* pool, PED_params* param, BN_CTX* ctx){
+
+    while (pool->count < pool->size){
+        pool->items[pool->count++] = pedersen_commit_zero_fresh(param,ctx);
+    }
+}
+
+/**
+ * Returns a commitment to 0, taken from the pool when it is not empty
+ * @param param: Pedersen parameters
+ * @param pool: Pool of precomputed commitments, may be NULL
+ * @param ctx: OpenSSL context
+ */
+PED_commitment* pedersen_commit_zero(PED_params* param, PED_zero_pool* pool, BN_CTX* ctx){
+
+    if (pool != NULL && pool->count > 0)
+        return pool->items[--pool->count];
+
+    return pedersen_commit_zero_fresh(param,ctx);
+}
+
 #endif
\ No newline at end of file
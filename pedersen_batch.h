@@ -0,0 +1,170 @@
+#ifndef PEDERSEN_BATCH_H
+#define PEDERSEN_BATCH_H
+
+#include <openssl/bn.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "pedersen.h"
+#include "commit_vector.h"
+#include "coupon_pool.h"
+#include "multibuffer.h"
+
+/**
+ * Computes r[i] = base^e[i] mod p for count exponents, with the multi-buffer
+ * kernel when the parameters have one
+ * @param mbb: Multi-buffer table of base, ignored if params->mb is NULL
+ * @param fb: Fixed-base table of base, may be NULL
+ * @param secrecy: Secrecy of every exponent, see pedersen_exp
+ */
+void pedersen_exp_batch(BIGNUM** r, BIGNUM* base, MB_base* mbb, FB_table* fb, BIGNUM** e, int count, PED_secrecy secrecy, PED_params* params, BN_CTX* ctx){
+
+    if (count == 0)
+        return;
+
+    ZKP_COUNT(ZKP_CNT_MODEXP,count);
+
+    // A table over short exponents beats full-width exponentiations, even vectorized
+    if (fb != NULL && fb->is_short){
+        for(int i=0; i<count;++i)
+            pedersen_exp(r[i],base,e[i],secrecy,fb,params,ctx);
+        return;
+    }
+
+    // The fixed-window kernel is the fastest for public exponents too
+    if (params->mb != NULL){
+        mb_mod_exp_batch(r,base,mbb,e,count,params->mb,ctx);
+        return;
+    }
+
+    for(int i=0; i<count;++i)
+        pedersen_exp(r[i],base,e[i],secrecy,fb,params,ctx);
+}
+
+/**
+ * Commits to count values at once. Coupons are used for h^s while the pool
+ * has some; the other exponentiations go through the batch kernel.
+ * @param out: Vector receiving the commitments
+ * @param slots: Entry of out for each value, NULL for 0..count-1
+ * @param m: Values to commit to
+ * @param count: Number of values
+ * @param params: Pedersen parameters
+ * @param coupons: Precomputed (s, h^s) pairs, may be NULL
+ * @param ctx: OpenSSL context
+ */
+void pedersen_commit_batch(PED_commit_vector* out, const int* slots, BIGNUM** m, int count, PED_params* params, PED_coupon_pool* coupons, BN_CTX* ctx){
+
+    BIGNUM** gm = (BIGNUM**) malloc(sizeof(BIGNUM*)*count*4);
+    BIGNUM** hs = gm + count;
+    BIGNUM** fresh_s = hs + count;
+    BIGNUM** fresh_hs = fresh_s + count;
+    PED_coupon c;
+    int i, nfresh=0;
+
+    ZKP_SPAN_BEGIN(span,"pedersen.commit_batch");
+    BN_CTX_start(ctx);
+
+    for(i=0; i<count;++i){
+
+        gm[i] = BN_CTX_get(ctx);
+        hs[i] = BN_CTX_get(ctx);
+
+        if (coupons != NULL && coupon_pool_take(coupons,&c)){
+            BN_copy(hs[i],c.hs);
+            commit_vector_set_s(out,slots != NULL ? slots[i] : i,c.s);
+            BN_free(c.hs);
+            BN_clear_free(c.s);
+        }
+        else{
+            fresh_s[nfresh] = BN_CTX_get(ctx);
+            BN_rand_range(fresh_s[nfresh],params->p);
+            BN_set_flags(fresh_s[nfresh],BN_FLG_CONSTTIME);
+            commit_vector_set_s(out,slots != NULL ? slots[i] : i,fresh_s[nfresh]);
+            fresh_hs[nfresh] = hs[i];
+            nfresh++;
+        }
+    }
+
+    pedersen_exp_batch(gm,params->g,params->mb_g,params->g_table,m,count,PED_SECRET,params,ctx);
+    pedersen_exp_batch(fresh_hs,params->h,params->mb_h,params->h_table,fresh_s,nfresh,PED_SECRET,params,ctx);
+
+    for(i=0; i<count;++i){
+        pedersen_mod_mul(hs[i],gm[i],hs[i],params,ctx);
+        commit_vector_set_c(out,slots != NULL ? slots[i] : i,hs[i]);
+    }
+
+    for(i=0; i<nfresh;++i){
+        BN_clear(fresh_s[i]);
+    }
+
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,(uint64_t) nfresh*BN_num_bytes(params->p));
+    BN_CTX_end(ctx);
+    ZKP_SPAN_END(span);
+
+    free(gm);
+}
+
+/**
+ * Recomputes the commitments g^m h^s of count openings, on public values
+ * @param c: Where to store the commitments
+ * @param s: Randomnesses
+ * @param m: Values
+ * @param count: Number of openings
+ */
+void pedersen_recommit_batch(BIGNUM** c, BIGNUM** s, BIGNUM** m, int count, PED_params* params, BN_CTX* ctx){
+
+    BIGNUM** hs = (BIGNUM**) malloc(sizeof(BIGNUM*)*count);
+
+    BN_CTX_start(ctx);
+
+    for(int i=0; i<count;++i){
+        hs[i] = BN_CTX_get(ctx);
+    }
+
+    pedersen_exp_batch(c,params->g,params->mb_g,params->g_table,m,count,PED_PUBLIC,params,ctx);
+    pedersen_exp_batch(hs,params->h,params->mb_h,NULL,s,count,PED_PUBLIC,params,ctx);
+
+    for(int i=0; i<count;++i){
+        pedersen_mod_mul(c[i],c[i],hs[i],params,ctx);
+    }
+
+    BN_CTX_end(ctx);
+
+    free(hs);
+}
+
+/**
+ * Checks count openings at once
+ * @param c: Commitments
+ * @param s: Randomnesses
+ * @param m: Claimed values
+ * @param count: Number of openings
+ * @return -1 if every opening is correct, else the index of the first wrong one
+ */
+int pederesen_unveil_batch(BIGNUM** c, BIGNUM** s, BIGNUM** m, int count, PED_params* params, BN_CTX* ctx){
+
+    BIGNUM** local_c = (BIGNUM**) malloc(sizeof(BIGNUM*)*count);
+    int i, failed=-1;
+
+    ZKP_SPAN_BEGIN(span,"pedersen.unveil_batch");
+    BN_CTX_start(ctx);
+
+    for(i=0; i<count;++i){
+        local_c[i] = BN_CTX_get(ctx);
+    }
+
+    pedersen_recommit_batch(local_c,s,m,count,params,ctx);
+
+    for(i=0; i<count;++i){
+        if (failed < 0 && BN_cmp(local_c[i],c[i]) != 0)
+            failed = i;
+    }
+
+    BN_CTX_end(ctx);
+    ZKP_SPAN_END(span);
+
+    free(local_c);
+
+    return failed;
+}
+
+#endif
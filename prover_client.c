@@ -0,0 +1,287 @@
+/*
+Prover client of the verifier daemon, for load tests.
+
+Opens sessions concurrent connections, one thread each. Every session
+generates its own yes-instance, sends it to the verifier, then runs rounds
+rounds of the protocol. Prints the round throughput and latency.
+
+Linux only. Build: gcc -O2 prover_client.c -lcrypto -lpthread -o prover_client
+The fixed-width kernels check for mulx/adx at runtime, no -m flag is needed;
+add -DFIXED_PORTABLE to run them on the portable multiply-accumulate instead.
+Usage: prover_client tcp:<host>:<port>|unix:<path> [sessions] [rounds] [n] [k] [bits] [depth]
+
+With depth > 1, each session keeps the commitments of up to depth rounds in
+flight, see zkp_engine.h.
+*/
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ctx_pool.h"
+#include "wire.h"
+#include "zkp_engine.h"
+
+// Prover state is small, threads do not need the default 8 MB of stack
+#define CLIENT_STACK_SIZE (512*1024)
+
+typedef struct client_job
+{
+    /* data */
+    const char* addr;
+    PED_params* params;
+    ZKP_config cfg;
+    int rounds;
+
+    // Results
+    int accepted;
+    int failed;
+    double latency;
+    double worst;
+} CLIENT_job;
+
+double client_now(){
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/**
+ * Connects to tcp:<host>:<port> or unix:<path>
+ */
+int client_connect(const char* addr){
+
+    struct addrinfo hints, *res;
+    struct sockaddr_un un;
+    char host[256];
+    const char* port;
+    int fd = -1, one = 1;
+
+    if (strncmp(addr,"tcp:",4) == 0 && (port = strrchr(addr+4,':')) != NULL && (size_t) (port-addr-4) < sizeof(host)){
+
+        memcpy(host,addr+4,port-addr-4);
+        host[port-addr-4] = 0;
+
+        memset(&hints,0,sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        if (getaddrinfo(host,port+1,&hints,&res) != 0)
+            return -1;
+
+        fd = socket(res->ai_family,SOCK_STREAM,0);
+
+        if (connect(fd,res->ai_addr,res->ai_addrlen) < 0){
+            close(fd);
+            fd = -1;
+        }
+        else
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+
+        freeaddrinfo(res);
+    }
+    else if (strncmp(addr,"unix:",5) == 0 && strlen(addr+5) < sizeof(un.sun_path)){
+
+        memset(&un,0,sizeof(un));
+        un.sun_family = AF_UNIX;
+        strcpy(un.sun_path,addr+5);
+
+        fd = socket(AF_UNIX,SOCK_STREAM,0);
+
+        if (connect(fd,(struct sockaddr*) &un,sizeof(un)) < 0){
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    return fd;
+}
+
+/**
+ * Drives the prover machine over the connection, one round at a time
+ * @return ZKP_OK, or why the session stopped
+ */
+ZKP_error client_run(int fd, PROVER_machine* m, CLIENT_job* job){
+
+    WIRE_buf out, in;
+    WIRE_reader r;
+    uint8_t type;
+    ZKP_step step;
+    double start = client_now(), t;
+    int round = 0;
+
+    wire_buf_init(&out);
+    wire_buf_init(&in);
+
+    step = PROVER_machine_step(m,0,NULL,&out);
+
+    while (step == ZKP_STEP_RECV || step == ZKP_STEP_MORE){
+
+        if (!wire_send_all(fd,&out)){
+            m->error = ZKP_ERR_PEER;
+            break;
+        }
+
+        // Next commitments, computed while the verifier handles the frames just sent
+        if (step == ZKP_STEP_MORE){
+            step = PROVER_machine_step(m,0,NULL,&out);
+            continue;
+        }
+
+        if (!wire_recv_frame(fd,&in,&type,&r)){
+            m->error = ZKP_ERR_PEER;
+            break;
+        }
+
+        // The READY frame starts the clock of the first round
+        if (type == WIRE_READY)
+            start = client_now();
+
+        step = PROVER_machine_step(m,type,&r,&out);
+
+        if (m->round > round){
+            t = client_now() - start;
+            job->latency += t;
+            if (t > job->worst) job->worst = t;
+            start = client_now();
+            round = m->round;
+        }
+    }
+
+    wire_buf_free(&out);
+    wire_buf_free(&in);
+
+    return m->error;
+}
+
+void* client_session(void* arg){
+
+    CLIENT_job* job = (CLIENT_job*) arg;
+    BN_CTX* ctx = zkp_ctx();
+    BIGNUM* M = BN_new();
+    KSS_instance* inst;
+    PROVER_data* P;
+    PROVER_machine m;
+    int fd;
+
+    BN_sub(M,job->params->p,BN_value_one());
+    inst = gen_instance_quiet(M,ctx,job->cfg.n,job->cfg.k);
+    P = PROVER_new(job->params,inst,NULL);
+    PROVER_machine_init(&m,P,job->rounds,job->cfg.depth);
+
+    if ((fd = client_connect(job->addr)) < 0){
+        job->failed = job->rounds;
+        goto end;
+    }
+
+    if (client_run(fd,&m,job) != ZKP_OK)
+        fprintf(stderr,"Session stopped after %d rounds: %s\n",m.round,zkp_error_string(m.error));
+
+    job->accepted = m.accepted;
+    job->failed = job->rounds - m.round;
+
+    close(fd);
+
+end:
+    PROVER_machine_free(&m);
+    PROVER_free(P);
+    kss_free(inst);
+    BN_free(M);
+    zkp_ctx_release();
+
+    return NULL;
+}
+
+int main(int argc, char** argv){
+
+    ZKP_config cfg;
+    CLIENT_job* jobs;
+    pthread_t* threads;
+    pthread_attr_t attr;
+    int sessions = argc > 2 ? atoi(argv[2]) : 1;
+    int rounds = argc > 3 ? atoi(argv[3]) : 10;
+    int accepted = 0, failed = 0, done = 0;
+    double start, elapsed, latency = 0, worst = 0;
+
+    zkp_trace_init();
+
+    if (argc < 2 || sessions < 1 || rounds < 1 || !zkp_config_init(&cfg,argc > 4 ? atoi(argv[4]) : ZKP_DEFAULT_N,argc > 5 ? atoi(argv[5]) : ZKP_DEFAULT_K,argc > 6 ? atoi(argv[6]) : ZKP_DEFAULT_BITS)){
+        puts("Usage: prover_client tcp:<host>:<port>|unix:<path> [sessions] [rounds] [n] [k] [bits] [depth]");
+        exit(1);
+    }
+
+    if (argc > 7){
+        cfg.depth = atoi(argv[7]);
+
+        if (cfg.depth < 1 || cfg.depth > ZKP_MAX_DEPTH){
+            printf("Unsupported pipeline depth %d (1 to %d).\n",cfg.depth,ZKP_MAX_DEPTH);
+            exit(1);
+        }
+    }
+
+    signal(SIGPIPE,SIG_IGN);
+
+    PED_params* params = pedersen_get_param(cfg.bits,zkp_ctx());
+    pedersen_precompute(params,FB_DEFAULT_WINDOW,zkp_ctx());
+    view_init(NULL,0,NULL,0);
+
+    jobs = (CLIENT_job*) calloc(sessions,sizeof(CLIENT_job));
+    threads = (pthread_t*) malloc(sizeof(pthread_t)*sessions);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr,CLIENT_STACK_SIZE);
+
+    start = client_now();
+
+    for(int i=0; i<sessions;++i){
+        jobs[i].addr = argv[1];
+        jobs[i].params = params;
+        jobs[i].cfg = cfg;
+        jobs[i].rounds = rounds;
+        pthread_create(&threads[i],&attr,client_session,&jobs[i]);
+    }
+
+    for(int i=0; i<sessions;++i){
+
+        pthread_join(threads[i],NULL);
+
+        accepted += jobs[i].accepted;
+        failed += jobs[i].failed;
+        done += rounds - jobs[i].failed;
+        latency += jobs[i].latency;
+        if (jobs[i].worst > worst) worst = jobs[i].worst;
+    }
+
+    elapsed = client_now() - start;
+
+    printf("%d sessions x %d rounds, n=%d, %d bits, depth %d\n",sessions,rounds,cfg.n,cfg.bits,cfg.depth);
+    printf("%d accepted, %d rejected, %d failed\n",accepted,done-accepted,failed);
+    printf("%.1f rounds/s, mean latency %.2f ms, worst %.2f ms\n",done/elapsed,done > 0 ? 1e3*latency/done : 0.0,1e3*worst);
+
+#ifdef ZKP_TRACE
+    zkp_trace_print();
+    zkp_trace_write_json("prover_trace.json");
+#endif
+
+    pthread_attr_destroy(&attr);
+    free(jobs);
+    free(threads);
+    zkp_ctx_release();
+
+    return failed == 0 && accepted == done ? 0 : 1;
+}
@@ -1,6 +1,7 @@
 #include <openssl/bn.h>
+#include "ctx_pool.h"
 
-#define BITS 1024
+#define SQRT_BITS 1024
 
 typedef struct 
 {
@@ -19,8 +20,8 @@ committer_data* gen_ref_string_committer(){
     BIGNUM* p = BN_new();
     BIGNUM* q = BN_new();
 
-    BN_generate_prime_ex(p,BITS,0,NULL,NULL,NULL);
-    BN_generate_prime_ex(q,BITS,0,NULL,NULL,NULL);
+    BN_generate_prime_ex(p,SQRT_BITS,0,NULL,NULL,NULL);
+    BN_generate_prime_ex(q,SQRT_BITS,0,NULL,NULL,NULL);
 
     comm_dat->p = p;
     comm_dat->q = q;
@@ -32,9 +33,8 @@ receiver_data* gen_ref_string_receiver(committer_data* comm){
 
     receiver_data* rcv = (receiver_data*) malloc(sizeof(receiver_data));
     BIGNUM* N = BN_new();
-    BN_CTX* ctx1 = BN_CTX_new(); //destroy
 
-    BN_mul(N,comm->p,comm->q,ctx1);
+    BN_mul(N,comm->p,comm->q,zkp_ctx());
 
     rcv->N = N;
 
@@ -43,10 +43,12 @@ receiver_data* gen_ref_string_receiver(committer_data* comm){
 
 BIGNUM* chinese_remainder(BIGNUM* x,BIGNUM* p, BIGNUM* y, BIGNUM* q){
 
-    BIGNUM* p_inv = BN_new();
+    ZKP_scratch sc = zkp_scratch_begin();
+    BN_CTX* ctx1 = sc.ctx;
+
+    BIGNUM* p_inv = zkp_scratch_get(&sc);
+    BIGNUM* N = zkp_scratch_get(&sc);
     BIGNUM* temp = BN_new();
-    BIGNUM* N = BN_new();
-    BN_CTX* ctx1 = BN_CTX_new(); //destroy
 
     BN_mul(N,p,q,ctx1);
     BN_mod_inverse(p_inv,p,q,ctx1);
@@ -55,6 +57,8 @@ BIGNUM* chinese_remainder(BIGNUM* x,BIGNUM* p, BIGNUM* y, BIGNUM* q){
     BN_mod_mul(temp,temp,p,N,ctx1);
     BN_mod_add(temp,temp,x,N,ctx1);
 
+    zkp_scratch_end(&sc);
+
     return temp;
 }
 
@@ -63,14 +67,15 @@ BIGNUM* chinese_remainder(BIGNUM* x,BIGNUM* p, BIGNUM* y, BIGNUM* q){
  */
 BIGNUM* mod_sqrt_semiprime(BIGNUM* x, BIGNUM* p, BIGNUM* q){
 
-    BIGNUM* p_sqrt = BN_new();
-    BIGNUM* q_sqrt = BN_new();
-    BIGNUM* p_sqrt_cmpl = BN_new();
-    BIGNUM* q_sqrt_cmpl = BN_new();
-    BIGNUM* zero = BN_new();
-    BN_zero(zero);
+    ZKP_scratch sc = zkp_scratch_begin();
+    BN_CTX* ctx1 = sc.ctx;
 
-    BN_CTX* ctx1 = BN_CTX_new(); //destroy
+    BIGNUM* p_sqrt = zkp_scratch_get(&sc);
+    BIGNUM* q_sqrt = zkp_scratch_get(&sc);
+    BIGNUM* p_sqrt_cmpl = zkp_scratch_get(&sc);
+    BIGNUM* q_sqrt_cmpl = zkp_scratch_get(&sc);
+    BIGNUM* zero = zkp_scratch_get(&sc);
+    BN_zero(zero);
 
     // compute modular square roots mod primes
     BN_mod_sqrt(p_sqrt,x,p,ctx1);
@@ -80,10 +85,12 @@ BIGNUM* mod_sqrt_semiprime(BIGNUM* x, BIGNUM* p, BIGNUM* q){
 
 
     // combine via CRT
-    chinese_remainder(p_sqrt,p,q_sqrt,q);
-    chinese_remainder(p_sqrt_cmpl,p,q_sqrt,q);
-    chinese_remainder(p_sqrt,p,q_sqrt_cmpl,q);
-    chinese_remainder(p_sqrt_cmpl,p,q_sqrt_cmpl,q);
+    BN_free(chinese_remainder(p_sqrt,p,q_sqrt,q));
+    BN_free(chinese_remainder(p_sqrt_cmpl,p,q_sqrt,q));
+    BN_free(chinese_remainder(p_sqrt,p,q_sqrt_cmpl,q));
+    BN_free(chinese_remainder(p_sqrt_cmpl,p,q_sqrt_cmpl,q));
+
+    zkp_scratch_end(&sc);
 
     return NULL;
 }
@@ -91,17 +98,18 @@ BIGNUM* mod_sqrt_semiprime(BIGNUM* x, BIGNUM* p, BIGNUM* q){
 
 BIGNUM* commit(committer_data* comm, BIGNUM* m){
 
-    BIGNUM* N = BN_new();
-    BIGNUM* thresh = BN_new();
-    BIGNUM* two = BN_new();
+    ZKP_scratch sc = zkp_scratch_begin();
+    BN_CTX* ctx1 = sc.ctx;
+
+    BIGNUM* N = zkp_scratch_get(&sc);
+    BIGNUM* thresh = zkp_scratch_get(&sc);
+    BIGNUM* two = zkp_scratch_get(&sc);
     BIGNUM* square = BN_new();
 
     // get const 2
     BN_add(two, BN_value_one(),BN_value_one());
 
 
-    BN_CTX* ctx1 = BN_CTX_new(); //destroy
-
     BN_mul(N,comm->p,comm->q,ctx1);
 
     // Reject if m is smaller than N/2
@@ -109,9 +117,13 @@ BIGNUM* commit(committer_data* comm, BIGNUM* m){
 
     if (BN_cmp(m,thresh) >= 0){
         printf("Error! Invalid commitment value!");
+        zkp_scratch_end(&sc);
+        BN_free(square);
         return NULL;
     }
 
     BN_mod_sqr(square,m,N,ctx1);
 
+    zkp_scratch_end(&sc);
+
 }
\ No newline at end of file
@@ -2,8 +2,7 @@
 
 #include <openssl/bn.h>
 
-#define DEBUG
-
+// Build with -DDEBUG for the trace of the protocol, it is off the hot paths otherwise
 #ifdef DEBUG
 #define DEBUG_PRINT(...) do{ fprintf( stderr, __VA_ARGS__ ); } while( false )
 #else
@@ -43,6 +42,10 @@ BIGNUM* BN_xor( BIGNUM* x, BIGNUM* y){
 
     BN_bin2bn(buf_res,size,res);
 
+    free(buf_x);
+    free(buf_y);
+    free(buf_res);
+
     return res;
 
 }
\ No newline at end of file
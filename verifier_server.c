@@ -0,0 +1,608 @@
+/*
+Verifier daemon for the variable-size protocol.
+
+One epoll loop owns every socket and does all the I/O: it reads frames,
+buffers replies and never computes. Each complete frame is handed with its
+session to a pool of worker threads, which run the protocol step (parsing,
+hashing, modular exponentiations) and write the reply. The loop is woken
+through an eventfd when a step is done. A session has at most one step in
+flight and is not read from meanwhile, so a slow session never blocks the
+others and its input buffer stays put while a worker parses it.
+
+The protocol itself is the verifier machine of zkp_engine.h, one per
+session; the server only moves its frames.
+
+Linux only. Build: gcc -O2 verifier_server.c -lcrypto -lpthread -o verifier_server
+The fixed-width kernels check for mulx/adx at runtime, no -m flag is needed;
+add -DFIXED_PORTABLE to run them on the portable multiply-accumulate instead.
+Usage: verifier_server tcp:<port>|unix:<path> [bits] [workers]
+*/
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ctx_pool.h"
+#include "wire.h"
+#include "zkp_engine.h"
+
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_MAX_EVENTS 256
+#define SERVER_BACKLOG 1024
+
+typedef enum session_state
+{
+    SESSION_OPEN = 0,
+    SESSION_CLOSED
+} SESSION_state;
+
+typedef struct session
+{
+    /* data */
+    int fd;
+    SESSION_state state;
+    bool busy;          // A worker owns the session
+    bool dead;          // The peer left while a worker owned it
+    WIRE_buf in;
+    WIRE_buf out;
+
+    // Step handed to a worker, and its result
+    uint8_t frame_type;
+    WIRE_reader frame;
+    WIRE_buf reply;
+    int accepted;
+
+    VERIFIER_machine machine;
+
+    struct session* next;
+
+    // Every session not yet freed, to free them on shutdown
+    struct session* live_prev;
+    struct session* live_next;
+} SESSION;
+
+typedef struct session_queue
+{
+    /* data */
+    SESSION* head;
+    SESSION* tail;
+} SESSION_queue;
+
+typedef struct server
+{
+    /* data */
+    int epfd;
+    int listen_fd;
+    int event_fd;
+    PED_params* params;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    SESSION_queue todo;
+    SESSION_queue done;
+    bool stop;
+
+    pthread_t* workers;
+    int nworkers;
+    SESSION* live;
+
+    unsigned long sessions;
+    unsigned long rounds;
+    unsigned long accepted;
+} SERVER;
+
+volatile sig_atomic_t server_stop = 0;
+
+void server_on_signal(int sig){
+    (void) sig;
+    server_stop = 1;
+}
+
+void session_queue_push(SESSION_queue* q, SESSION* s){
+
+    s->next = NULL;
+
+    if (q->tail != NULL)
+        q->tail->next = s;
+    else
+        q->head = s;
+
+    q->tail = s;
+}
+
+SESSION* session_queue_pop(SESSION_queue* q){
+
+    SESSION* s = q->head;
+
+    if (s != NULL){
+        q->head = s->next;
+        if (q->head == NULL)
+            q->tail = NULL;
+    }
+
+    return s;
+}
+
+SESSION* session_new(int fd, PED_params* params){
+
+    SESSION* s = (SESSION*) calloc(1,sizeof(SESSION));
+
+    s->fd = fd;
+    s->state = SESSION_OPEN;
+    VERIFIER_machine_init(&s->machine,params);
+    wire_buf_init(&s->in);
+    wire_buf_init(&s->out);
+    wire_buf_init(&s->reply);
+
+    return s;
+}
+
+void session_free(SESSION* s){
+
+    VERIFIER_machine_free(&s->machine);
+    wire_buf_free(&s->in);
+    wire_buf_free(&s->out);
+    wire_buf_free(&s->reply);
+    free(s);
+}
+
+/**
+ * Runs the verifier machine on the frame handed to a worker, writing the reply
+ */
+void session_step(SESSION* s){
+
+    int rounds = s->machine.rounds;
+
+    if (VERIFIER_machine_step(&s->machine,s->frame_type,&s->frame,&s->reply) == ZKP_STEP_FAIL)
+        s->state = SESSION_CLOSED;
+
+    s->accepted = s->machine.rounds > rounds ? s->machine.last : -1;
+}
+
+void* server_worker(void* arg){
+
+    SERVER* srv = (SERVER*) arg;
+    SESSION* s;
+    uint64_t one = 1;
+
+    while (true){
+
+        pthread_mutex_lock(&srv->lock);
+
+        while (!srv->stop && srv->todo.head == NULL)
+            pthread_cond_wait(&srv->cond,&srv->lock);
+
+        // On shutdown the queued steps are dropped with their sessions
+        s = srv->stop ? NULL : session_queue_pop(&srv->todo);
+
+        pthread_mutex_unlock(&srv->lock);
+
+        if (s == NULL)
+            break;
+
+        session_step(s);
+
+        pthread_mutex_lock(&srv->lock);
+        session_queue_push(&srv->done,s);
+        pthread_mutex_unlock(&srv->lock);
+
+        // Only fails when the counter is full, and then the loop is woken anyway
+        if (write(srv->event_fd,&one,sizeof(one)) < 0 && errno != EAGAIN)
+            perror("eventfd write");
+    }
+
+    return NULL;
+}
+
+void server_link(SERVER* srv, SESSION* s){
+
+    s->live_prev = NULL;
+    s->live_next = srv->live;
+
+    if (srv->live != NULL)
+        srv->live->live_prev = s;
+
+    srv->live = s;
+}
+
+void server_free_session(SERVER* srv, SESSION* s){
+
+    if (s->live_prev != NULL)
+        s->live_prev->live_next = s->live_next;
+    else
+        srv->live = s->live_next;
+
+    if (s->live_next != NULL)
+        s->live_next->live_prev = s->live_prev;
+
+    session_free(s);
+}
+
+void server_watch(SERVER* srv, SESSION* s){
+
+    struct epoll_event ev;
+
+    // No reading while a worker owns the input buffer
+    ev.events = (s->busy ? 0 : EPOLLIN) | (s->out.pos < s->out.len ? EPOLLOUT : 0);
+    ev.data.ptr = s;
+
+    epoll_ctl(srv->epfd,EPOLL_CTL_MOD,s->fd,&ev);
+}
+
+void server_close(SERVER* srv, SESSION* s){
+
+    epoll_ctl(srv->epfd,EPOLL_CTL_DEL,s->fd,NULL);
+    close(s->fd);
+    s->fd = -1;
+
+    // The worker still owns it: freed when its step comes back
+    if (s->busy)
+        s->dead = true;
+    else
+        server_free_session(srv,s);
+}
+
+/**
+ * Writes what the socket takes of the pending output
+ * @return false if the connection is gone
+ */
+bool session_flush(SESSION* s){
+
+    ssize_t w;
+
+    while (s->out.pos < s->out.len){
+
+        w = send(s->fd,s->out.data+s->out.pos,s->out.len-s->out.pos,MSG_NOSIGNAL);
+
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (w <= 0)
+            return false;
+
+        s->out.pos += w;
+    }
+
+    s->out.len = 0;
+    s->out.pos = 0;
+
+    return true;
+}
+
+/**
+ * Hands the next buffered frame, if complete, to the workers
+ * @return false if the input is malformed
+ */
+bool session_pump(SERVER* srv, SESSION* s){
+
+    int res;
+
+    if (s->busy || s->state == SESSION_CLOSED)
+        return true;
+
+    wire_buf_compact(&s->in);
+
+    res = wire_next_frame(&s->in,&s->frame_type,&s->frame);
+
+    if (res < 0)
+        return false;
+
+    if (res == 1){
+        s->busy = true;
+        s->reply.len = 0;
+
+        pthread_mutex_lock(&srv->lock);
+        session_queue_push(&srv->todo,s);
+        pthread_cond_signal(&srv->cond);
+        pthread_mutex_unlock(&srv->lock);
+    }
+
+    return true;
+}
+
+/**
+ * Reads everything available on the socket
+ * @return false on end of stream or error
+ */
+bool session_read(SESSION* s){
+
+    ssize_t got;
+
+    while (true){
+
+        got = recv(s->fd,wire_buf_reserve(&s->in,65536),65536,0);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (got <= 0)
+            return false;
+
+        s->in.len += got;
+
+        // Bounded by one frame: the rest waits in the kernel
+        if (s->in.len - s->in.pos > WIRE_MAX_FRAME + WIRE_HEADER)
+            return true;
+    }
+}
+
+/**
+ * Takes back the sessions whose step is done
+ */
+void server_collect(SERVER* srv){
+
+    SESSION_queue done;
+    SESSION* s;
+    uint64_t count;
+
+    // Nothing to read after a spurious wakeup, the queue is checked anyway
+    if (read(srv->event_fd,&count,sizeof(count)) < 0 && errno != EAGAIN)
+        perror("eventfd read");
+
+    pthread_mutex_lock(&srv->lock);
+    done = srv->done;
+    srv->done.head = NULL;
+    srv->done.tail = NULL;
+    pthread_mutex_unlock(&srv->lock);
+
+    while ((s = session_queue_pop(&done)) != NULL){
+
+        s->busy = false;
+
+        if (s->dead){
+            server_free_session(srv,s);
+            continue;
+        }
+
+        if (s->accepted >= 0){
+            srv->rounds++;
+            srv->accepted += s->accepted;
+        }
+
+        wire_put_bytes(&s->out,s->reply.data,s->reply.len);
+
+        if (!session_flush(s)){
+            server_close(srv,s);
+            continue;
+        }
+
+        // After an error the reply is the last thing sent
+        if (s->state == SESSION_CLOSED && s->out.pos == s->out.len){
+            server_close(srv,s);
+            continue;
+        }
+
+        // The prover may have pipelined its next frame
+        if (!session_pump(srv,s)){
+            server_close(srv,s);
+            continue;
+        }
+
+        server_watch(srv,s);
+    }
+}
+
+void server_accept(SERVER* srv){
+
+    struct epoll_event ev;
+    SESSION* s;
+    int fd, one = 1;
+
+    while ((fd = accept4(srv->listen_fd,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC)) >= 0){
+
+        setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+
+        s = session_new(fd,srv->params);
+        server_link(srv,s);
+        srv->sessions++;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        epoll_ctl(srv->epfd,EPOLL_CTL_ADD,fd,&ev);
+    }
+}
+
+void server_event(SERVER* srv, SESSION* s, uint32_t events){
+
+    if (events & (EPOLLERR|EPOLLHUP) && !(events & EPOLLIN)){
+        server_close(srv,s);
+        return;
+    }
+
+    if (events & EPOLLOUT){
+        if (!session_flush(s)){
+            server_close(srv,s);
+            return;
+        }
+
+        if (s->state == SESSION_CLOSED && s->out.pos == s->out.len){
+            server_close(srv,s);
+            return;
+        }
+    }
+
+    if (events & EPOLLIN && !s->busy){
+        if (!session_read(s) || !session_pump(srv,s)){
+            server_close(srv,s);
+            return;
+        }
+    }
+
+    server_watch(srv,s);
+}
+
+/**
+ * Opens the listening socket for tcp:<port> or unix:<path>
+ */
+int server_listen(const char* addr){
+
+    struct sockaddr_in in;
+    struct sockaddr_un un;
+    int fd, one = 1;
+
+    if (strncmp(addr,"tcp:",4) == 0){
+
+        fd = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+        memset(&in,0,sizeof(in));
+        in.sin_family = AF_INET;
+        in.sin_addr.s_addr = htonl(INADDR_ANY);
+        in.sin_port = htons((unsigned short) atoi(addr+4));
+
+        if (bind(fd,(struct sockaddr*) &in,sizeof(in)) < 0){
+            perror("bind");
+            return -1;
+        }
+    }
+    else if (strncmp(addr,"unix:",5) == 0 && strlen(addr+5) < sizeof(un.sun_path)){
+
+        fd = socket(AF_UNIX,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+
+        memset(&un,0,sizeof(un));
+        un.sun_family = AF_UNIX;
+        strcpy(un.sun_path,addr+5);
+        unlink(un.sun_path);
+
+        if (bind(fd,(struct sockaddr*) &un,sizeof(un)) < 0){
+            perror("bind");
+            return -1;
+        }
+    }
+    else{
+        printf("Unknown address %s.\n",addr);
+        return -1;
+    }
+
+    if (listen(fd,SERVER_BACKLOG) < 0){
+        perror("listen");
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Stops and joins the workers, then closes and frees every session. A
+ * worker finishes the step it runs, the queued steps are dropped.
+ */
+void server_shutdown(SERVER* srv){
+
+    SESSION* s;
+
+    pthread_mutex_lock(&srv->lock);
+    srv->stop = true;
+    pthread_cond_broadcast(&srv->cond);
+    pthread_mutex_unlock(&srv->lock);
+
+    for(int i=0; i<srv->nworkers;++i)
+        pthread_join(srv->workers[i],NULL);
+
+    while ((s = srv->live) != NULL){
+        if (s->fd >= 0)
+            close(s->fd);
+        server_free_session(srv,s);
+    }
+
+    free(srv->workers);
+    close(srv->event_fd);
+    close(srv->listen_fd);
+    close(srv->epfd);
+    pthread_cond_destroy(&srv->cond);
+    pthread_mutex_destroy(&srv->lock);
+}
+
+int main(int argc, char** argv){
+
+    struct epoll_event ev, events[SERVER_MAX_EVENTS];
+    SERVER srv;
+    int bits = argc > 2 ? atoi(argv[2]) : ZKP_DEFAULT_BITS;
+    int workers = argc > 3 ? atoi(argv[3]) : SERVER_DEFAULT_WORKERS;
+    int ready;
+
+    zkp_trace_init();
+
+    if (argc < 2 || workers < 1){
+        puts("Usage: verifier_server tcp:<port>|unix:<path> [bits] [workers]");
+        exit(1);
+    }
+
+    signal(SIGPIPE,SIG_IGN);
+    signal(SIGINT,server_on_signal);
+    signal(SIGTERM,server_on_signal);
+
+    memset(&srv,0,sizeof(srv));
+    pthread_mutex_init(&srv.lock,NULL);
+    pthread_cond_init(&srv.cond,NULL);
+
+    srv.params = pedersen_get_param(bits,zkp_ctx());
+    pedersen_precompute(srv.params,FB_DEFAULT_WINDOW,zkp_ctx());
+
+    // Creates the shared zero of views before the workers can race on it
+    view_init(NULL,0,NULL,0);
+
+    if ((srv.listen_fd = server_listen(argv[1])) < 0)
+        exit(1);
+
+    srv.epfd = epoll_create1(EPOLL_CLOEXEC);
+    srv.event_fd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv.listen_fd;
+    epoll_ctl(srv.epfd,EPOLL_CTL_ADD,srv.listen_fd,&ev);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv.event_fd;
+    epoll_ctl(srv.epfd,EPOLL_CTL_ADD,srv.event_fd,&ev);
+
+    srv.workers = (pthread_t*) malloc(sizeof(pthread_t)*workers);
+    srv.nworkers = workers;
+
+    for(int i=0; i<workers;++i)
+        pthread_create(&srv.workers[i],NULL,server_worker,&srv);
+
+    printf("Verifier listening on %s with %d workers\n",argv[1],workers);
+    fflush(stdout);
+
+    while (!server_stop){
+
+        ready = epoll_wait(srv.epfd,events,SERVER_MAX_EVENTS,-1);
+
+        for(int i=0; i<ready;++i){
+
+            if (events[i].data.ptr == &srv.listen_fd)
+                server_accept(&srv);
+            else if (events[i].data.ptr == &srv.event_fd)
+                server_collect(&srv);
+            else
+                server_event(&srv,(SESSION*) events[i].data.ptr,events[i].events);
+        }
+    }
+
+    server_shutdown(&srv);
+
+    printf("%lu sessions, %lu rounds, %lu accepted\n",srv.sessions,srv.rounds,srv.accepted);
+
+#ifdef ZKP_TRACE
+    zkp_trace_print();
+    zkp_trace_write_json("verifier_trace.json");
+#endif
+
+    return 0;
+}
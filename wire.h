@@ -0,0 +1,480 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <openssl/bn.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "bitsol.h"
+#include "commit_vector.h"
+#include "zkp_fixed_size.h"
+
+/*
+Wire format of the interactive protocol between a prover and a verifier.
+
+Every message is one frame: a 4-byte big-endian length, then a 1-byte type
+and the payload, the length counting the type and the payload. Integers in
+payloads are 4-byte big-endian. Values are fixed-width little-endian bytes:
+instance values on the size of M, opened values on the size of the padded
+instance (kss_padded_width), commitments, randomnesses and sums on
+8*words bytes, the layout of a commitment vector, so vectors are copied as
+they are.
+
+    HELLO     P->V  n, size of M, M, S, pipeline depth (1 byte), the n
+                    values of the instance
+    READY     V->P  empty
+    COMMITS   P->V  count, words, the c values of both vectors
+    CHALLENGE V->P  index (1 byte)
+    RESPONSE  P->V  the opened values, their randomnesses, the permuted
+                    solution (count bits as 64-bit words) and the sum of
+                    the selected randomnesses
+    RESULT    V->P  1 if the verifier accepts, else 0
+    ERROR     V->P  empty, the verifier closes the connection
+
+After READY the prover may run any number of rounds, COMMITS to RESULT.
+Rounds are pipelined: the prover may send the COMMITS of up to depth rounds
+before the RESPONSE of the oldest one. Challenges, responses and results
+follow the order of the COMMITS.
+*/
+
+#define WIRE_HEADER 5
+
+// Larger frames are a protocol error
+#define WIRE_MAX_FRAME (64*1024*1024)
+
+enum wire_type
+{
+    WIRE_HELLO = 1,
+    WIRE_READY = 2,
+    WIRE_COMMITS = 3,
+    WIRE_CHALLENGE = 4,
+    WIRE_RESPONSE = 5,
+    WIRE_RESULT = 6,
+    WIRE_ERROR = 7
+};
+
+/*
+Growable byte buffer: frames are appended at the end and consumed from pos
+*/
+typedef struct wire_buffer
+{
+    /* data */
+    unsigned char* data;
+    size_t len;
+    size_t cap;
+    size_t pos;
+} WIRE_buf;
+
+/*
+Bounds-checked cursor over a received payload. Reads past the end return
+zeroes and clear ok.
+*/
+typedef struct wire_reader
+{
+    /* data */
+    const unsigned char* p;
+    size_t left;
+    bool ok;
+} WIRE_reader;
+
+void wire_buf_init(WIRE_buf* b){
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+    b->pos = 0;
+}
+
+void wire_buf_free(WIRE_buf* b){
+    free(b->data);
+    wire_buf_init(b);
+}
+
+/**
+ * Makes room for extra more bytes
+ */
+unsigned char* wire_buf_reserve(WIRE_buf* b, size_t extra){
+
+    size_t cap = b->cap > 0 ? b->cap : 4096;
+
+    if (b->len + extra > b->cap){
+        while (cap < b->len + extra) cap *= 2;
+        b->data = (unsigned char*) realloc(b->data,cap);
+        b->cap = cap;
+    }
+
+    return b->data + b->len;
+}
+
+/**
+ * Drops the consumed bytes, moving what is left to the front
+ */
+void wire_buf_compact(WIRE_buf* b){
+
+    if (b->pos == 0)
+        return;
+
+    memmove(b->data,b->data+b->pos,b->len-b->pos);
+    b->len -= b->pos;
+    b->pos = 0;
+}
+
+void wire_put_bytes(WIRE_buf* b, const void* data, size_t n){
+    memcpy(wire_buf_reserve(b,n),data,n);
+    b->len += n;
+}
+
+void wire_put_u8(WIRE_buf* b, uint8_t x){
+    wire_put_bytes(b,&x,1);
+}
+
+void wire_put_u32(WIRE_buf* b, uint32_t x){
+
+    unsigned char be[4] = { (unsigned char) (x >> 24), (unsigned char) (x >> 16), (unsigned char) (x >> 8), (unsigned char) x };
+
+    wire_put_bytes(b,be,4);
+}
+
+/**
+ * Appends x as width little-endian bytes
+ */
+void wire_put_bn(WIRE_buf* b, const BIGNUM* x, int width){
+    BN_bn2lebinpad(x,wire_buf_reserve(b,width),width);
+    b->len += width;
+}
+
+/**
+ * Starts a frame of the given type
+ * @return Offset of the frame, for wire_end
+ */
+size_t wire_begin(WIRE_buf* b, uint8_t type){
+
+    size_t start = b->len;
+
+    wire_put_u32(b,0);
+    wire_put_u8(b,type);
+
+    return start;
+}
+
+/**
+ * Writes the length of the frame started at start
+ */
+void wire_end(WIRE_buf* b, size_t start){
+
+    uint32_t n = (uint32_t) (b->len - start - 4);
+
+    b->data[start] = (unsigned char) (n >> 24);
+    b->data[start+1] = (unsigned char) (n >> 16);
+    b->data[start+2] = (unsigned char) (n >> 8);
+    b->data[start+3] = (unsigned char) n;
+
+    ZKP_COUNT(ZKP_CNT_BYTES_SENT,4 + (uint64_t) n);
+}
+
+uint32_t wire_read_be32(const unsigned char* p){
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+/**
+ * Looks for a complete frame at the read position of b
+ * @param type: Type of the frame
+ * @param r: Reader over its payload
+ * @return 1 if a frame was found and consumed, 0 if more bytes are needed, -1 on a malformed frame
+ */
+int wire_next_frame(WIRE_buf* b, uint8_t* type, WIRE_reader* r){
+
+    size_t avail = b->len - b->pos;
+    uint32_t n;
+
+    if (avail < WIRE_HEADER)
+        return 0;
+
+    n = wire_read_be32(b->data+b->pos);
+
+    if (n < 1 || n > WIRE_MAX_FRAME)
+        return -1;
+
+    if (avail < 4 + (size_t) n)
+        return 0;
+
+    *type = b->data[b->pos+4];
+    r->p = b->data + b->pos + WIRE_HEADER;
+    r->left = n-1;
+    r->ok = true;
+
+    b->pos += 4 + (size_t) n;
+
+    ZKP_COUNT(ZKP_CNT_BYTES_RECV,4 + (uint64_t) n);
+
+    return 1;
+}
+
+const unsigned char* wire_get_bytes(WIRE_reader* r, size_t n){
+
+    const unsigned char* p = r->p;
+
+    if (!r->ok || r->left < n){
+        r->ok = false;
+        return NULL;
+    }
+
+    r->p += n;
+    r->left -= n;
+
+    return p;
+}
+
+uint8_t wire_get_u8(WIRE_reader* r){
+
+    const unsigned char* p = wire_get_bytes(r,1);
+
+    return p != NULL ? p[0] : 0;
+}
+
+uint32_t wire_get_u32(WIRE_reader* r){
+
+    const unsigned char* p = wire_get_bytes(r,4);
+
+    return p != NULL ? wire_read_be32(p) : 0;
+}
+
+/**
+ * Reads width little-endian bytes into out
+ */
+BIGNUM* wire_get_bn(WIRE_reader* r, int width, BIGNUM* out){
+
+    const unsigned char* p = wire_get_bytes(r,width);
+
+    if (p == NULL){
+        BN_zero(out);
+        return out;
+    }
+
+    return BN_lebin2bn(p,width,out);
+}
+
+#ifndef _WIN32
+
+/**
+ * Writes the whole buffer from pos on to a blocking descriptor
+ */
+bool wire_send_all(int fd, WIRE_buf* b){
+
+    ssize_t w;
+
+    while (b->pos < b->len){
+
+        w = write(fd,b->data+b->pos,b->len-b->pos);
+
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+
+        b->pos += w;
+    }
+
+    b->len = 0;
+    b->pos = 0;
+
+    return true;
+}
+
+/**
+ * Reads from a blocking descriptor until a whole frame is buffered in b
+ * @return false on end of stream or malformed frame
+ */
+bool wire_recv_frame(int fd, WIRE_buf* b, uint8_t* type, WIRE_reader* r){
+
+    ssize_t got;
+    int res;
+
+    wire_buf_compact(b);
+
+    while ((res = wire_next_frame(b,type,r)) == 0){
+
+        got = read(fd,wire_buf_reserve(b,65536),65536);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+
+        b->len += got;
+    }
+
+    return res == 1;
+}
+
+#endif
+
+/**
+ * HELLO: the public part of an instance and the pipeline depth of the prover
+ */
+void wire_put_hello(WIRE_buf* b, const KSS_instance* inst, int depth){
+
+    size_t start = wire_begin(b,WIRE_HELLO);
+    int width = BN_num_bytes(inst->M);
+
+    wire_put_u32(b,inst->n);
+    wire_put_u32(b,width);
+    wire_put_bn(b,inst->M,width);
+    wire_put_bn(b,inst->S,width);
+    wire_put_u8(b,(uint8_t) depth);
+
+    for(int i=0; i<inst->n;++i)
+        wire_put_bn(b,inst->a[i],width);
+
+    wire_end(b,start);
+}
+
+/**
+ * Parses a HELLO into an instance with no solution
+ * @param max_bytes: Largest accepted size of M
+ * @return NULL if the message is malformed
+ */
+KSS_instance* wire_get_hello(WIRE_reader* r, int max_bytes, int* depth){
+
+    KSS_instance* inst;
+    int n = (int) wire_get_u32(r);
+    int width = (int) wire_get_u32(r);
+
+    if (!r->ok || n < 1 || n > ZKP_MAX_N || width < 1 || width > max_bytes || r->left < (size_t) (n+2)*width+1)
+        return NULL;
+
+    inst = (KSS_instance*) malloc(sizeof(KSS_instance));
+    inst->n = n;
+    inst->k = 0;
+    inst->solution = NULL;
+    inst->words = 0;
+    inst->packed = NULL;
+    inst->M = wire_get_bn(r,width,BN_new());
+    inst->S = wire_get_bn(r,width,BN_new());
+    *depth = wire_get_u8(r);
+    inst->a = (BIGNUM**) malloc(sizeof(BIGNUM*)*n);
+
+    for(int i=0; i<n;++i)
+        inst->a[i] = wire_get_bn(r,width,BN_new());
+
+    return inst;
+}
+
+void wire_instance_free(KSS_instance* inst){
+
+    for(int i=0; i<inst->n;++i)
+        BN_free(inst->a[i]);
+
+    free(inst->a);
+    BN_free(inst->M);
+    BN_free(inst->S);
+    free(inst);
+}
+
+/**
+ * COMMITS: the c values of both commitment vectors
+ */
+void wire_put_commits(WIRE_buf* b, const PED_commit_vector* c1, const PED_commit_vector* c2){
+
+    size_t start = wire_begin(b,WIRE_COMMITS);
+    size_t bytes = (size_t) c1->count*c1->words*8;
+
+    wire_put_u32(b,c1->count);
+    wire_put_u32(b,c1->words);
+    wire_put_bytes(b,c1->c,bytes);
+    wire_put_bytes(b,c2->c,bytes);
+
+    wire_end(b,start);
+}
+
+/**
+ * Reads the c values of a COMMITS into two vectors of the expected shape
+ */
+bool wire_get_commits(WIRE_reader* r, PED_commit_vector* c1, PED_commit_vector* c2){
+
+    size_t bytes = (size_t) c1->count*c1->words*8;
+    const unsigned char* p;
+
+    if (wire_get_u32(r) != (uint32_t) c1->count || wire_get_u32(r) != (uint32_t) c1->words)
+        return false;
+
+    if ((p = wire_get_bytes(r,bytes)) == NULL)
+        return false;
+    memcpy(c1->c,p,bytes);
+
+    if ((p = wire_get_bytes(r,bytes)) == NULL)
+        return false;
+    memcpy(c2->c,p,bytes);
+
+    return true;
+}
+
+/**
+ * RESPONSE: opened values and randomnesses, permuted solution and sum
+ * @param width: Size of the padded values, kss_padded_width
+ */
+void wire_put_response(WIRE_buf* b, const PED_commit_vector* com, const BN_view* opened, int width, const BIT_solution* sol, const BIGNUM* sum){
+
+    size_t start = wire_begin(b,WIRE_RESPONSE);
+
+    wire_put_u32(b,com->count);
+
+    for(int i=0; i<opened->len;++i)
+        wire_put_bn(b,view_get(opened,i),width);
+
+    wire_put_bytes(b,com->s,(size_t) com->count*com->words*8);
+
+    for(int j=0; j<sol->words;++j){
+        for(int k=0; k<8;++k) wire_put_u8(b,(uint8_t) (sol->w[j] >> (8*k)));
+    }
+
+    wire_put_bn(b,sum,com->words*8);
+
+    wire_end(b,start);
+}
+
+/**
+ * Reads a RESPONSE into buffers of the expected shape
+ * @param com: Receives the randomnesses of the opened vector
+ * @param values: Receives the com->count opened values
+ * @param width: Size of the padded values, kss_padded_width
+ */
+bool wire_get_response(WIRE_reader* r, PED_commit_vector* com, BIGNUM** values, int width, BIT_solution* sol, BIGNUM* sum){
+
+    size_t bytes = (size_t) com->count*com->words*8;
+    const unsigned char* p;
+
+    if (wire_get_u32(r) != (uint32_t) com->count || sol->n != com->count)
+        return false;
+
+    for(int i=0; i<com->count;++i)
+        wire_get_bn(r,width,values[i]);
+
+    if ((p = wire_get_bytes(r,bytes)) == NULL)
+        return false;
+    memcpy(com->s,p,bytes);
+
+    for(int j=0; j<sol->words;++j){
+
+        sol->w[j] = 0;
+
+        if ((p = wire_get_bytes(r,8)) == NULL)
+            return false;
+
+        for(int k=7; k>=0;--k) sol->w[j] = (sol->w[j] << 8) | p[k];
+    }
+
+    // No bit past the last element
+    if (sol->n % 64 != 0 && (sol->w[sol->words-1] >> (sol->n % 64)) != 0)
+        return false;
+
+    wire_get_bn(r,com->words*8,sum);
+
+    return r->ok && r->left == 0;
+}
+
+#endif
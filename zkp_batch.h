@@ -0,0 +1,456 @@
+#ifndef ZKP_BATCH_H
+#define ZKP_BATCH_H
+
+#include <openssl/bn.h>
+#include <openssl/rand.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "commit_vector.h"
+#include "pedersen.h"
+#include "zkp_session.h"
+#include "zkp_trace.h"
+
+/*
+Batch verification of many proofs against the same Pedersen parameters.
+
+Each proof brings one opening equation per opened commitment, c = g^m h^s,
+and its final one, C = g^S h^sum with C the homomorphic sum of the closed
+commitments. The batch raises each of the N equations to a random 64-bit
+r and checks their product at once:
+
+    prod c^r = g^(sum r*m) h^(sum r*s)
+
+The right side is two exponentiations for the whole batch. The left side
+is a multi-exponentiation with short exponents, computed bucket-wise
+(Pippenger): for a window of w bits of the r, each base goes to the bucket
+of its digit, one multiplication, and the buckets are merged into the
+product B_t of the bases whose r has bit t set. The left side is then
+prod B_t^(2^t), 63 squarings. The window minimizes (64/w)*(N + w*2^(w-1)),
+so small batches get narrow windows and large ones wide windows.
+
+The group has order p-1 = 2q and g, h generate all of it, so an equation
+can be off by -1 = g^q, which a random exponent misses with probability
+1/2. The Legendre symbol of each B_t settles it: it must be the product of
+the symbols of the g^m h^s it multiplies, known from the parities of m and
+s. 64 symbols per batch, one per bit, miss a wrong sign with probability
+2^-64, as the product check misses any other error.
+
+When the batch fails, every proof of it is verified on its own, so a bad
+proof does not reject the others.
+*/
+
+#define ZKP_BATCH_BITS 64
+#define ZKP_BATCH_MAX_WINDOW 16
+
+typedef enum zkp_batch_status
+{
+    ZKP_BATCH_PENDING = 0,
+    ZKP_BATCH_ACCEPTED,
+    ZKP_BATCH_REJECTED
+} ZKP_batch_status;
+
+/*
+A proof in the batch. The opened vector and values belong to the caller
+and must stay valid until batch_verify.
+*/
+typedef struct zkp_batch_proof
+{
+    /* data */
+    PED_commit_vector* com;
+    BN_view* opened;
+    BIGNUM* product;        // Homomorphic sum of the closed commitments
+    BIGNUM* sum;
+    BIGNUM* target;
+    ZKP_batch_status status;
+} ZKP_batch_proof;
+
+typedef struct zkp_batch
+{
+    /* data */
+    PED_params* params;
+    BN_CTX* ctx;
+    BN_MONT_CTX* mont;
+    BIGNUM* order;
+    bool g_odd;             // Whether g, h are non-residues: their symbol then
+    bool h_odd;             // follows the parity of the exponent
+    ZKP_batch_proof* proofs;
+    int count;
+    int capacity;
+    int accepted;
+} ZKP_batch;
+
+/**
+ * Creates an empty batch
+ * @param params: Pedersen parameters of every proof of the batch
+ * @param capacity: Largest number of proofs
+ */
+ZKP_batch* batch_new(PED_params* params, int capacity){
+
+    ZKP_batch* b = (ZKP_batch*) malloc(sizeof(ZKP_batch));
+
+    b->params = params;
+    b->ctx = BN_CTX_new();
+    b->mont = BN_MONT_CTX_new();
+    BN_MONT_CTX_set(b->mont,params->p,b->ctx);
+    b->order = BN_dup(params->p);
+    BN_sub_word(b->order,1);
+    b->g_odd = BN_kronecker(params->g,params->p,b->ctx) == -1;
+    b->h_odd = BN_kronecker(params->h,params->p,b->ctx) == -1;
+    b->proofs = (ZKP_batch_proof*) calloc(capacity,sizeof(ZKP_batch_proof));
+    b->count = 0;
+    b->capacity = capacity;
+    b->accepted = 0;
+
+    for(int i=0; i<capacity;++i){
+        b->proofs[i].product = BN_new();
+        b->proofs[i].sum = BN_new();
+        b->proofs[i].target = BN_new();
+    }
+
+    return b;
+}
+
+/**
+ * Fourth to last step of a proof, deferred to the batch. The checks that do
+ * not exponentiate, the sizes, the multiset of the opened values and the
+ * homomorphic sum, are done now.
+ * @param V: Verifier session of the proof
+ * @param com: The opened commitments
+ * @param opened: The opened values
+ * @param closed: The other commitments
+ * @param solution: The permuted solution
+ * @param sum: The opening of the homomorphic sum
+ * @return false if the proof is already rejected or the batch is full
+ */
+bool VERIFIER_batch_add(ZKP_batch* b, VERIFIER_data* V, PED_commit_vector* com, BN_view* opened, PED_commit_vector* closed, const BIT_solution* solution, BIGNUM* sum){
+
+    ZKP_batch_proof* pr;
+
+    if (b->count == b->capacity || V->params != b->params)
+        return false;
+
+    pr = &b->proofs[b->count++];
+    pr->com = com;
+    pr->opened = opened;
+    pr->status = ZKP_BATCH_REJECTED;
+
+    if (com->count != V->len || opened->len != V->len)
+        return false;
+
+    if (!VERIFIER_check_multiset(opened,V->mset_key,&V->padded_digest,V->len))
+        return false;
+
+    if (VERIFIER_homomorphic_sum_round(V,closed,solution) == NULL)
+        return false;
+
+    BN_copy(pr->product,V->commitment_to_sum);
+    BN_copy(pr->sum,sum);
+    BN_copy(pr->target,V->target);
+    pr->status = ZKP_BATCH_PENDING;
+
+    return true;
+}
+
+/**
+ * Width of the windows for n bases, of the fewest multiplications
+ */
+int batch_window(long n){
+
+    int best = 1;
+    double cost, best_cost = 0;
+
+    for(int w=1; w<=ZKP_BATCH_MAX_WINDOW;++w){
+
+        cost = (double) ((ZKP_BATCH_BITS+w-1)/w) * ((double) n + (double) w*(1 << (w-1)));
+
+        if (w == 1 || cost < best_cost){
+            best = w;
+            best_cost = cost;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * acc = acc*x in Montgomery form, acc being empty (one) until its first factor
+ */
+void batch_mul_into(BIGNUM* acc, bool* set, const BIGNUM* x, ZKP_batch* b){
+
+    if (*set)
+        BN_mod_mul_montgomery(acc,acc,x,b->mont,b->ctx);
+    else{
+        BN_copy(acc,x);
+        *set = true;
+    }
+}
+
+/**
+ * Checks every pending proof of the batch with one randomized equation
+ * @return false if at least one of them is wrong
+ */
+bool batch_check(ZKP_batch* b){
+
+    PED_params* params = b->params;
+    BN_CTX* ctx = b->ctx;
+    long n = 0, e = 0;
+    int w, nbuckets, nmul = 0;
+    bool res, set[ZKP_BATCH_BITS], odd[ZKP_BATCH_BITS];
+    bool* bset;
+    uint64_t* r;
+    BIGNUM** x;
+    BIGNUM** bucket;
+    BIGNUM* bit[ZKP_BATCH_BITS];
+    BIGNUM *A, *B, *rb, *t, *lhs, *rhs, *m, *s;
+    ZKP_batch_proof* pr;
+
+    for(int j=0; j<b->count;++j){
+        if (b->proofs[j].status == ZKP_BATCH_PENDING)
+            n += b->proofs[j].com->count + 1;
+    }
+
+    if (n == 0)
+        return true;
+
+    ZKP_SPAN_BEGIN(span,"verifier.batch");
+
+    w = batch_window(n);
+    nbuckets = 1 << w;
+    r = (uint64_t*) malloc(sizeof(uint64_t)*n);
+    x = (BIGNUM**) malloc(sizeof(BIGNUM*)*(n+nbuckets));
+    bucket = x + n;
+    bset = (bool*) malloc(sizeof(bool)*nbuckets);
+
+    RAND_bytes((unsigned char*) r,(int) (sizeof(uint64_t)*n));
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,sizeof(uint64_t)*n);
+
+    BN_CTX_start(ctx);
+
+    A = BN_CTX_get(ctx);
+    B = BN_CTX_get(ctx);
+    rb = BN_CTX_get(ctx);
+    t = BN_CTX_get(ctx);
+    m = BN_CTX_get(ctx);
+    s = BN_CTX_get(ctx);
+    lhs = BN_CTX_get(ctx);
+    rhs = BN_CTX_get(ctx);
+
+    for(int i=0; i<ZKP_BATCH_BITS;++i){
+        bit[i] = BN_CTX_get(ctx);
+        set[i] = false;
+        odd[i] = false;
+    }
+
+    BN_zero(A);
+    BN_zero(B);
+    res = true;
+
+    // The bases in Montgomery form, the exponents of the right side and the
+    // expected symbols
+    for(int j=0; j<b->count && res;++j){
+
+        pr = &b->proofs[j];
+
+        if (pr->status != ZKP_BATCH_PENDING)
+            continue;
+
+        for(int i=0; i<=pr->com->count;++i,++e){
+
+            x[e] = BN_new();
+
+            if (i < pr->com->count){
+                commit_vector_get_c(pr->com,i,x[e]);
+                BN_copy(m,view_get(pr->opened,i));
+                commit_vector_get_s(pr->com,i,s);
+            }
+            else{
+                BN_copy(x[e],pr->product);
+                BN_copy(m,pr->target);
+                BN_copy(s,pr->sum);
+            }
+
+            // The single check compares c with a reduced value and takes
+            // non-negative exponents
+            if (BN_is_zero(x[e]) || BN_cmp(x[e],params->p) >= 0 || BN_is_negative(m) || BN_is_negative(s)){
+                res = false;
+                ++e;
+                break;
+            }
+
+            BN_to_montgomery(x[e],x[e],b->mont,ctx);
+
+            BN_lebin2bn((const unsigned char*) &r[e],sizeof(uint64_t),rb);
+            BN_mul(t,m,rb,ctx);
+            BN_add(A,A,t);
+            BN_mul(t,s,rb,ctx);
+            BN_add(B,B,t);
+
+            // Symbol of g^m h^s, -1 iff the sum of the odd exponents is odd
+            if (((b->g_odd && BN_is_odd(m)) ^ (b->h_odd && BN_is_odd(s))) != 0){
+                for(int k=0; k<ZKP_BATCH_BITS;++k)
+                    odd[k] ^= (r[e] >> k) & 1;
+            }
+        }
+    }
+
+    BN_clear(s);
+
+    if (res){
+
+        for(int d=0; d<nbuckets;++d)
+            bucket[d] = BN_CTX_get(ctx);
+
+        // Windows of w bits of the exponents
+        for(int lo=0; lo<ZKP_BATCH_BITS;lo+=w){
+
+            memset(bset,0,sizeof(bool)*nbuckets);
+
+            for(long i=0; i<n;++i){
+
+                int d = (int) ((r[i] >> lo) & (uint64_t) (nbuckets-1));
+
+                if (d != 0){
+                    batch_mul_into(bucket[d],&bset[d],x[i],b);
+                    nmul++;
+                }
+            }
+
+            // B_t, the product of the buckets whose digit has bit t set
+            for(int k=0; k<w && lo+k<ZKP_BATCH_BITS;++k){
+                for(int d=1; d<nbuckets;++d){
+                    if (((d >> k) & 1) && bset[d]){
+                        batch_mul_into(bit[lo+k],&set[lo+k],bucket[d],b);
+                        nmul++;
+                    }
+                }
+            }
+        }
+
+        // prod B_t^(2^t), from the top bit down
+        BN_to_montgomery(lhs,BN_value_one(),b->mont,ctx);
+
+        for(int k=ZKP_BATCH_BITS-1; k>=0;--k){
+
+            BN_mod_mul_montgomery(lhs,lhs,lhs,b->mont,ctx);
+
+            if (set[k])
+                BN_mod_mul_montgomery(lhs,lhs,bit[k],b->mont,ctx);
+        }
+
+        BN_from_montgomery(lhs,lhs,b->mont,ctx);
+        nmul += 2*ZKP_BATCH_BITS;
+
+        // g^A h^B, exponents modulo the group order. Both come from the
+        // openings and the verifier's coefficients, they are public
+        BN_nnmod(A,A,b->order,ctx);
+        BN_nnmod(B,B,b->order,ctx);
+
+        pedersen_exp(rhs,params->g,A,PED_PUBLIC,NULL,params,ctx);
+        pedersen_exp(t,params->h,B,PED_PUBLIC,params->h_table,params,ctx);
+
+        pedersen_mod_mul(rhs,rhs,t,params,ctx);
+
+        ZKP_COUNT(ZKP_CNT_MODEXP,2);
+
+        res = BN_cmp(lhs,rhs) == 0;
+
+        // The signs, one symbol per bit of the exponents
+        for(int k=0; k<ZKP_BATCH_BITS && res;++k){
+
+            if (!set[k]){
+                res = !odd[k];
+                continue;
+            }
+
+            BN_from_montgomery(t,bit[k],b->mont,ctx);
+            res = BN_kronecker(t,params->p,ctx) == (odd[k] ? -1 : 1);
+        }
+    }
+
+    ZKP_COUNT(ZKP_CNT_MODMUL,nmul);
+
+    BN_clear(A);
+    BN_clear(B);
+    BN_CTX_end(ctx);
+
+    for(long i=0; i<e;++i)
+        BN_free(x[i]);
+
+    free(x);
+    free(r);
+    free(bset);
+
+    ZKP_SPAN_END(span);
+
+    return res;
+}
+
+/**
+ * Verifies the pending proofs: all of them at once, and each on its own
+ * if the batch fails
+ * @return Number of accepted proofs of the batch
+ */
+int batch_verify(ZKP_batch* b){
+
+    PED_params* params = b->params;
+    ZKP_batch_proof* pr;
+    bool ok;
+
+    if (batch_check(b)){
+        for(int j=0; j<b->count;++j){
+            if (b->proofs[j].status == ZKP_BATCH_PENDING){
+                b->proofs[j].status = ZKP_BATCH_ACCEPTED;
+                b->accepted++;
+            }
+        }
+
+        return b->accepted;
+    }
+
+    for(int j=0; j<b->count;++j){
+
+        pr = &b->proofs[j];
+
+        if (pr->status != ZKP_BATCH_PENDING)
+            continue;
+
+        ok = PROVER_opens(pr->com,pr->opened,params,b->ctx)
+            && pedersen_unveil_params(pr->product,pr->sum,pr->target,params,b->ctx);
+
+        pr->status = ok ? ZKP_BATCH_ACCEPTED : ZKP_BATCH_REJECTED;
+        b->accepted += ok;
+    }
+
+    return b->accepted;
+}
+
+/**
+ * Empties the batch for the next proofs
+ */
+void batch_reset(ZKP_batch* b){
+
+    for(int j=0; j<b->count;++j)
+        BN_clear(b->proofs[j].sum);
+
+    b->count = 0;
+    b->accepted = 0;
+}
+
+void batch_free(ZKP_batch* b){
+
+    for(int i=0; i<b->capacity;++i){
+        BN_free(b->proofs[i].product);
+        BN_clear_free(b->proofs[i].sum);
+        BN_free(b->proofs[i].target);
+    }
+
+    free(b->proofs);
+    BN_free(b->order);
+    BN_MONT_CTX_free(b->mont);
+    BN_CTX_free(b->ctx);
+    free(b);
+}
+
+#endif
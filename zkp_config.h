@@ -0,0 +1,165 @@
+#ifndef ZKP_CONFIG_H
+#define ZKP_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Defaults used when a size is not given at runtime
+#define ZKP_DEFAULT_N 256
+#define ZKP_DEFAULT_K 16
+#define ZKP_DEFAULT_BITS 2048
+
+// Largest short instance modulus, stored as native words
+#define ZKP_MAX_SHORT_BITS 128
+
+// Permutations are arrays of unsigned short over the 2(n+bits) padded
+// elements, bits = ceil(log2 n) <= 15 carry entries: n+15 <= 32767
+#define ZKP_MAX_N 32752
+
+// Rounds whose commitments may be in flight before their challenge
+#define ZKP_DEFAULT_DEPTH 1
+#define ZKP_MAX_DEPTH 16
+
+// Worker processes of the sharded mode, 0 for a single process
+#define ZKP_DEFAULT_SHARDS 0
+#define ZKP_MAX_SHARDS 64
+
+// Soundness target in bits, and widest round of the multi-challenge mode
+#define ZKP_DEFAULT_SOUNDNESS 80
+#define ZKP_MAX_SOUNDNESS 256
+#define ZKP_MAX_COPIES 16
+
+typedef enum zkp_backend
+{
+    ZKP_BACKEND_PEDERSEN = 0
+} ZKP_backend;
+
+// What the prover sends in the first step
+typedef enum zkp_transcript
+{
+    ZKP_TRANSCRIPT_FULL = 0,    // Both commitment vectors
+    ZKP_TRANSCRIPT_MERKLE = 1   // Only their Merkle roots
+} ZKP_transcript;
+
+/*
+Runtime description of a proof session: instance size, solution weight,
+size of the commitment modulus, size of the instance modulus (0 for the
+group order p-1), commitment backend, transcript mode, pipeline depth,
+number of worker processes and soundness target.
+*/
+typedef struct zkp_config
+{
+    /* data */
+    int n;
+    int k;
+    int bits;
+    int mbits;
+    int depth;
+    int shards;
+    int soundness;
+    ZKP_backend backend;
+    ZKP_transcript transcript;
+} ZKP_config;
+
+/**
+ * Fills a configuration, returns false if the sizes are not supported
+ * @param cfg: Configuration to fill
+ * @param n: Number of elements of the instance
+ * @param k: Number of elements in the solution
+ * @param bits: Size in bits of the commitment modulus
+ */
+bool zkp_config_init(ZKP_config* cfg, int n, int k, int bits){
+
+    cfg->n = n;
+    cfg->k = k;
+    cfg->bits = bits;
+    cfg->mbits = 0;
+    cfg->depth = ZKP_DEFAULT_DEPTH;
+    cfg->shards = ZKP_DEFAULT_SHARDS;
+    cfg->soundness = ZKP_DEFAULT_SOUNDNESS;
+    cfg->backend = ZKP_BACKEND_PEDERSEN;
+    cfg->transcript = ZKP_TRANSCRIPT_FULL;
+
+    if (n < 1 || n > ZKP_MAX_N){
+        printf("Unsupported instance size %d (max %d).\n",n,ZKP_MAX_N);
+        return false;
+    }
+
+    if (k < 1 || k > n){
+        printf("Solution weight %d must be between 1 and n=%d.\n",k,n);
+        return false;
+    }
+
+    if (bits < 512 || bits % 64 != 0){
+        printf("Unsupported modulus size %d. Use a multiple of 64, at least 512.\n",bits);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Reads the configuration from the command line:
+ * [n] [k] [bits] [full|merkle] [mbits] [depth] [shards] [soundness].
+ * Missing arguments take the default values.
+ */
+bool zkp_config_from_args(ZKP_config* cfg, int argc, char** argv){
+
+    int n = argc > 1 ? atoi(argv[1]) : ZKP_DEFAULT_N;
+    int k = argc > 2 ? atoi(argv[2]) : ZKP_DEFAULT_K;
+    int bits = argc > 3 ? atoi(argv[3]) : ZKP_DEFAULT_BITS;
+
+    if (!zkp_config_init(cfg,n,k,bits))
+        return false;
+
+    if (argc > 4){
+        if (strcmp(argv[4],"merkle") == 0)
+            cfg->transcript = ZKP_TRANSCRIPT_MERKLE;
+        else if (strcmp(argv[4],"full") != 0){
+            printf("Unknown transcript mode %s.\n",argv[4]);
+            return false;
+        }
+    }
+
+    if (argc > 5){
+        cfg->mbits = atoi(argv[5]);
+
+        if (cfg->mbits != 0 && (cfg->mbits < 8 || cfg->mbits > ZKP_MAX_SHORT_BITS)){
+            printf("Unsupported instance modulus size %d. Use 0 for p-1, or 8 to %d bits.\n",cfg->mbits,ZKP_MAX_SHORT_BITS);
+            return false;
+        }
+    }
+
+    if (argc > 6){
+        cfg->depth = atoi(argv[6]);
+
+        if (cfg->depth < 1 || cfg->depth > ZKP_MAX_DEPTH){
+            printf("Unsupported pipeline depth %d (1 to %d).\n",cfg->depth,ZKP_MAX_DEPTH);
+            return false;
+        }
+    }
+
+    if (argc > 7){
+        cfg->shards = atoi(argv[7]);
+
+        if (cfg->shards < 0 || cfg->shards > ZKP_MAX_SHARDS){
+            printf("Unsupported number of shards %d (0 to %d).\n",cfg->shards,ZKP_MAX_SHARDS);
+            return false;
+        }
+    }
+
+    if (argc > 8){
+        cfg->soundness = atoi(argv[8]);
+
+        if (cfg->soundness < 1 || cfg->soundness > ZKP_MAX_SOUNDNESS){
+            printf("Unsupported soundness target %d (1 to %d bits).\n",cfg->soundness,ZKP_MAX_SOUNDNESS);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,527 @@
+#ifndef ZKP_ENGINE_H
+#define ZKP_ENGINE_H
+
+#include <openssl/bn.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "wire.h"
+#include "zkp_config.h"
+#include "zkp_session.h"
+#include "zkp_trace.h"
+
+/*
+Resumable prover and verifier state machines for the variable-size protocol.
+
+A machine never blocks and never exits: each call to its step function
+consumes at most one received frame, appends the frames to send to out, and
+returns. ZKP_STEP_RECV means the frames in out must be sent and the next
+frame of the peer delivered to the following step; DONE and FAIL are final,
+with the cause of a failure in the error field. The caller owns the I/O, so
+one thread can interleave any number of sessions and run the computation of
+one while another waits for its peer.
+
+The prover starts by a step with no frame (type 0, in NULL), which sends
+HELLO. The verifier only reacts to frames, and answers a protocol error with
+an ERROR frame before failing.
+
+Rounds are pipelined over depth slots. The prover commits to the next round
+as soon as a slot is free, without waiting for the challenges in flight:
+ZKP_STEP_MORE means the frames in out must be sent, then the step called
+again with no frame to compute the next commitments. These are computed
+while the peer handles the frames just sent, so on a slow link the commit
+time of a round hides behind the round trip of the previous ones. A slot is
+free again once its response is sent. The verifier keeps the commitments of
+depth rounds and checks the oldest one while the next ones arrive. Each
+challenge is still drawn after the commitments of its round are received.
+*/
+
+typedef enum zkp_step
+{
+    ZKP_STEP_RECV = 0,
+    ZKP_STEP_MORE,
+    ZKP_STEP_DONE,
+    ZKP_STEP_FAIL
+} ZKP_step;
+
+typedef enum zkp_error
+{
+    ZKP_OK = 0,
+    ZKP_ERR_MALFORMED,      // A frame could not be parsed
+    ZKP_ERR_UNEXPECTED,     // A frame of the wrong type for the state
+    ZKP_ERR_PEER,           // The peer sent ERROR
+    ZKP_ERR_INSTANCE        // The instance or the depth is invalid
+} ZKP_error;
+
+typedef enum prover_state
+{
+    PROVER_HELLO = 0,
+    PROVER_WAIT_READY,
+    PROVER_RUNNING,
+    PROVER_FINISHED
+} PROVER_state;
+
+typedef enum verifier_state
+{
+    VERIFIER_WAIT_HELLO = 0,
+    VERIFIER_RUNNING,
+    VERIFIER_FAILED
+} VERIFIER_state;
+
+typedef struct prover_machine
+{
+    /* data */
+    PROVER_state state;
+    PROVER_data* slot[ZKP_MAX_DEPTH];
+    int depth;
+    ZKP_error error;
+
+    int rounds;
+    int committed;      // Rounds whose commitments are sent
+    int answered;       // Rounds whose response is sent
+    int round;          // Rounds whose result is received
+    int accepted;
+} PROVER_machine;
+
+// Commitments of a round whose response has not been checked yet
+typedef struct verifier_slot
+{
+    /* data */
+    PED_commit_vector* com[2];
+    int index;
+} VERIFIER_slot;
+
+typedef struct verifier_machine
+{
+    /* data */
+    VERIFIER_state state;
+    PED_params* params;
+    ZKP_error error;
+
+    // Set up by HELLO
+    KSS_instance* instance;
+    VERIFIER_data* V;
+    ZKP_arena* arena;
+    VERIFIER_slot slot[ZKP_MAX_DEPTH];
+    int depth;
+    BIGNUM** values;
+    BN_view opened;
+    BIT_solution* solution;
+    BIGNUM* sum;
+    int width;
+
+    int committed;      // Rounds whose commitments are received
+    int rounds;         // Rounds checked
+    int accepted;
+    int last;           // Result of the last round, -1 before the first
+} VERIFIER_machine;
+
+const char* zkp_error_string(ZKP_error e){
+
+    switch (e){
+        case ZKP_OK: return "no error";
+        case ZKP_ERR_MALFORMED: return "malformed frame";
+        case ZKP_ERR_UNEXPECTED: return "unexpected frame";
+        case ZKP_ERR_PEER: return "the peer reported an error";
+        case ZKP_ERR_INSTANCE: return "invalid instance";
+    }
+
+    return "unknown error";
+}
+
+/**
+ * Prepares a prover machine
+ * @param P: Prover session of the statement, the first slot
+ * @param rounds: Number of rounds to run
+ * @param depth: Rounds in flight, the other slots are sessions of the same
+ * statement created here
+ */
+void PROVER_machine_init(PROVER_machine* m, PROVER_data* P, int rounds, int depth){
+
+    m->state = PROVER_HELLO;
+    m->depth = depth < 1 ? 1 : depth > ZKP_MAX_DEPTH ? ZKP_MAX_DEPTH : depth;
+    m->error = ZKP_OK;
+    m->rounds = rounds;
+
+    // No use for more slots than rounds
+    if (rounds > 0 && m->depth > rounds)
+        m->depth = rounds;
+
+    m->committed = 0;
+    m->answered = 0;
+    m->round = 0;
+    m->accepted = 0;
+
+    m->slot[0] = P;
+
+    for(int i=1; i<m->depth;++i)
+        m->slot[i] = PROVER_new(P->params,P->instance,P->coupons);
+}
+
+// The first slot belongs to the caller
+void PROVER_machine_free(PROVER_machine* m){
+
+    for(int i=1; i<m->depth;++i)
+        PROVER_free(m->slot[i]);
+}
+
+ZKP_step PROVER_machine_fail(PROVER_machine* m, ZKP_error e){
+    m->error = e;
+    m->state = PROVER_FINISHED;
+    return ZKP_STEP_FAIL;
+}
+
+// Whether a slot is free for the commitments of another round
+bool PROVER_machine_can_commit(PROVER_machine* m){
+    return m->committed < m->rounds && m->committed - m->answered < m->depth;
+}
+
+/**
+ * Commits to both permuted instances for the next round, in its slot
+ * @return MORE while other slots are free, else RECV
+ */
+ZKP_step PROVER_machine_commit(PROVER_machine* m, WIRE_buf* out){
+
+    PROVER_data* P = m->slot[m->committed % m->depth];
+
+    ZKP_SPAN_BEGIN(span,"prover.commit");
+
+    PROVER_precompute(P);
+    PROVER_round_commits(P);
+    wire_put_commits(out,P->commitment_1,P->commitment_2);
+
+    ZKP_SPAN_END(span);
+
+    m->committed++;
+
+    return PROVER_machine_can_commit(m) ? ZKP_STEP_MORE : ZKP_STEP_RECV;
+}
+
+/**
+ * Advances the prover on the frame received from the verifier
+ * @param type: Type of the frame, 0 for the first step and after MORE
+ * @param in: Its payload, NULL for the first step and after MORE
+ * @param out: Where to append the frames to send
+ */
+ZKP_step PROVER_machine_step(PROVER_machine* m, uint8_t type, WIRE_reader* in, WIRE_buf* out){
+
+    PROVER_data* P;
+    PED_commit_vector* com;
+    BN_view* opened;
+    BIT_solution* sol;
+    BIGNUM* sum;
+    int index, res;
+
+    if (m->state == PROVER_FINISHED)
+        return m->error == ZKP_OK ? ZKP_STEP_DONE : ZKP_STEP_FAIL;
+
+    if (m->state != PROVER_HELLO && type == WIRE_ERROR)
+        return PROVER_machine_fail(m,ZKP_ERR_PEER);
+
+    switch (m->state){
+
+        case PROVER_HELLO:
+            wire_put_hello(out,m->slot[0]->instance,m->depth);
+            m->state = PROVER_WAIT_READY;
+            return ZKP_STEP_RECV;
+
+        case PROVER_WAIT_READY:
+            if (type != WIRE_READY)
+                return PROVER_machine_fail(m,ZKP_ERR_UNEXPECTED);
+
+            m->state = PROVER_RUNNING;
+
+            if (m->rounds == 0){
+                m->state = PROVER_FINISHED;
+                return ZKP_STEP_DONE;
+            }
+
+            return PROVER_machine_commit(m,out);
+
+        case PROVER_RUNNING:
+            break;
+
+        default:
+            return PROVER_machine_fail(m,ZKP_ERR_UNEXPECTED);
+    }
+
+    switch (type){
+
+        case 0:
+            if (!PROVER_machine_can_commit(m))
+                return ZKP_STEP_RECV;
+
+            return PROVER_machine_commit(m,out);
+
+        case WIRE_CHALLENGE:
+            if (m->answered == m->committed)
+                return PROVER_machine_fail(m,ZKP_ERR_UNEXPECTED);
+
+            P = m->slot[m->answered % m->depth];
+            index = wire_get_u8(in);
+
+            if (!in->ok || (index != 0 && index != 1))
+                return PROVER_machine_fail(m,ZKP_ERR_MALFORMED);
+
+            ZKP_SPAN_BEGIN(response,"prover.response");
+
+            PROVER_opening(P,index,&com,&opened);
+            sol = PROVER_permuted_solution(P,index);
+            sum = PROVER_sum(P,index);
+            wire_put_response(out,com,opened,P->width,sol,sum);
+
+            ZKP_SPAN_END(response);
+
+            // The response is serialized, the slot can take another round
+            PROVER_reset(P);
+            m->answered++;
+
+            return PROVER_machine_can_commit(m) ? ZKP_STEP_MORE : ZKP_STEP_RECV;
+
+        case WIRE_RESULT:
+            if (m->round == m->answered)
+                return PROVER_machine_fail(m,ZKP_ERR_UNEXPECTED);
+
+            res = wire_get_u8(in);
+
+            if (!in->ok)
+                return PROVER_machine_fail(m,ZKP_ERR_MALFORMED);
+
+            m->accepted += res == 1;
+            m->round++;
+
+            if (m->round == m->rounds){
+                m->state = PROVER_FINISHED;
+                return ZKP_STEP_DONE;
+            }
+
+            return ZKP_STEP_RECV;
+
+        default:
+            return PROVER_machine_fail(m,ZKP_ERR_UNEXPECTED);
+    }
+}
+
+/**
+ * Prepares a verifier machine, waiting for the instance
+ * @param params: Pedersen parameters, precomputed tables included
+ */
+void VERIFIER_machine_init(VERIFIER_machine* m, PED_params* params){
+    memset(m,0,sizeof(VERIFIER_machine));
+    m->state = VERIFIER_WAIT_HELLO;
+    m->params = params;
+    m->error = ZKP_OK;
+    m->last = -1;
+}
+
+void VERIFIER_machine_free(VERIFIER_machine* m){
+
+    if (m->V != NULL){
+        arena_free(m->arena);
+        bitsol_free(m->solution);
+        BN_free(m->sum);
+
+        for(int i=0; i<m->V->len;++i)
+            BN_free(m->values[i]);
+
+        free(m->values);
+        VERIFIER_free(m->V);
+        m->V = NULL;
+    }
+
+    if (m->instance != NULL){
+        wire_instance_free(m->instance);
+        m->instance = NULL;
+    }
+}
+
+ZKP_step VERIFIER_machine_fail(VERIFIER_machine* m, ZKP_error e, WIRE_buf* out){
+
+    size_t start = wire_begin(out,WIRE_ERROR);
+
+    wire_end(out,start);
+
+    m->error = e;
+    m->state = VERIFIER_FAILED;
+
+    return ZKP_STEP_FAIL;
+}
+
+/**
+ * HELLO: sets up the verifier session for the instance sent by the prover
+ */
+ZKP_step VERIFIER_machine_hello(VERIFIER_machine* m, WIRE_reader* in, WIRE_buf* out){
+
+    PED_params* params = m->params;
+    int depth, len;
+    size_t start;
+
+    m->instance = wire_get_hello(in,BN_num_bytes(params->p),&depth);
+
+    if (m->instance == NULL)
+        return VERIFIER_machine_fail(m,ZKP_ERR_MALFORMED,out);
+
+    m->depth = depth < 1 ? 1 : depth > ZKP_MAX_DEPTH ? ZKP_MAX_DEPTH : depth;
+    m->V = VERIFIER_new(params,m->instance);
+    m->width = m->V->width;
+    len = m->V->len;
+
+    // The vectors of every slot live as long as the session, rewritten every round
+    m->arena = arena_new(m->depth*2*2*len*BN_num_bytes(params->p)+ARENA_DEFAULT_SIZE);
+
+    for(int i=0; i<m->depth;++i){
+        m->slot[i].com[0] = commit_vector_new(m->arena,len,params->p);
+        m->slot[i].com[1] = commit_vector_new(m->arena,len,params->p);
+    }
+
+    m->values = (BIGNUM**) malloc(sizeof(BIGNUM*)*len);
+
+    for(int i=0; i<len;++i)
+        m->values[i] = BN_new();
+
+    m->opened = view_init(m->values,len,NULL,len);
+    m->solution = bitsol_new(len);
+    m->sum = BN_new();
+
+    // Sums of selected values, below 2^(bits+1)*M, must not wrap around the group order
+    if (depth != m->depth || (m->V->carry_bits > 0 && BN_num_bits(m->instance->M)+m->V->carry_bits+1 >= BN_num_bits(params->p)))
+        return VERIFIER_machine_fail(m,ZKP_ERR_INSTANCE,out);
+
+    start = wire_begin(out,WIRE_READY);
+    wire_end(out,start);
+
+    m->state = VERIFIER_RUNNING;
+
+    return ZKP_STEP_RECV;
+}
+
+/**
+ * Advances the verifier on the frame received from the prover
+ * @param type: Type of the frame
+ * @param in: Its payload
+ * @param out: Where to append the frames to send
+ */
+ZKP_step VERIFIER_machine_step(VERIFIER_machine* m, uint8_t type, WIRE_reader* in, WIRE_buf* out){
+
+    VERIFIER_data* V = m->V;
+    VERIFIER_slot* slot;
+    size_t start;
+    bool ok;
+
+    if (m->state == VERIFIER_FAILED)
+        return ZKP_STEP_FAIL;
+
+    if (type == WIRE_ERROR)
+        return VERIFIER_machine_fail(m,ZKP_ERR_PEER,out);
+
+    if (m->state == VERIFIER_WAIT_HELLO){
+
+        if (type != WIRE_HELLO)
+            return VERIFIER_machine_fail(m,ZKP_ERR_UNEXPECTED,out);
+
+        return VERIFIER_machine_hello(m,in,out);
+    }
+
+    switch (type){
+
+        case WIRE_COMMITS:
+            // No more rounds in flight than the prover announced
+            if (m->committed - m->rounds == m->depth)
+                return VERIFIER_machine_fail(m,ZKP_ERR_UNEXPECTED,out);
+
+            slot = &m->slot[m->committed % m->depth];
+
+            if (!wire_get_commits(in,slot->com[0],slot->com[1]))
+                return VERIFIER_machine_fail(m,ZKP_ERR_MALFORMED,out);
+
+            slot->index = VERIFIER_challenge(V);
+            m->committed++;
+
+            start = wire_begin(out,WIRE_CHALLENGE);
+            wire_put_u8(out,(uint8_t) slot->index);
+            wire_end(out,start);
+
+            return ZKP_STEP_RECV;
+
+        case WIRE_RESPONSE:
+            if (m->rounds == m->committed)
+                return VERIFIER_machine_fail(m,ZKP_ERR_UNEXPECTED,out);
+
+            slot = &m->slot[m->rounds % m->depth];
+            V->index = slot->index;
+
+            if (!wire_get_response(in,slot->com[V->index],m->values,m->width,m->solution,m->sum))
+                return VERIFIER_machine_fail(m,ZKP_ERR_MALFORMED,out);
+
+            ZKP_SPAN_BEGIN(check,"verifier.check");
+
+            ok = VERIFIER_checks_opening(V,slot->com[V->index],&m->opened)
+                && VERIFIER_homomorphic_sum_round(V,slot->com[1-V->index],m->solution) != NULL
+                && VERIFIER_accepts(V,m->sum);
+
+            ZKP_SPAN_END(check);
+
+            m->rounds++;
+            m->accepted += ok;
+            m->last = ok;
+
+            start = wire_begin(out,WIRE_RESULT);
+            wire_put_u8(out,ok ? 1 : 0);
+            wire_end(out,start);
+
+            return ZKP_STEP_RECV;
+
+        default:
+            return VERIFIER_machine_fail(m,ZKP_ERR_UNEXPECTED,out);
+    }
+}
+
+/**
+ * Runs a prover and a verifier machine against each other in memory, until
+ * the prover is done or either fails
+ * @return ZKP_OK, or the error of the machine that failed
+ */
+ZKP_error zkp_run_local(PROVER_machine* pm, VERIFIER_machine* vm){
+
+    WIRE_buf to_verifier, to_prover;
+    WIRE_reader r;
+    uint8_t type;
+    ZKP_step ps, vs = ZKP_STEP_RECV;
+    ZKP_error res = ZKP_OK;
+
+    wire_buf_init(&to_verifier);
+    wire_buf_init(&to_prover);
+
+    ps = PROVER_machine_step(pm,0,NULL,&to_verifier);
+
+    while ((ps == ZKP_STEP_RECV || ps == ZKP_STEP_MORE) && vs == ZKP_STEP_RECV){
+
+        // Frames read by the prover are no longer referenced
+        wire_buf_compact(&to_prover);
+
+        while (vs == ZKP_STEP_RECV && wire_next_frame(&to_verifier,&type,&r) == 1)
+            vs = VERIFIER_machine_step(vm,type,&r,&to_prover);
+
+        to_verifier.len = to_verifier.pos = 0;
+
+        if (ps == ZKP_STEP_MORE)
+            ps = PROVER_machine_step(pm,0,NULL,&to_verifier);
+        else if (wire_next_frame(&to_prover,&type,&r) == 1)
+            ps = PROVER_machine_step(pm,type,&r,&to_verifier);
+        else
+            break;
+    }
+
+    if (vs == ZKP_STEP_FAIL)
+        res = vm->error;
+    else if (ps == ZKP_STEP_FAIL)
+        res = pm->error;
+    else if (ps != ZKP_STEP_DONE)
+        res = ZKP_ERR_UNEXPECTED;
+
+    wire_buf_free(&to_verifier);
+    wire_buf_free(&to_prover);
+
+    return res;
+}
+
+#endif
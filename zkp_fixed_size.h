@@ -3,9 +3,17 @@
 
 #include <openssl/bn.h>
 #include "pedersen.h"
-
-#define N_FIXED 256
-#define K 16
+#include "arena.h"
+#include "commit_vector.h"
+#include "coupon_pool.h"
+#include "pedersen_batch.h"
+#include "bitsol.h"
+#include "lazy_sum.h"
+#include "multiset_hash.h"
+#include "zkp_config.h"
+
+// Largest instance modulus, in 64-bit words, whose values are stored natively
+#define KSS_PACKED_MAX_WORDS 2
 
 typedef struct instance
 {
@@ -14,28 +22,34 @@ typedef struct instance
     BIGNUM* S;
     BIGNUM* M;
     char* solution;
+    int n;
+    int k;
+
+    // Short modulus: the values as words 64-bit words each, else NULL
+    int words;
+    uint64_t* packed;
 } KSS_instance;
 
 typedef unsigned short * permutation;
 
-typedef struct PROVER_data
-{
-    /* data */
-    char* p1;
-    char* p2;
-    PED_commitment** commitment_1;
-    PED_commitment** commitment_2;
-    KSS_instance* instance;
-} PROVER_data;
-
-typedef struct VERIFIER_data
+void Fisher_Yates_shuffle_perm(permutation* a, int n);
+
+/*
+Read-only view of an array of BIGNUM through an index map. The view does not
+own nor copy the elements. Positions mapped past the end of the base array
+read as zero, which is how an instance padded with zeros is represented.
+*/
+typedef struct bn_view
 {
     /* data */
-    PED_commitment** commitment_1;
-    PED_commitment** commitment_2;
-    KSS_instance* instance;
-} VERIFIER_data;
+    BIGNUM** base;
+    int base_len;
+    permutation index;
+    int len;
+} BN_view;
 
+// Shared zero returned for padding positions of a view
+BIGNUM* view_zero = NULL;
 
 /**
  * Creates an identity permutation on size elements
@@ -95,31 +109,135 @@ BIGNUM** permutation_apply(BIGNUM** array, permutation p, int size){
         BN_copy(new[i],array[new_index]);
     }
 
-    for(i=0;i<size;++i){
-        if ( BN_cmp(new[i],array[ p[i]]) != 0)
-            printf("Error in position %d\n",i);
+    return new;
+}
+
+/**
+ * Creates a view over an array of BIGNUM
+ * @param base: The array to look at
+ * @param base_len: Size of base
+ * @param index: Position i of the view reads base[index[i]]. NULL for the identity
+ * @param len: Size of the view. Positions from base_len on read as zero
+ */
+BN_view view_init(BIGNUM** base, int base_len, permutation index, int len){
+
+    BN_view v;
+
+    if (view_zero == NULL){
+        view_zero = BN_new();
+        BN_zero(view_zero);
     }
 
-    return new;
+    v.base = base;
+    v.base_len = base_len;
+    v.index = index;
+    v.len = len;
+
+    return v;
 }
 
 /**
- * Applies a given permutation on an array representing a solution
+ * Position of base read by the i-th element of a view, or -1 for padding
+ */
+int view_source(const BN_view* v, int i){
+
+    int j = v->index == NULL ? i : v->index[i];
+
+    return j < v->base_len ? j : -1;
+}
+
+/**
+ * Returns the i-th element of a view, without copying it
+ */
+BIGNUM* view_get(const BN_view* v, int i){
+
+    int j = view_source(v,i);
+
+    return j < 0 ? view_zero : v->base[j];
+}
+
+/**
+ * Writes the elements of a view to out, v->len pointers, without copying them
+ */
+BIGNUM** view_gather_into(const BN_view* v, BIGNUM** out){
+
+    for(int i=0; i<v->len;++i){
+        out[i] = view_get(v,i);
+    }
+
+    return out;
+}
+
+/**
+ * Returns the elements of a view as an array of pointers, without copying them
+ */
+BIGNUM** view_gather(const BN_view* v){
+    return view_gather_into(v,(BIGNUM**) malloc(sizeof(BIGNUM*)*v->len));
+}
+
+/**
+ * Permutes an identity view: position i of the result reads position p[i] of v
+ * @param v: A view with no index map
+ * @param p: The permutation to apply, of size v->len
+ */
+BN_view view_permute(const BN_view* v, permutation p){
+    return view_init(v->base,v->base_len,p,v->len);
+}
+
+/**
+ * Applies a given permutation on an array representing a solution, writing to out
+ * @param out: Destination, of size size
  * @param array: The array to permute
  * @param p: The permutation to apply
  * @param size: Size of array and p
  */
-char* permutation_apply_sol(char* array, permutation p, int size){
-    
+char* permutation_apply_sol_into(char* out, char* array, permutation p, int size){
+
     unsigned int i,new_index;
-    char* new = (char*) malloc(sizeof(char)*size);
 
     for(i=0;i<size;++i){
         new_index= p[i];
-        new[i]=array[new_index];
+        out[i]=array[new_index];
     }
 
-    return new;
+    return out;
+}
+
+/**
+ * Applies a given permutation on an array representing a solution
+ * @param array: The array to permute
+ * @param p: The permutation to apply
+ * @param size: Size of array and p
+ */
+char* permutation_apply_sol(char* array, permutation p, int size){
+    return permutation_apply_sol_into((char*) malloc(sizeof(char)*size),array,p,size);
+}
+
+/**
+ * Applies a given permutation on a bit-packed solution, writing to out:
+ * bit i of out is bit p[i] of sol, gathered 64 output bits at a time
+ * @param out: Destination, over as many elements as sol
+ * @param sol: The solution to permute
+ * @param p: The permutation to apply
+ */
+BIT_solution* permutation_apply_bitsol_into(BIT_solution* out, const BIT_solution* sol, permutation p){
+
+    uint64_t w;
+    int i, j, src;
+
+    for(j=0; j<out->words;++j){
+
+        w = 0;
+
+        for(i=0; i<64 && 64*j+i<out->n;++i){
+            src = p[64*j+i];
+            w |= ( (sol->w[src >> 6] >> (src & 63)) & 1 ) << i;
+        }
+
+        out->w[j] = w;
+    }
+
+    return out;
 }
 
 /**
@@ -158,6 +276,18 @@ void Fisher_Yates_shuffle_perm(permutation* a, int n){
     }
 }
 
+/**
+ * Overwrites an existing permutation with a fresh random one
+ */
+void permutation_randomize(permutation p, int size){
+
+    for(unsigned short i=0; i<size;++i){
+        p[i]=i;
+    }
+
+    Fisher_Yates_shuffle_perm(&p,size);
+}
+
 /**
  * Prints in binary form the solution to a yes-instance of the subset sum problem
  */
@@ -176,21 +306,179 @@ void print_solution(char* a, int n){
     putchar('\n');
 }
 
+/**
+ * Stores the values of an instance with a modulus of at most
+ * KSS_PACKED_MAX_WORDS words as native words. Larger ones stay unpacked.
+ */
+void kss_pack(KSS_instance* inst){
+
+    unsigned char buf[8*KSS_PACKED_MAX_WORDS];
+    int words = (BN_num_bits(inst->M)+63)/64;
+    uint64_t w;
+
+    inst->words = 0;
+    inst->packed = NULL;
+
+    if (words > KSS_PACKED_MAX_WORDS)
+        return;
+
+    inst->words = words;
+    inst->packed = (uint64_t*) malloc(sizeof(uint64_t)*words*inst->n);
+
+    for(int i=0; i<inst->n;++i){
+
+        BN_bn2lebinpad(inst->a[i],buf,8*words);
+
+        for(int j=0; j<words;++j){
+            w = 0;
+            for(int b=7; b>=0;--b) w = (w << 8) | buf[8*j+b];
+            inst->packed[i*words+j] = w;
+        }
+    }
+}
+
+/**
+ * Integer sum, not reduced, of the values of a packed instance selected by sel,
+ * accumulated on native words
+ * @param r: Where to store the sum
+ */
+BIGNUM* kss_sum_selected_packed(BIGNUM* r, const KSS_instance* inst, const char* sel){
+
+    // One more word than a value: n < 2^15 values cannot overflow it
+    uint64_t acc[KSS_PACKED_MAX_WORDS+1] = {0};
+    unsigned char buf[8*(KSS_PACKED_MAX_WORDS+1)];
+    const uint64_t* v;
+    uint64_t carry, t;
+    int j;
+
+    for(int i=0; i<inst->n;++i){
+
+        if (sel[i] != 1)
+            continue;
+
+        v = inst->packed + (size_t) i*inst->words;
+        carry = 0;
+
+        for(j=0; j<inst->words;++j){
+            t = acc[j] + carry;
+            carry = t < carry;
+            acc[j] = t + v[j];
+            carry += acc[j] < t;
+        }
+
+        for(; j<=KSS_PACKED_MAX_WORDS && carry;++j){
+            acc[j] += carry;
+            carry = acc[j] < carry;
+        }
+    }
+
+    for(j=0; j<=KSS_PACKED_MAX_WORDS;++j){
+        for(int b=0; b<8;++b) buf[8*j+b] = (unsigned char) (acc[j] >> (8*b));
+    }
+
+    return BN_lebin2bn(buf,sizeof(buf),r);
+}
+
+/**
+ * Number of times the selected values wrap around M: their integer sum is
+ * S + carry*M. Commitments add values over the integers, so with a modulus
+ * that does not divide the group order the prover makes up for carry*M with
+ * the carry entries of the padded instance. The carry depends on the
+ * solution, it is never sent.
+ * Always 0 when M is the group order p-1 or the instance is not packed.
+ */
+int kss_carry(const KSS_instance* inst, BN_CTX* ctx){
+
+    int carry;
+
+    if (inst->packed == NULL)
+        return 0;
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* sum = kss_sum_selected_packed(BN_CTX_get(ctx),inst,inst->solution);
+
+    BN_sub(sum,sum,inst->S);
+    BN_div(sum,NULL,sum,inst->M,ctx);
+    carry = (int) BN_get_word(sum);
+
+    BN_CTX_end(ctx);
+
+    return carry;
+}
+
+/**
+ * Number of bits of x
+ */
+int kss_bits(int x){
+
+    int bits = 0;
+
+    while (x >> bits)
+        bits++;
+
+    return bits;
+}
+
+/**
+ * Carry entries of the padded instance, the bits of the largest carry n-1.
+ * None when M is the group order p-1, its multiples vanish in the exponent.
+ * @param p: Modulus of the commitment group
+ */
+int kss_carry_bits(const KSS_instance* inst, const BIGNUM* p){
+
+    BIGNUM* order = BN_dup(p);
+    bool full;
+
+    BN_sub_word(order,1);
+    full = BN_cmp(inst->M,order) == 0;
+    BN_free(order);
+
+    return full ? 0 : kss_bits(inst->n-1);
+}
+
+/**
+ * Size of the values of the instance padded with bits carry entries, the
+ * largest being M*2^(bits-1)
+ */
+int kss_padded_width(const KSS_instance* inst, int bits){
+    return bits == 0 ? BN_num_bytes(inst->M) : (BN_num_bits(inst->M)+bits-1+7)/8;
+}
+
+/**
+ * What the selected values of the padded instance sum to: S + (2^bits-1)*M.
+ * The prover selects the carry entries of the bits of 2^bits-1-carry, so the
+ * target does not depend on the solution.
+ */
+BIGNUM* kss_padded_target(BIGNUM* r, const KSS_instance* inst, int bits, BN_CTX* ctx){
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* t = BN_CTX_get(ctx);
+
+    BN_set_word(t,((unsigned long) 1 << bits) - 1);
+    BN_mul(r,t,inst->M,ctx);
+    BN_add(r,r,inst->S);
+
+    BN_CTX_end(ctx);
+
+    return r;
+}
+
 /**
  * Generates a random yes-instance of the Size Modular Subset-Sum problem
  * @param M: The chosen modulo
  * @param ctx: OpenSSL context to use
+ * @param n: Number of elements of the instance
+ * @param k: Number of elements in the solution
  */
-KSS_instance* gen_instance(BIGNUM* M, BN_CTX* ctx, int n){
+KSS_instance* gen_instance_quiet(BIGNUM* M, BN_CTX* ctx, int n, int k){
 
     KSS_instance* inst = (KSS_instance*) malloc(sizeof(KSS_instance));
 
     BN_CTX_start(ctx);
 
-    puts("Generating yes instance of modular size subset sum...");
-
     BIGNUM** a = (BIGNUM**) malloc(sizeof(BIGNUM*)*n);
-    BIGNUM** solution = (BIGNUM**) malloc(sizeof(BIGNUM*)*K);
     char* select_solution = (char*) malloc(sizeof(char)*n);
 
     int i;
@@ -200,11 +488,13 @@ KSS_instance* gen_instance(BIGNUM* M, BN_CTX* ctx, int n){
         BN_rand_range(a[i],M);
     }
 
-    for(i=0;i<K;i++){
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,(uint64_t) n*BN_num_bytes(M));
+
+    for(i=0;i<k;i++){
         select_solution[i]=1;
     }
 
-    for(i=K;i<n;i++){
+    for(i=k;i<n;i++){
         select_solution[i]=0;
     }
 
@@ -222,27 +512,59 @@ KSS_instance* gen_instance(BIGNUM* M, BN_CTX* ctx, int n){
     inst->M=M;
     inst->S=S;
     inst->solution=select_solution;
+    inst->n=n;
+    inst->k=k;
+    kss_pack(inst);
 
     BN_CTX_end(ctx);
 
+    return inst;
+}
+
+/**
+ * gen_instance_quiet, printing the solution and the target
+ */
+KSS_instance* gen_instance(BIGNUM* M, BN_CTX* ctx, int n, int k){
+
+    KSS_instance* inst;
+
+    puts("Generating yes instance of modular size subset sum...");
+
+    inst = gen_instance_quiet(M,ctx,n,k);
+
     puts("Done");
     print_solution(inst->solution, n);
-    printf("Target: 0x%s\n",BN_bn2hex(S));
+    printf("Target: 0x%s\n",BN_bn2hex(inst->S));
 
     return inst;
 }
 
+/**
+ * Frees an instance from gen_instance, except M which belongs to the caller
+ */
+void kss_free(KSS_instance* inst){
+
+    for(int i=0; i<inst->n;++i)
+        BN_free(inst->a[i]);
+
+    free(inst->a);
+    BN_free(inst->S);
+    free(inst->solution);
+    free(inst->packed);
+    free(inst);
+}
+
 bool verify_solution(KSS_instance* inst, BN_CTX* ctx){
 
-    int i;
     BN_CTX_start(ctx);
     BIGNUM* sum=BN_new();
 
-    for(i=0;i<N_FIXED;++i){
-
-        if (inst->solution[i]==1)
-            BN_mod_add(sum,sum,inst->a[i],inst->M,ctx);
+    if (inst->packed != NULL){
+        kss_sum_selected_packed(sum,inst,inst->solution);
+        BN_nnmod(sum,sum,inst->M,ctx);
     }
+    else
+        lazy_sum_selected(sum,inst->a,inst->solution,inst->n,inst->M,ctx);
 
     bool res = BN_cmp(sum,inst->S) == 0;
 
@@ -252,14 +574,19 @@ bool verify_solution(KSS_instance* inst, BN_CTX* ctx){
     return res;
 }
 
-PED_commitment** PROVER_commits(BIGNUM** a, PED_params* params, BN_CTX* ctx){
-
-    PED_commitment** commitments = (PED_commitment**) malloc(sizeof(PED_commitment*) * N_FIXED);
+/**
+ * Commits to every value of a view
+ * @param arena: arena of the proof, owning the returned vector
+ * @param a: view of the values to commit to
+ * @param params: Pedersen parameters
+ * @param coupons: precomputed (s, h^s) pairs, may be NULL
+ */
+PED_commit_vector* PROVER_commits(ZKP_arena* arena, BN_view* a, PED_params* params, PED_coupon_pool* coupons, BN_CTX* ctx){
 
+    PED_commit_vector* commitments = commit_vector_new(arena,a->len,params->p);
+    BIGNUM** values = view_gather_into(a,(BIGNUM**) arena_alloc(arena,sizeof(BIGNUM*) * a->len));
 
-    for (int i=0; i<N_FIXED; ++i){
-        commitments[i] = pedersen_commit(a[i],params->p,params->g,params->h,ctx);
-    }
+    pedersen_commit_batch(commitments,NULL,values,a->len,params,coupons,ctx);
 
     return commitments;
 }
@@ -269,36 +596,101 @@ int VERIFIER_selects_index(){
     return rand()%2;
 }
 
+/**
+ * The prover opens one his two initial commitments, on arrays of the caller
+ * @param com: the commitments and their randomnesses
+ * @param a: view of the values the prover committed to
+ * @param values: Room for a->len pointers, see view_gather_into
+ * @param cs: Room for 2*com->count pointers
+ * @param params: Pedersen parameters
+ */
+bool PROVER_opens_into(PED_commit_vector* com, BN_view* a, BIGNUM** values, BIGNUM** cs, PED_params* params, BN_CTX* ctx){
+
+    BIGNUM** c = cs;
+    BIGNUM** s = cs + com->count;
+    int failed;
+
+    view_gather_into(a,values);
+
+    BN_CTX_start(ctx);
+
+    for(int i=0; i<com->count;++i){
+        c[i] = commit_vector_get_c(com,i,BN_CTX_get(ctx));
+        s[i] = commit_vector_get_s(com,i,BN_CTX_get(ctx));
+    }
+
+    failed = pederesen_unveil_batch(c,s,values,a->len,params,ctx);
+
+    for(int i=0; i<com->count;++i){
+        BN_clear(s[i]);
+    }
+
+    BN_CTX_end(ctx);
+
+    if (failed >= 0){
+        printf("Failed opening %d-th commitment.\n",failed);
+        return false;
+    }
+
+    return true;
+}
+
 /**
  * The prover opens one his two initial commitments
- * @param c: array of commitments
- * @param a: array of values the prover committed to
- * @param s: array of randomnesses used by the prover
- * @param p: the prime used to implement Pedersen commitments
- * @param g: first generator
- * @param h: second generator
+ * @param com: the commitments and their randomnesses
+ * @param a: view of the values the prover committed to
+ * @param params: Pedersen parameters
+ */
+bool PROVER_opens(PED_commit_vector* com, BN_view* a, PED_params* params, BN_CTX* ctx){
+
+    BIGNUM** values = (BIGNUM**) malloc(sizeof(BIGNUM*)*a->len);
+    BIGNUM** cs = (BIGNUM**) malloc(sizeof(BIGNUM*)*com->count*2);
+    bool res = PROVER_opens_into(com,a,values,cs,params,ctx);
+
+    free(cs);
+    free(values);
+
+    return res;
+}
+
+/**
+ * Checks that the opened values are the claimed instance permuted by p
+ * @param received: view of the opened values
+ * @param claimed: view of the (padded) instance
+ * @param p: the permutation sent by the prover
  */
-bool PROVER_opens(BIGNUM** c, BIGNUM** a, BIGNUM** s, BIGNUM* p, BIGNUM* g, BIGNUM* h, BN_CTX* ctx){
+bool VERIFIER_check_permutation(BN_view* received, BN_view* claimed, permutation p){
 
-    bool is_success;
+    BIGNUM *r, *c;
 
-    for(int i=0; i<N_FIXED; ++i){
-        is_success = pederesen_unveil(c[i],s[i],a[i],p,g,h,ctx);
+    if (received->len != claimed->len)
+        return false;
 
-        if (!is_success){
-            printf("Failed opening %d-th commitment.\n",i);
+    for(int i=0; i<received->len;++i){
+
+        r = view_get(received,i);
+        c = view_get(claimed,p[i]);
+
+        // Views over the same storage resolve to the same element
+        if ( r != c && BN_cmp(r,c) != 0)
             return false;
-        }
     }
 
     return true;
 }
 
-bool VERIFIER_check_permutation(BIGNUM** received, BIGNUM** claimed, permutation p, int len){
+/**
+ * Digest of the multiset of values of a view, in one pass
+ * @param k: Secret key of the verifier
+ * @param d: Where to store the digest
+ * @param v: The values
+ */
+bool view_multiset_digest(const MSET_key* k, MSET_digest* d, const BN_view* v){
 
-    for(int i=0; i<len;++i){
+    mset_digest_init(d);
 
-        if ( BN_cmp(received[i], claimed[p[i]]) != 0)
+    for(int i=0; i<v->len;++i){
+        if (!mset_add(k,d,view_get(v,i)))
             return false;
     }
 
@@ -306,24 +698,52 @@ bool VERIFIER_check_permutation(BIGNUM** received, BIGNUM** claimed, permutation
 }
 
 /**
- * Computes the homomorphic sum of elements included in the solution
- * @param c: Array of commitments
- * @param solution: Permuted solutions
- * @param mod: Modulus
- * @param ctx: OpenSSL context 
+ * Checks that the opened values are a permutation of the claimed instance,
+ * without the permutation: compares their multiset digests
+ * @param received: view of the opened values
+ * @param k: Secret key of the verifier
+ * @param claimed: digest of the (padded) instance under k, computed once
+ * @param len: length of the (padded) instance
+ */
+bool VERIFIER_check_multiset(BN_view* received, const MSET_key* k, const MSET_digest* claimed, int len){
+
+    MSET_digest d;
+
+    if (received->len != len)
+        return false;
+
+    if (!view_multiset_digest(k,&d,received))
+        return false;
+
+    return mset_equal(&d,claimed);
+}
+
+/**
+ * Computes into prod the homomorphic sum of the k commitments at positions idx
+ * @param prod: Where to store the result
+ * @param c: Commitments, only their c values are read
+ * @param idx: Positions of the selected commitments
+ * @param k: Number of selected commitments
+ * @param params: Pedersen parameters
+ * @param ctx: OpenSSL context
  */
-BIGNUM* VERIFIER_homomorphic_sum(BIGNUM** c, char* solution, BIGNUM* prime, BN_CTX* ctx){
+BIGNUM* VERIFIER_homomorphic_sum_indexed(BIGNUM* prod, PED_commit_vector* c, const int* idx, int k, PED_params* params, BN_CTX* ctx){
+
+    ZKP_COUNT(ZKP_CNT_MODMUL,k);
+
+    if (params->fx != NULL){
+        params->fx->mod_prod(prod,c->c,idx,k,params->fx->mont);
+        return prod;
+    }
 
     BN_CTX_start(ctx);
 
-    BIGNUM* prod = BN_new();
-    
-    BN_add(prod,prod,BN_value_one());
-    
-    for( int i=0; i<N_FIXED;++i){
-        if (solution[i]==1){
-            BN_mod_mul(prod,prod,c[i],prime,ctx);
-        }
+    BIGNUM* x = BN_CTX_get(ctx);
+
+    BN_one(prod);
+
+    for(int j=0; j<k;++j){
+        BN_mod_mul(prod,prod,commit_vector_get_c(c,idx[j],x),params->p,ctx);
     }
 
     BN_CTX_end(ctx);
@@ -331,4 +751,59 @@ BIGNUM* VERIFIER_homomorphic_sum(BIGNUM** c, char* solution, BIGNUM* prime, BN_C
     return prod;
 }
 
+/**
+ * Computes into prod the homomorphic sum of elements included in the solution
+ * @param prod: Where to store the result
+ * @param c: Commitments, only their c values are read
+ * @param solution: Permuted solutions
+ * @param idx: Room for c->count positions, filled with the selected ones
+ * @param params: Pedersen parameters
+ * @param ctx: OpenSSL context 
+ */
+BIGNUM* VERIFIER_homomorphic_sum_into(BIGNUM* prod, PED_commit_vector* c, char* solution, int* idx, PED_params* params, BN_CTX* ctx){
+
+    int k = 0;
+
+    for( int i=0; i<c->count;++i){
+        if (solution[i]==1)
+            idx[k++] = i;
+    }
+
+    return VERIFIER_homomorphic_sum_indexed(prod,c,idx,k,params,ctx);
+}
+
+/**
+ * Computes into prod the homomorphic sum of the elements of a bit-packed
+ * solution, visiting only the selected commitments
+ * @param prod: Where to store the result
+ * @param c: Commitments, only their c values are read
+ * @param solution: Permuted solution
+ * @param idx: Room for the weight of solution, filled with its positions
+ * @param params: Pedersen parameters
+ * @param ctx: OpenSSL context
+ */
+BIGNUM* VERIFIER_homomorphic_sum_bits(BIGNUM* prod, PED_commit_vector* c, const BIT_solution* solution, int* idx, PED_params* params, BN_CTX* ctx){
+
+    int k = bitsol_indices(solution,idx);
+
+    return VERIFIER_homomorphic_sum_indexed(prod,c,idx,k,params,ctx);
+}
+
+/**
+ * Computes the homomorphic sum of elements included in the solution
+ * @param c: Commitments, only their c values are read
+ * @param solution: Permuted solutions
+ * @param params: Pedersen parameters
+ * @param ctx: OpenSSL context 
+ */
+BIGNUM* VERIFIER_homomorphic_sum(PED_commit_vector* c, char* solution, PED_params* params, BN_CTX* ctx){
+
+    int* idx = (int*) malloc(sizeof(int)*(c->count > 0 ? c->count : 1));
+    BIGNUM* prod = VERIFIER_homomorphic_sum_into(BN_new(),c,solution,idx,params,ctx);
+
+    free(idx);
+
+    return prod;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1247 @@
+#ifndef ZKP_IPA_H
+#define ZKP_IPA_H
+
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pedersen.h"
+#include "wire.h"
+#include "zkp_fixed_size.h"
+#include "zkp_trace.h"
+
+/*
+Non-interactive proof of a subset sum solution of logarithmic size, an
+inner-product argument in the style of Bulletproofs.
+
+The argument needs a group of prime order: it runs in the subgroup of
+quadratic residues of Z_p*, of order q = (p-1)/2, with g^2 and h^2 of the
+Pedersen parameters and vector generators G_i, H_i and u hashed to the
+subgroup, of unknown logarithms. Scalars are modulo q.
+
+The selected values sum to S + carry*M over the integers, and the carry
+depends on the solution. It stays in the witness: with bits = ceil(log2 n),
+the prover knows b in {0,1}^N, the solution followed by the bits of carry
+and padded with zeros to a power of two, and shows without revealing it
+
+    <b, a> = S                  the selected values sum to S modulo M
+    <b, w> = k                  k of the n values are selected
+
+a being the instance followed by the carry weights -M*2^j, j < bits, and w
+being 1 on the n values of the instance, 0 on the carry bits. Both hold
+modulo q, which is the relation over the integers as long as
+(n + 2^bits)*M < q (ipa_supports): the backend runs on short-modulus
+instances. With a_L = b and a_R = b - 1, the proof
+of Bulletproofs' range proof shows a_L o a_R = 0 and a_L - a_R = 1, the
+vector of powers of two replaced by c = z^2*a + z^3*w.
+
+Proof: A, S, T1, T2, the scalars tau_x, mu and t, then log N pairs L, R of
+the inner-product argument and its final scalars a, b. The challenges are
+hashes of the transcript (Fiat-Shamir), which starts with the parameters
+and the instance.
+*/
+
+#define IPA_LABEL "zkp-ipa-v2"
+
+// Widest window of the multi-exponentiations
+#define IPA_MAX_WINDOW 12
+
+// Window of the constant-time multi-exponentiation of secret exponents
+#define IPA_SECRET_WINDOW 4
+
+typedef struct ipa_params
+{
+    /* data */
+    PED_params* ped;
+    BN_CTX* ctx;
+    BN_MONT_CTX* mont;
+    BIGNUM* q;
+    BIGNUM* g;
+    BIGNUM* h;
+    BIGNUM* u;
+    BIGNUM** G;
+    BIGNUM** H;
+    int N;                  // Number of vector generators, a power of two
+    int rounds;             // log2(N)
+    int pbytes;             // Width of a group element
+    int qbytes;             // Width of a scalar
+} IPA_params;
+
+typedef struct ipa_proof
+{
+    /* data */
+    BIGNUM* A;
+    BIGNUM* S;
+    BIGNUM* T1;
+    BIGNUM* T2;
+    BIGNUM* taux;
+    BIGNUM* mu;
+    BIGNUM* t;
+    BIGNUM** L;
+    BIGNUM** R;
+    BIGNUM* a;
+    BIGNUM* b;
+    int rounds;
+} IPA_proof;
+
+typedef struct ipa_transcript
+{
+    /* data */
+    EVP_MD_CTX* md;
+    EVP_MD_CTX* fork;
+    unsigned char* buf;
+} IPA_transcript;
+
+/**
+ * Hashes label and i to an element of the subgroup of quadratic residues
+ */
+void ipa_hash_to_group(BIGNUM* out, const char* label, uint32_t i, IPA_params* pp){
+
+    int len = pp->pbytes + 16;
+    unsigned char* wide = (unsigned char*) malloc(len + 32);
+    unsigned char be[8];
+    EVP_MD_CTX* md = EVP_MD_CTX_new();
+
+    // The square of a value wider than p by 128 bits, close to uniform
+    for(uint32_t ctr=0;;++ctr){
+
+        for(int off=0; off<len;off+=32){
+
+            uint32_t block = (uint32_t) off/32;
+
+            be[0] = i >> 24; be[1] = i >> 16; be[2] = i >> 8; be[3] = i;
+            be[4] = (ctr << 4 | block) >> 24; be[5] = (ctr << 4 | block) >> 16;
+            be[6] = (ctr << 4 | block) >> 8; be[7] = ctr << 4 | block;
+
+            EVP_DigestInit_ex(md,EVP_sha256(),NULL);
+            EVP_DigestUpdate(md,IPA_LABEL,strlen(IPA_LABEL));
+            EVP_DigestUpdate(md,label,strlen(label));
+            EVP_DigestUpdate(md,be,8);
+            EVP_DigestFinal_ex(md,wide + off,NULL);
+        }
+
+        BN_bin2bn(wide,len,out);
+        BN_mod_sqr(out,out,pp->ped->p,pp->ctx);
+
+        if (!BN_is_zero(out) && !BN_is_one(out))
+            break;
+    }
+
+    EVP_MD_CTX_free(md);
+    free(wide);
+}
+
+/**
+ * Generators of the argument for instances of up to n values, and their carry bits
+ * @param ped: Pedersen parameters, p a safe prime
+ * @param n: Largest instance
+ */
+IPA_params* ipa_params_new(PED_params* ped, int n){
+
+    IPA_params* pp = (IPA_params*) malloc(sizeof(IPA_params));
+
+    pp->ped = ped;
+    pp->ctx = BN_CTX_new();
+    pp->mont = BN_MONT_CTX_new();
+    BN_MONT_CTX_set(pp->mont,ped->p,pp->ctx);
+
+    pp->q = BN_dup(ped->p);
+    BN_rshift1(pp->q,pp->q);
+    pp->pbytes = BN_num_bytes(ped->p);
+    pp->qbytes = BN_num_bytes(pp->q);
+
+    pp->N = 1;
+    pp->rounds = 0;
+
+    while (pp->N < n+kss_bits(n-1)){
+        pp->N <<= 1;
+        pp->rounds++;
+    }
+
+    pp->g = BN_new();
+    pp->h = BN_new();
+    pp->u = BN_new();
+    BN_mod_sqr(pp->g,ped->g,ped->p,pp->ctx);
+    BN_mod_sqr(pp->h,ped->h,ped->p,pp->ctx);
+    ipa_hash_to_group(pp->u,"u",0,pp);
+
+    pp->G = (BIGNUM**) malloc(sizeof(BIGNUM*)*pp->N*2);
+    pp->H = pp->G + pp->N;
+
+    for(int i=0; i<pp->N;++i){
+        pp->G[i] = BN_new();
+        pp->H[i] = BN_new();
+        ipa_hash_to_group(pp->G[i],"G",i,pp);
+        ipa_hash_to_group(pp->H[i],"H",i,pp);
+    }
+
+    return pp;
+}
+
+void ipa_params_free(IPA_params* pp){
+
+    for(int i=0; i<2*pp->N;++i)
+        BN_free(pp->G[i]);
+
+    free(pp->G);
+    BN_free(pp->g);
+    BN_free(pp->h);
+    BN_free(pp->u);
+    BN_free(pp->q);
+    BN_MONT_CTX_free(pp->mont);
+    BN_CTX_free(pp->ctx);
+    free(pp);
+}
+
+/**
+ * Whether the relation modulo q is the one of the instance: no sum of
+ * values of the instance, nor of carry weights, reaches q
+ */
+bool ipa_supports(IPA_params* pp, const KSS_instance* inst){
+
+    int bits = kss_bits(inst->n-1);
+    bool res;
+
+    if (inst->n+bits > pp->N)
+        return false;
+
+    BN_CTX_start(pp->ctx);
+
+    BIGNUM* bound = BN_CTX_get(pp->ctx);
+
+    BN_copy(bound,inst->M);
+    BN_mul_word(bound,inst->n + (1ul << bits));
+    res = BN_cmp(bound,pp->q) < 0;
+
+    BN_CTX_end(pp->ctx);
+
+    return res;
+}
+
+IPA_proof* ipa_proof_new(int rounds){
+
+    IPA_proof* pr = (IPA_proof*) malloc(sizeof(IPA_proof));
+
+    pr->A = BN_new();
+    pr->S = BN_new();
+    pr->T1 = BN_new();
+    pr->T2 = BN_new();
+    pr->taux = BN_new();
+    pr->mu = BN_new();
+    pr->t = BN_new();
+    pr->a = BN_new();
+    pr->b = BN_new();
+    pr->rounds = rounds;
+    pr->L = (BIGNUM**) malloc(sizeof(BIGNUM*)*(rounds*2+1));
+    pr->R = pr->L + rounds;
+
+    for(int j=0; j<2*rounds;++j)
+        pr->L[j] = BN_new();
+
+    return pr;
+}
+
+void ipa_proof_free(IPA_proof* pr){
+
+    BN_free(pr->A);
+    BN_free(pr->S);
+    BN_free(pr->T1);
+    BN_free(pr->T2);
+    BN_free(pr->taux);
+    BN_free(pr->mu);
+    BN_free(pr->t);
+    BN_free(pr->a);
+    BN_free(pr->b);
+
+    for(int j=0; j<2*pr->rounds;++j)
+        BN_free(pr->L[j]);
+
+    free(pr->L);
+    free(pr);
+}
+
+/**
+ * Bytes of a proof on the wire
+ */
+size_t ipa_proof_size(const IPA_params* pp){
+    return (size_t) (4 + 2*pp->rounds)*pp->pbytes + (size_t) 5*pp->qbytes;
+}
+
+void ipa_proof_put(WIRE_buf* b, const IPA_proof* pr, const IPA_params* pp){
+
+    wire_put_bn(b,pr->A,pp->pbytes);
+    wire_put_bn(b,pr->S,pp->pbytes);
+    wire_put_bn(b,pr->T1,pp->pbytes);
+    wire_put_bn(b,pr->T2,pp->pbytes);
+    wire_put_bn(b,pr->taux,pp->qbytes);
+    wire_put_bn(b,pr->mu,pp->qbytes);
+    wire_put_bn(b,pr->t,pp->qbytes);
+
+    for(int j=0; j<2*pr->rounds;++j)
+        wire_put_bn(b,pr->L[j],pp->pbytes);
+
+    wire_put_bn(b,pr->a,pp->qbytes);
+    wire_put_bn(b,pr->b,pp->qbytes);
+}
+
+/**
+ * Reads a proof for the parameters pp
+ * @return NULL if the payload is too short
+ */
+IPA_proof* ipa_proof_get(WIRE_reader* r, const IPA_params* pp){
+
+    IPA_proof* pr = ipa_proof_new(pp->rounds);
+
+    wire_get_bn(r,pp->pbytes,pr->A);
+    wire_get_bn(r,pp->pbytes,pr->S);
+    wire_get_bn(r,pp->pbytes,pr->T1);
+    wire_get_bn(r,pp->pbytes,pr->T2);
+    wire_get_bn(r,pp->qbytes,pr->taux);
+    wire_get_bn(r,pp->qbytes,pr->mu);
+    wire_get_bn(r,pp->qbytes,pr->t);
+
+    for(int j=0; j<2*pr->rounds;++j)
+        wire_get_bn(r,pp->pbytes,pr->L[j]);
+
+    wire_get_bn(r,pp->qbytes,pr->a);
+    wire_get_bn(r,pp->qbytes,pr->b);
+
+    if (!r->ok){
+        ipa_proof_free(pr);
+        return NULL;
+    }
+
+    return pr;
+}
+
+void ipa_transcript_init(IPA_transcript* t, IPA_params* pp){
+    t->md = EVP_MD_CTX_new();
+    t->fork = EVP_MD_CTX_new();
+    t->buf = (unsigned char*) malloc(pp->pbytes > 32 ? pp->pbytes : 32);
+    EVP_DigestInit_ex(t->md,EVP_sha256(),NULL);
+    EVP_DigestUpdate(t->md,IPA_LABEL,strlen(IPA_LABEL));
+}
+
+void ipa_transcript_free(IPA_transcript* t){
+    EVP_MD_CTX_free(t->md);
+    EVP_MD_CTX_free(t->fork);
+    free(t->buf);
+}
+
+void ipa_absorb(IPA_transcript* t, const BIGNUM* x, int width){
+    BN_bn2lebinpad(x,t->buf,width);
+    EVP_DigestUpdate(t->md,t->buf,width);
+}
+
+void ipa_absorb_int(IPA_transcript* t, uint32_t x){
+    unsigned char be[4] = {(unsigned char) (x >> 24),(unsigned char) (x >> 16),(unsigned char) (x >> 8),(unsigned char) x};
+    EVP_DigestUpdate(t->md,be,4);
+}
+
+/**
+ * Next challenge, a non-zero scalar of 256 bits, hashed back into the
+ * transcript
+ */
+void ipa_challenge(IPA_transcript* t, BIGNUM* out, IPA_params* pp){
+
+    unsigned char d[32];
+
+    do{
+        EVP_MD_CTX_copy_ex(t->fork,t->md);
+        EVP_DigestFinal_ex(t->fork,d,NULL);
+        EVP_DigestUpdate(t->md,d,32);
+        BN_bin2bn(d,32,out);
+        BN_mod(out,out,pp->q,pp->ctx);
+    } while (BN_is_zero(out));
+}
+
+/**
+ * The statement: parameters and instance
+ */
+void ipa_absorb_statement(IPA_transcript* t, IPA_params* pp, const KSS_instance* inst){
+
+    ipa_absorb(t,pp->ped->p,pp->pbytes);
+    ipa_absorb(t,pp->g,pp->pbytes);
+    ipa_absorb(t,pp->h,pp->pbytes);
+    ipa_absorb_int(t,pp->N);
+    ipa_absorb_int(t,inst->n);
+    ipa_absorb_int(t,inst->k);
+    ipa_absorb(t,inst->M,pp->pbytes);
+    ipa_absorb(t,inst->S,pp->pbytes);
+
+    for(int i=0; i<inst->n;++i)
+        ipa_absorb(t,inst->a[i],pp->pbytes);
+}
+
+BIGNUM** ipa_vec_new(int n){
+
+    BIGNUM** v = (BIGNUM**) malloc(sizeof(BIGNUM*)*n);
+
+    for(int i=0; i<n;++i)
+        v[i] = BN_new();
+
+    return v;
+}
+
+void ipa_vec_free(BIGNUM** v, int n){
+
+    for(int i=0; i<n;++i)
+        BN_clear_free(v[i]);
+
+    free(v);
+}
+
+/**
+ * out = <a,b> mod q
+ */
+void ipa_inner(BIGNUM* out, BIGNUM** a, BIGNUM** b, int n, IPA_params* pp){
+
+    BN_CTX_start(pp->ctx);
+
+    BIGNUM* t = BN_CTX_get(pp->ctx);
+
+    BN_zero(out);
+
+    for(int i=0; i<n;++i){
+        BN_mul(t,a[i],b[i],pp->ctx);
+        BN_add(out,out,t);
+    }
+
+    BN_nnmod(out,out,pp->q,pp->ctx);
+    BN_clear(t);
+
+    BN_CTX_end(pp->ctx);
+}
+
+/**
+ * w bits of the little-endian exponent e from bit pos
+ */
+int ipa_digit(const unsigned char* e, int nbytes, int pos, int w){
+
+    uint32_t v = 0;
+    int byte = pos >> 3;
+
+    for(int i=0; i<3 && byte+i<nbytes;++i)
+        v |= (uint32_t) e[byte+i] << (8*i);
+
+    return (int) ((v >> (pos & 7)) & ((1u << w)-1));
+}
+
+void ipa_mul_into(BIGNUM* acc, bool* set, const BIGNUM* x, IPA_params* pp){
+
+    if (*set)
+        BN_mod_mul_montgomery(acc,acc,x,pp->mont,pp->ctx);
+    else{
+        BN_copy(acc,x);
+        *set = true;
+    }
+}
+
+/**
+ * r = bit ? a : b, reading both: a and b are below p, bit is 0 or 1
+ */
+void ipa_select(BIGNUM* r, const BIGNUM* a, const BIGNUM* b, int bit, IPA_params* pp){
+
+    int words = (pp->pbytes+7)/8;
+    uint64_t* wa = (uint64_t*) malloc(sizeof(uint64_t)*2*words);
+    uint64_t* wb = wa + words;
+    uint64_t mask = (uint64_t) 0 - (uint64_t) bit;
+
+    BN_bn2lebinpad(a,(unsigned char*) wa,words*8);
+    BN_bn2lebinpad(b,(unsigned char*) wb,words*8);
+
+    for(int k=0; k<words;++k)
+        wa[k] = (wa[k] & mask) | (wb[k] & ~mask);
+
+    BN_lebin2bn((unsigned char*) wa,words*8,r);
+
+    OPENSSL_cleanse(wa,sizeof(uint64_t)*2*words);
+    free(wa);
+}
+
+/**
+ * r = g^m h^s for secret m and s, t is scratch
+ */
+void ipa_commit_secret(BIGNUM* r, BIGNUM* m, BIGNUM* s, BIGNUM* t, IPA_params* pp){
+
+    BN_set_flags(m,BN_FLG_CONSTTIME);
+    BN_set_flags(s,BN_FLG_CONSTTIME);
+    BN_mod_exp_mont_consttime(r,pp->g,m,pp->ped->p,pp->ctx,pp->mont);
+    BN_mod_exp_mont_consttime(t,pp->h,s,pp->ped->p,pp->ctx,pp->mont);
+    pedersen_mod_mul(r,r,t,pp->ped,pp->ctx);
+}
+
+/**
+ * r = prod bases[i]^exps[i] mod p for secret exponents, Straus' interleaved
+ * fixed windows: the same squarings and n multiplications per window whatever
+ * the exponents, each factor read from the 2^w powers of its base with the
+ * masked scan of fixed_base_select
+ */
+void ipa_multi_exp_secret(BIGNUM* r, BIGNUM** bases, BIGNUM** exps, int n, IPA_params* pp){
+
+    BN_CTX* ctx = pp->ctx;
+    int nbytes = pp->qbytes;
+    int bits = BN_num_bits(pp->q);
+    int w = IPA_SECRET_WINDOW, nmul = 0;
+    unsigned char* e = (unsigned char*) malloc((size_t) n*nbytes);
+    FB_table powers;
+
+    // Row i of the table holds the powers of base i, as the windows of a fixed base
+    powers.entries = 1 << w;
+    powers.words = (pp->pbytes+7)/8;
+    powers.table = (uint64_t*) malloc(sizeof(uint64_t)*n*powers.entries*powers.words);
+
+    uint64_t* entry = (uint64_t*) malloc(sizeof(uint64_t)*powers.words);
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* acc = BN_CTX_get(ctx);
+    BIGNUM* x = BN_CTX_get(ctx);
+    BIGNUM* t = BN_CTX_get(ctx);
+
+    for(int i=0; i<n;++i){
+
+        BN_to_montgomery(x,bases[i],pp->mont,ctx);
+        BN_to_montgomery(t,BN_value_one(),pp->mont,ctx);
+
+        for(int d=0; d<powers.entries;++d){
+            BN_bn2lebinpad(t,(unsigned char*) (powers.table + (size_t) (i*powers.entries+d)*powers.words),powers.words*8);
+            BN_mod_mul_montgomery(t,t,x,pp->mont,ctx);
+        }
+
+        BN_bn2lebinpad(exps[i],e + (size_t) i*nbytes,nbytes);
+    }
+
+    nmul += n*powers.entries;
+    BN_to_montgomery(acc,BN_value_one(),pp->mont,ctx);
+
+    for(int lo=((bits-1)/w)*w; lo>=0; lo-=w){
+
+        for(int s=0; s<w;++s)
+            BN_mod_mul_montgomery(acc,acc,acc,pp->mont,ctx);
+
+        for(int i=0; i<n;++i){
+            fixed_base_select(&powers,i,ipa_digit(e + (size_t) i*nbytes,nbytes,lo,w),entry);
+            BN_lebin2bn((unsigned char*) entry,powers.words*8,t);
+            BN_mod_mul_montgomery(acc,acc,t,pp->mont,ctx);
+        }
+
+        nmul += w + n;
+    }
+
+    BN_from_montgomery(r,acc,pp->mont,ctx);
+
+    BN_CTX_end(ctx);
+
+    ZKP_COUNT(ZKP_CNT_MODMUL,nmul);
+
+    OPENSSL_cleanse(e,(size_t) n*nbytes);
+    OPENSSL_cleanse(entry,sizeof(uint64_t)*powers.words);
+    free(e);
+    free(entry);
+    free(powers.table);
+}
+
+/**
+ * r = prod bases[i]^exps[i] mod p. Public exponents run Pippenger's buckets:
+ * per window of w bits, n multiplications into the buckets and 2*2^w to
+ * merge them, the buckets hit depending on the exponents. Secret ones go
+ * through ipa_multi_exp_secret.
+ * @param exps: Scalars modulo q
+ */
+void ipa_multi_exp(BIGNUM* r, BIGNUM** bases, BIGNUM** exps, int n, PED_secrecy secrecy, IPA_params* pp){
+
+    if (secrecy == PED_SECRET){
+        ipa_multi_exp_secret(r,bases,exps,n,pp);
+        return;
+    }
+
+    BN_CTX* ctx = pp->ctx;
+    int nbytes = pp->qbytes;
+    int bits = BN_num_bits(pp->q);
+    int w = 1, nbuckets, nmul = 0;
+    double cost, best = 0;
+    unsigned char* e = (unsigned char*) malloc((size_t) n*nbytes);
+    bool *bset, acc_set = false;
+    BIGNUM **x, **bucket;
+    BIGNUM *acc, *run, *tot;
+
+    for(int c=1; c<=IPA_MAX_WINDOW;++c){
+
+        cost = (double) ((bits+c-1)/c) * ((double) n + 2.0*(1 << c)) + bits;
+
+        if (c == 1 || cost < best){
+            w = c;
+            best = cost;
+        }
+    }
+
+    nbuckets = 1 << w;
+    bset = (bool*) malloc(sizeof(bool)*nbuckets);
+    x = (BIGNUM**) malloc(sizeof(BIGNUM*)*(n+nbuckets));
+    bucket = x + n;
+
+    BN_CTX_start(ctx);
+
+    acc = BN_CTX_get(ctx);
+    run = BN_CTX_get(ctx);
+    tot = BN_CTX_get(ctx);
+
+    for(int i=0; i<n;++i){
+        x[i] = BN_CTX_get(ctx);
+        BN_to_montgomery(x[i],bases[i],pp->mont,ctx);
+        BN_bn2lebinpad(exps[i],e + (size_t) i*nbytes,nbytes);
+    }
+
+    for(int d=0; d<nbuckets;++d)
+        bucket[d] = BN_CTX_get(ctx);
+
+    // Windows from the top, the accumulator squared w times between them
+    for(int lo=((bits-1)/w)*w; lo>=0; lo-=w){
+
+        bool run_set = false, tot_set = false;
+
+        if (acc_set){
+            for(int s=0; s<w;++s)
+                BN_mod_mul_montgomery(acc,acc,acc,pp->mont,ctx);
+            nmul += w;
+        }
+
+        memset(bset,0,sizeof(bool)*nbuckets);
+
+        for(int i=0; i<n;++i){
+
+            int d = ipa_digit(e + (size_t) i*nbytes,nbytes,lo,w);
+
+            if (d != 0){
+                ipa_mul_into(bucket[d],&bset[d],x[i],pp);
+                nmul++;
+            }
+        }
+
+        // sum of d*bucket[d] as running products, from the top bucket
+        for(int d=nbuckets-1; d>=1;--d){
+
+            if (bset[d])
+                ipa_mul_into(run,&run_set,bucket[d],pp);
+
+            if (run_set)
+                ipa_mul_into(tot,&tot_set,run,pp);
+
+            nmul += 2;
+        }
+
+        if (tot_set)
+            ipa_mul_into(acc,&acc_set,tot,pp);
+    }
+
+    if (acc_set)
+        BN_from_montgomery(r,acc,pp->mont,ctx);
+    else
+        BN_one(r);
+
+    BN_CTX_end(ctx);
+
+    ZKP_COUNT(ZKP_CNT_MODMUL,nmul);
+
+    OPENSSL_cleanse(e,(size_t) n*nbytes);
+    free(e);
+    free(x);
+    free(bset);
+}
+
+/**
+ * Inner-product argument for <a,b> = t with generators G and H o hscale,
+ * folds a, b, G, H and hscale in place
+ * @param hscale: Exponents of H in the first round, then ones
+ * @param u: Generator of the inner product
+ */
+void ipa_prove_inner(IPA_proof* pr, IPA_transcript* tr, IPA_params* pp, BIGNUM** a, BIGNUM** b, BIGNUM** G, BIGNUM** H, BIGNUM** hscale, BIGNUM* u){
+
+    BN_CTX* ctx = pp->ctx;
+    BIGNUM** bases = (BIGNUM**) malloc(sizeof(BIGNUM*)*(4*pp->N+2));
+    BIGNUM** exps = bases + 2*pp->N+1;
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* cL = BN_CTX_get(ctx);
+    BIGNUM* cR = BN_CTX_get(ctx);
+    BIGNUM* x = BN_CTX_get(ctx);
+    BIGNUM* xinv = BN_CTX_get(ctx);
+    BIGNUM* e1 = BN_CTX_get(ctx);
+    BIGNUM* e2 = BN_CTX_get(ctx);
+    BIGNUM* t = BN_CTX_get(ctx);
+    BIGNUM** sb = (BIGNUM**) malloc(sizeof(BIGNUM*)*pp->N);
+
+    for(int i=0; i<pp->N;++i)
+        sb[i] = BN_CTX_get(ctx);
+
+    for(int j=0, n=pp->N/2; n>=1;++j, n/=2){
+
+        ipa_inner(cL,a,b + n,n,pp);
+        ipa_inner(cR,a + n,b,n,pp);
+
+        // L = G_hi^a_lo H_lo^b_hi u^cL
+        for(int i=0; i<n;++i){
+            BN_mod_mul(sb[i],b[n+i],hscale[i],pp->q,ctx);
+            bases[i] = G[n+i];
+            exps[i] = a[i];
+            bases[n+i] = H[i];
+            exps[n+i] = sb[i];
+        }
+
+        bases[2*n] = u;
+        exps[2*n] = cL;
+        ipa_multi_exp(pr->L[j],bases,exps,2*n+1,PED_SECRET,pp);
+
+        // R = G_lo^a_hi H_hi^b_lo u^cR
+        for(int i=0; i<n;++i){
+            BN_mod_mul(sb[i],b[i],hscale[n+i],pp->q,ctx);
+            bases[i] = G[i];
+            exps[i] = a[n+i];
+            bases[n+i] = H[n+i];
+            exps[n+i] = sb[i];
+        }
+
+        bases[2*n] = u;
+        exps[2*n] = cR;
+        ipa_multi_exp(pr->R[j],bases,exps,2*n+1,PED_SECRET,pp);
+
+        ipa_absorb(tr,pr->L[j],pp->pbytes);
+        ipa_absorb(tr,pr->R[j],pp->pbytes);
+        ipa_challenge(tr,x,pp);
+        BN_mod_inverse(xinv,x,pp->q,ctx);
+
+        // The generators fold with the public challenge, in variable time
+        for(int i=0; i<n;++i){
+
+            BN_mod_exp2_mont(G[i],G[i],xinv,G[n+i],x,pp->ped->p,ctx,pp->mont);
+
+            BN_mod_mul(e1,x,hscale[i],pp->q,ctx);
+            BN_mod_mul(e2,xinv,hscale[n+i],pp->q,ctx);
+            BN_mod_exp2_mont(H[i],H[i],e1,H[n+i],e2,pp->ped->p,ctx,pp->mont);
+            BN_one(hscale[i]);
+
+            BN_mod_mul(t,a[n+i],xinv,pp->q,ctx);
+            BN_mod_mul(a[i],a[i],x,pp->q,ctx);
+            BN_mod_add(a[i],a[i],t,pp->q,ctx);
+
+            BN_mod_mul(t,b[n+i],x,pp->q,ctx);
+            BN_mod_mul(b[i],b[i],xinv,pp->q,ctx);
+            BN_mod_add(b[i],b[i],t,pp->q,ctx);
+        }
+
+        ZKP_COUNT(ZKP_CNT_MODEXP,2*n);
+    }
+
+    BN_copy(pr->a,a[0]);
+    BN_copy(pr->b,b[0]);
+
+    for(int i=0; i<pp->N;++i)
+        BN_clear(sb[i]);
+
+    BN_clear(t);
+    BN_CTX_end(ctx);
+
+    free(sb);
+    free(bases);
+}
+
+/**
+ * c = z^2*a + z^3*w, t0 = z^2*S + z^3*k + (z - z^2)*<1,y^N> - z*<1,c>,
+ * the constant term of <l(X),r(X)> for a valid solution
+ */
+void ipa_constraints(BIGNUM** c, BIGNUM* t0, IPA_params* pp, const KSS_instance* inst, const BIGNUM* y, const BIGNUM* z){
+
+    BN_CTX* ctx = pp->ctx;
+    int n = inst->n, bits = kss_bits(inst->n-1);
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* z2 = BN_CTX_get(ctx);
+    BIGNUM* z3 = BN_CTX_get(ctx);
+    BIGNUM* sum = BN_CTX_get(ctx);
+    BIGNUM* yi = BN_CTX_get(ctx);
+    BIGNUM* t = BN_CTX_get(ctx);
+
+    BN_mod_sqr(z2,z,pp->q,ctx);
+    BN_mod_mul(z3,z2,z,pp->q,ctx);
+
+    // <1,c>
+    BN_zero(sum);
+
+    for(int i=0; i<pp->N;++i){
+        if (i < n){
+            BN_mod_mul(c[i],inst->a[i],z2,pp->q,ctx);
+            BN_mod_add(c[i],c[i],z3,pp->q,ctx);
+        }
+        else if (i < n+bits){
+            // Carry weight -M*2^j, no term of w
+            BN_lshift(t,inst->M,i-n);
+            BN_mod_mul(c[i],t,z2,pp->q,ctx);
+            BN_mod_sub(c[i],pp->q,c[i],pp->q,ctx);
+        }
+        else
+            BN_zero(c[i]);
+
+        BN_mod_add(sum,sum,c[i],pp->q,ctx);
+    }
+
+    BN_mod_mul(t0,z,sum,pp->q,ctx);
+    BN_mod_sub(t0,pp->q,t0,pp->q,ctx);
+
+    // <1,y^N>
+    BN_zero(sum);
+    BN_one(yi);
+
+    for(int i=0; i<pp->N;++i){
+        BN_mod_add(sum,sum,yi,pp->q,ctx);
+        BN_mod_mul(yi,yi,y,pp->q,ctx);
+    }
+
+    BN_mod_sub(t,z,z2,pp->q,ctx);
+    BN_mod_mul(t,t,sum,pp->q,ctx);
+    BN_mod_add(t0,t0,t,pp->q,ctx);
+
+    BN_set_word(t,inst->k);
+    BN_mod_mul(t,t,z3,pp->q,ctx);
+    BN_mod_add(t0,t0,t,pp->q,ctx);
+
+    BN_mod_mul(t,inst->S,z2,pp->q,ctx);
+    BN_mod_add(t0,t0,t,pp->q,ctx);
+
+    BN_CTX_end(ctx);
+}
+
+/**
+ * Number of times the selected values of inst wrap around M, 0 if they sum
+ * to less than S
+ */
+int ipa_carry(IPA_params* pp, const KSS_instance* inst){
+
+    int carry = 0;
+
+    BN_CTX_start(pp->ctx);
+
+    BIGNUM* sum = BN_CTX_get(pp->ctx);
+
+    BN_zero(sum);
+
+    for(int i=0; i<inst->n;++i){
+        if (inst->solution[i] == 1)
+            BN_add(sum,sum,inst->a[i]);
+    }
+
+    BN_sub(sum,sum,inst->S);
+
+    if (!BN_is_negative(sum)){
+        BN_div(sum,NULL,sum,inst->M,pp->ctx);
+        carry = (int) BN_get_word(sum);
+    }
+
+    BN_clear(sum);
+    BN_CTX_end(pp->ctx);
+
+    return carry;
+}
+
+/**
+ * Bit i of the witness: the solution on the n values, then the bits of carry
+ */
+int ipa_witness_bit(const KSS_instance* inst, int carry, int i){
+
+    if (i < inst->n)
+        return inst->solution[i] == 1;
+
+    if (i < inst->n+kss_bits(inst->n-1))
+        return carry >> (i-inst->n) & 1;
+
+    return 0;
+}
+
+/**
+ * Proves knowledge of the solution of inst
+ * @return The proof, NULL if the instance is not supported
+ */
+IPA_proof* ipa_prove(IPA_params* pp, const KSS_instance* inst){
+
+    BN_CTX* ctx = pp->ctx;
+    int N = pp->N, carry;
+    IPA_proof* pr;
+    IPA_transcript tr;
+    BIGNUM** bases;
+    BIGNUM** exps;
+
+    if (!ipa_supports(pp,inst))
+        return NULL;
+
+    ZKP_SPAN_BEGIN(span,"ipa.prove");
+
+    pr = ipa_proof_new(pp->rounds);
+    bases = (BIGNUM**) malloc(sizeof(BIGNUM*)*(4*N+2));
+    exps = bases + 2*N+1;
+
+    BIGNUM** sL = ipa_vec_new(N);
+    BIGNUM** sR = ipa_vec_new(N);
+    BIGNUM** l = ipa_vec_new(N);
+    BIGNUM** r = ipa_vec_new(N);
+    BIGNUM** r1 = ipa_vec_new(N);
+    BIGNUM** c = ipa_vec_new(N);
+    BIGNUM** G = ipa_vec_new(N);
+    BIGNUM** H = ipa_vec_new(N);
+    BIGNUM** hscale = ipa_vec_new(N);
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* alpha = BN_CTX_get(ctx);
+    BIGNUM* rho = BN_CTX_get(ctx);
+    BIGNUM* tau1 = BN_CTX_get(ctx);
+    BIGNUM* tau2 = BN_CTX_get(ctx);
+    BIGNUM* y = BN_CTX_get(ctx);
+    BIGNUM* z = BN_CTX_get(ctx);
+    BIGNUM* x = BN_CTX_get(ctx);
+    BIGNUM* w = BN_CTX_get(ctx);
+    BIGNUM* yi = BN_CTX_get(ctx);
+    BIGNUM* yinv = BN_CTX_get(ctx);
+    BIGNUM* t0 = BN_CTX_get(ctx);
+    BIGNUM* t1 = BN_CTX_get(ctx);
+    BIGNUM* t2 = BN_CTX_get(ctx);
+    BIGNUM* t = BN_CTX_get(ctx);
+    BIGNUM* sel = BN_CTX_get(ctx);
+    BIGNUM* unsel = BN_CTX_get(ctx);
+    BIGNUM* uw = BN_CTX_get(ctx);
+
+    carry = ipa_carry(pp,inst);
+
+    ipa_transcript_init(&tr,pp);
+    ipa_absorb_statement(&tr,pp,inst);
+
+    BN_rand_range(alpha,pp->q);
+    BN_rand_range(rho,pp->q);
+    BN_rand_range(tau1,pp->q);
+    BN_rand_range(tau2,pp->q);
+
+    // A = h^alpha G^a_L H^a_R, a_L the witness and a_R = a_L - 1. Both
+    // products take a factor per value, G_i or 1 and 1 or H_i by masked selection
+    BN_one(sel);
+    BN_one(unsel);
+
+    for(int i=0; i<N;++i){
+
+        int bit = ipa_witness_bit(inst,carry,i);
+
+        ipa_select(t1,pp->G[i],BN_value_one(),bit,pp);
+        pedersen_mod_mul(sel,sel,t1,pp->ped,ctx);
+        ipa_select(t1,BN_value_one(),pp->H[i],bit,pp);
+        pedersen_mod_mul(unsel,unsel,t1,pp->ped,ctx);
+    }
+
+    BN_mod_inverse(unsel,unsel,pp->ped->p,ctx);
+    BN_set_flags(alpha,BN_FLG_CONSTTIME);
+    BN_mod_exp_mont_consttime(pr->A,pp->h,alpha,pp->ped->p,ctx,pp->mont);
+    pedersen_mod_mul(pr->A,pr->A,sel,pp->ped,ctx);
+    pedersen_mod_mul(pr->A,pr->A,unsel,pp->ped,ctx);
+
+    // S = h^rho G^s_L H^s_R
+    for(int i=0; i<N;++i){
+        BN_rand_range(sL[i],pp->q);
+        BN_rand_range(sR[i],pp->q);
+        bases[i] = pp->G[i];
+        exps[i] = sL[i];
+        bases[N+i] = pp->H[i];
+        exps[N+i] = sR[i];
+    }
+
+    bases[2*N] = pp->h;
+    exps[2*N] = rho;
+    ipa_multi_exp(pr->S,bases,exps,2*N+1,PED_SECRET,pp);
+
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,(uint64_t) (2*N+4)*pp->qbytes);
+    ZKP_COUNT(ZKP_CNT_MODEXP,1);
+
+    ipa_absorb(&tr,pr->A,pp->pbytes);
+    ipa_absorb(&tr,pr->S,pp->pbytes);
+    ipa_challenge(&tr,y,pp);
+    ipa_challenge(&tr,z,pp);
+
+    ipa_constraints(c,t0,pp,inst,y,z);
+
+    // l(X) = a_L - z + s_L X, r(X) = y^i o (a_R + z + s_R X) + c
+    BN_one(yi);
+
+    for(int i=0; i<N;++i){
+
+        int bit = ipa_witness_bit(inst,carry,i);
+
+        // l0 = a_L - z, r0 = a_L - 1 + z without branching on the bit
+        BN_set_word(l[i],bit);
+        BN_mod_add(r[i],l[i],z,pp->q,ctx);
+        BN_mod_sub(r[i],r[i],BN_value_one(),pp->q,ctx);
+        BN_mod_sub(l[i],l[i],z,pp->q,ctx);
+
+        BN_mod_mul(r[i],r[i],yi,pp->q,ctx);
+        BN_mod_add(r[i],r[i],c[i],pp->q,ctx);
+        BN_mod_mul(r1[i],sR[i],yi,pp->q,ctx);
+
+        BN_mod_mul(yi,yi,y,pp->q,ctx);
+    }
+
+    // t1 = <l0,r1> + <s_L,r0>, t2 = <s_L,r1>
+    ipa_inner(t1,l,r1,N,pp);
+    ipa_inner(t,sL,r,N,pp);
+    BN_mod_add(t1,t1,t,pp->q,ctx);
+    ipa_inner(t2,sL,r1,N,pp);
+
+    // T1 = g^t1 h^tau1, T2 = g^t2 h^tau2, all four exponents secret
+    ipa_commit_secret(pr->T1,t1,tau1,t,pp);
+    ipa_commit_secret(pr->T2,t2,tau2,t,pp);
+    ZKP_COUNT(ZKP_CNT_MODEXP,4);
+
+    ipa_absorb(&tr,pr->T1,pp->pbytes);
+    ipa_absorb(&tr,pr->T2,pp->pbytes);
+    ipa_challenge(&tr,x,pp);
+
+    // l = l0 + s_L x, r = r0 + r1 x, t = <l,r>
+    for(int i=0; i<N;++i){
+        BN_mod_mul(t,sL[i],x,pp->q,ctx);
+        BN_mod_add(l[i],l[i],t,pp->q,ctx);
+        BN_mod_mul(t,r1[i],x,pp->q,ctx);
+        BN_mod_add(r[i],r[i],t,pp->q,ctx);
+    }
+
+    ipa_inner(pr->t,l,r,N,pp);
+
+    // tau_x = tau2 x^2 + tau1 x, mu = alpha + rho x
+    BN_mod_mul(pr->taux,tau2,x,pp->q,ctx);
+    BN_mod_add(pr->taux,pr->taux,tau1,pp->q,ctx);
+    BN_mod_mul(pr->taux,pr->taux,x,pp->q,ctx);
+    BN_mod_mul(pr->mu,rho,x,pp->q,ctx);
+    BN_mod_add(pr->mu,pr->mu,alpha,pp->q,ctx);
+
+    ipa_absorb(&tr,pr->taux,pp->qbytes);
+    ipa_absorb(&tr,pr->mu,pp->qbytes);
+    ipa_absorb(&tr,pr->t,pp->qbytes);
+    ipa_challenge(&tr,w,pp);
+
+    BN_mod_exp_mont(uw,pp->u,w,pp->ped->p,ctx,pp->mont);
+    ZKP_COUNT(ZKP_CNT_MODEXP,1);
+
+    // The argument runs on H' = H^(y^-i), folded into the first round
+    BN_mod_inverse(yinv,y,pp->q,ctx);
+    BN_one(yi);
+
+    for(int i=0; i<N;++i){
+        BN_copy(G[i],pp->G[i]);
+        BN_copy(H[i],pp->H[i]);
+        BN_copy(hscale[i],yi);
+        BN_mod_mul(yi,yi,yinv,pp->q,ctx);
+    }
+
+    ipa_prove_inner(pr,&tr,pp,l,r,G,H,hscale,uw);
+
+    BN_clear(alpha);
+    BN_clear(rho);
+    BN_clear(tau1);
+    BN_clear(tau2);
+    BN_clear(t1);
+    BN_clear(t2);
+    BN_clear(t);
+    BN_CTX_end(ctx);
+
+    ipa_transcript_free(&tr);
+    ipa_vec_free(sL,N);
+    ipa_vec_free(sR,N);
+    ipa_vec_free(l,N);
+    ipa_vec_free(r,N);
+    ipa_vec_free(r1,N);
+    ipa_vec_free(c,N);
+    ipa_vec_free(G,N);
+    ipa_vec_free(H,N);
+    ipa_vec_free(hscale,N);
+    free(bases);
+
+    ZKP_SPAN_END(span);
+
+    return pr;
+}
+
+/**
+ * Whether x is an element of the subgroup of quadratic residues
+ */
+bool ipa_in_group(const BIGNUM* x, IPA_params* pp){
+    return !BN_is_zero(x) && !BN_is_negative(x) && BN_cmp(x,pp->ped->p) < 0 && BN_kronecker(x,pp->ped->p,pp->ctx) == 1;
+}
+
+bool ipa_is_scalar(const BIGNUM* x, IPA_params* pp){
+    return !BN_is_negative(x) && BN_cmp(x,pp->q) < 0;
+}
+
+/**
+ * Verifies a proof for inst, with two multi-exponentiations: the polynomial
+ * identity of t, and the commitments with the whole inner-product argument
+ * in one equation
+ */
+bool ipa_verify(IPA_params* pp, const KSS_instance* inst, const IPA_proof* pr){
+
+    BN_CTX* ctx = pp->ctx;
+    int N = pp->N, K = pp->rounds;
+    int nb = 2*N + 2*K + 3;
+    bool res = true;
+    IPA_transcript tr;
+    BIGNUM** bases;
+
+    if (!ipa_supports(pp,inst) || pr->rounds != K)
+        return false;
+
+    if (!ipa_in_group(pr->A,pp) || !ipa_in_group(pr->S,pp) || !ipa_in_group(pr->T1,pp) || !ipa_in_group(pr->T2,pp))
+        return false;
+
+    for(int j=0; j<2*K;++j)
+        if (!ipa_in_group(pr->L[j],pp))
+            return false;
+
+    if (!ipa_is_scalar(pr->taux,pp) || !ipa_is_scalar(pr->mu,pp) || !ipa_is_scalar(pr->t,pp) || !ipa_is_scalar(pr->a,pp) || !ipa_is_scalar(pr->b,pp))
+        return false;
+
+    ZKP_SPAN_BEGIN(span,"ipa.verify");
+
+    bases = (BIGNUM**) malloc(sizeof(BIGNUM*)*nb);
+
+    BIGNUM** c = ipa_vec_new(N);
+    BIGNUM** s = ipa_vec_new(N);
+    BIGNUM** e = ipa_vec_new(nb);
+    BIGNUM** xs = ipa_vec_new(2*K);
+
+    BN_CTX_start(ctx);
+
+    BIGNUM* y = BN_CTX_get(ctx);
+    BIGNUM* z = BN_CTX_get(ctx);
+    BIGNUM* x = BN_CTX_get(ctx);
+    BIGNUM* w = BN_CTX_get(ctx);
+    BIGNUM* yinv = BN_CTX_get(ctx);
+    BIGNUM* yi = BN_CTX_get(ctx);
+    BIGNUM* t0 = BN_CTX_get(ctx);
+    BIGNUM* t = BN_CTX_get(ctx);
+    BIGNUM* sinv = BN_CTX_get(ctx);
+    BIGNUM* check = BN_CTX_get(ctx);
+
+    ipa_transcript_init(&tr,pp);
+    ipa_absorb_statement(&tr,pp,inst);
+
+    ipa_absorb(&tr,pr->A,pp->pbytes);
+    ipa_absorb(&tr,pr->S,pp->pbytes);
+    ipa_challenge(&tr,y,pp);
+    ipa_challenge(&tr,z,pp);
+    ipa_absorb(&tr,pr->T1,pp->pbytes);
+    ipa_absorb(&tr,pr->T2,pp->pbytes);
+    ipa_challenge(&tr,x,pp);
+    ipa_absorb(&tr,pr->taux,pp->qbytes);
+    ipa_absorb(&tr,pr->mu,pp->qbytes);
+    ipa_absorb(&tr,pr->t,pp->qbytes);
+    ipa_challenge(&tr,w,pp);
+
+    // xs[j] = x_j^2, xs[K+j] = x_j^-2
+    for(int j=0; j<K;++j){
+        ipa_absorb(&tr,pr->L[j],pp->pbytes);
+        ipa_absorb(&tr,pr->R[j],pp->pbytes);
+        ipa_challenge(&tr,xs[j],pp);
+    }
+
+    ipa_constraints(c,t0,pp,inst,y,z);
+
+    // g^(t - t0) h^tau_x T1^-x T2^-x^2 = 1
+    BN_mod_sub(e[0],pr->t,t0,pp->q,ctx);
+    BN_copy(e[1],pr->taux);
+    BN_sub(e[2],pp->q,x);
+    BN_mod_sqr(e[3],x,pp->q,ctx);
+    BN_mod_sub(e[3],pp->q,e[3],pp->q,ctx);
+
+    bases[0] = pp->g;
+    bases[1] = pp->h;
+    bases[2] = pr->T1;
+    bases[3] = pr->T2;
+    ipa_multi_exp(check,bases,e,4,PED_PUBLIC,pp);
+
+    res = BN_is_one(check);
+
+    if (res){
+
+        // s_0 = prod x_j^-1, s_i from s_(i - 2^b) for b the top bit of i
+        BN_one(s[0]);
+
+        for(int j=0; j<K;++j){
+            BN_mod_inverse(t,xs[j],pp->q,ctx);
+            BN_mod_mul(s[0],s[0],t,pp->q,ctx);
+            BN_mod_sqr(xs[K+j],t,pp->q,ctx);
+            BN_mod_sqr(xs[j],xs[j],pp->q,ctx);
+        }
+
+        for(int i=1, b=0; i<N;++i){
+            if (i == (2 << b))
+                b++;
+            BN_mod_mul(s[i],s[i-(1 << b)],xs[K-1-b],pp->q,ctx);
+        }
+
+        // A S^x G^(-z - a s_i) H^(z + y^-i (c_i - b/s_i)) h^-mu u^(w (t - a b)) L^x^2 R^x^-2 = 1
+        BN_mod_inverse(yinv,y,pp->q,ctx);
+        BN_one(yi);
+
+        for(int i=0; i<N;++i){
+
+            BN_mod_mul(e[i],pr->a,s[i],pp->q,ctx);
+            BN_mod_add(e[i],e[i],z,pp->q,ctx);
+            BN_mod_sub(e[i],pp->q,e[i],pp->q,ctx);
+            bases[i] = pp->G[i];
+
+            BN_mod_inverse(sinv,s[i],pp->q,ctx);
+            BN_mod_mul(t,pr->b,sinv,pp->q,ctx);
+            BN_mod_sub(t,c[i],t,pp->q,ctx);
+            BN_mod_mul(t,t,yi,pp->q,ctx);
+            BN_mod_add(e[N+i],t,z,pp->q,ctx);
+            bases[N+i] = pp->H[i];
+
+            BN_mod_mul(yi,yi,yinv,pp->q,ctx);
+        }
+
+        for(int j=0; j<K;++j){
+            bases[2*N+j] = pr->L[j];
+            BN_copy(e[2*N+j],xs[j]);
+            bases[2*N+K+j] = pr->R[j];
+            BN_copy(e[2*N+K+j],xs[K+j]);
+        }
+
+        bases[2*N+2*K] = pr->S;
+        BN_copy(e[2*N+2*K],x);
+
+        bases[2*N+2*K+1] = pp->h;
+        BN_mod_sub(e[2*N+2*K+1],pp->q,pr->mu,pp->q,ctx);
+
+        bases[2*N+2*K+2] = pp->u;
+        BN_mod_mul(t,pr->a,pr->b,pp->q,ctx);
+        BN_mod_sub(t,pr->t,t,pp->q,ctx);
+        BN_mod_mul(e[2*N+2*K+2],t,w,pp->q,ctx);
+
+        ipa_multi_exp(check,bases,e,nb,PED_PUBLIC,pp);
+        pedersen_mod_mul(check,check,pr->A,pp->ped,ctx);
+
+        res = BN_is_one(check);
+    }
+
+    BN_CTX_end(ctx);
+
+    ipa_transcript_free(&tr);
+    ipa_vec_free(c,N);
+    ipa_vec_free(s,N);
+    ipa_vec_free(e,nb);
+    ipa_vec_free(xs,2*K);
+
+    ZKP_SPAN_END(span);
+
+    free(bases);
+
+    return res;
+}
+
+#endif
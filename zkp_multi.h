@@ -0,0 +1,353 @@
+#ifndef ZKP_MULTI_H
+#define ZKP_MULTI_H
+
+#include <openssl/bn.h>
+#include <openssl/rand.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "zkp_config.h"
+#include "zkp_session.h"
+#include "zkp_trace.h"
+
+/*
+Multi-challenge rounds: the prover commits to t permuted copies of the
+padded instance, and the challenge is a subset of c of them. These are
+proven through the homomorphic sum of the commitments the permuted solution
+selects, the t-c others are opened. Each copy reveals one side only, so the
+round stays zero-knowledge for the same reason as the two-copy one.
+
+Without a solution, a copy passes either the opening (it holds a permutation
+of the instance) or the sum (it holds values the solution sums to S), not
+both. A cheating prover escapes only if the challenge is exactly the set of
+its copies of the second kind: a round has soundness error 1/C(t,c), and t=2,
+c=1 is the round of zkp_session.h.
+
+zkp_plan picks t and c for a soundness target. It minimizes
+rounds * (t*commit + (t-c)*open + c*sum + round), with a cost per operation
+that defaults to modular exponentiations (zkp_round_cost_modexp) but can be
+measured. Wider rounds cost fewer exponentiations per bit of soundness, and
+their copies are independent, so they batch and shard well.
+
+A round, with mask the copies proven through the sum:
+    PROVER_multi_commits, VERIFIER_multi_challenge,
+    for every opened copy j, PROVER_multi_opening + VERIFIER_checks_opening,
+    for every summed copy j, PROVER_multi_permuted_solution +
+    VERIFIER_homomorphic_sum_round, PROVER_multi_sum + VERIFIER_accepts,
+    PROVER_multi_reset
+*/
+
+typedef struct zkp_round_cost
+{
+    /* data */
+    double commit;      // Prover, one copy of 2n commitments
+    double open;        // Verifier, one opened copy
+    double sum;         // Verifier, one copy proven through the sum
+    double round;       // Any round, whatever its width
+} ZKP_round_cost;
+
+typedef struct zkp_plan
+{
+    /* data */
+    int copies;
+    int summed;
+    int rounds;
+    double bits;        // Soundness of one round, log2 C(copies,summed)
+    double cost;
+} ZKP_plan;
+
+/*
+The permuted copies of a multi-challenge round. The prover session provides
+the instance, its padded view and solution, the pools and the accumulator.
+*/
+typedef struct PROVER_multi
+{
+    /* data */
+    PROVER_data* P;
+    int copies;
+    ZKP_arena* arena;
+    PED_zero_pool* zeros;
+    permutation* perm;
+    BN_view* views;
+    PED_commit_vector** com;
+} PROVER_multi;
+
+/**
+ * Exponentiations of each operation for instances of n values: 2 per
+ * commitment of the 2n of a copy, and the opening of the sum
+ */
+ZKP_round_cost zkp_round_cost_modexp(int n){
+
+    ZKP_round_cost c;
+
+    c.commit = 4.0*n;
+    c.open = 4.0*n;
+    c.sum = 2;
+    c.round = 0;
+
+    return c;
+}
+
+/**
+ * log2(x) for x >= 1, by squarings
+ */
+double zkp_log2(double x){
+
+    double r = 0, f = 1;
+
+    while (x >= 2){
+        x /= 2;
+        r += 1;
+    }
+
+    for(int i=0; i<48;++i){
+        x *= x;
+        f /= 2;
+
+        if (x >= 2){
+            x /= 2;
+            r += f;
+        }
+    }
+
+    return r;
+}
+
+double zkp_binomial(int t, int c){
+
+    double b = 1;
+
+    for(int i=1; i<=c;++i)
+        b = b*(t-c+i)/i;
+
+    return b;
+}
+
+/**
+ * Cheapest round for a soundness target
+ * @param soundness: The target, a cheating prover is accepted with probability at most 2^-soundness
+ * @param cost: Cost of each operation
+ * @param max_copies: Widest round
+ */
+ZKP_plan zkp_plan(int soundness, const ZKP_round_cost* cost, int max_copies){
+
+    ZKP_plan best, p;
+
+    best.copies = 0;
+
+    for(int t=2; t<=max_copies;++t){
+        for(int c=1; c<t;++c){
+
+            p.copies = t;
+            p.summed = c;
+            p.bits = zkp_log2(zkp_binomial(t,c));
+            p.rounds = (int) (soundness/p.bits);
+
+            if (p.rounds*p.bits < soundness)
+                p.rounds++;
+
+            p.cost = p.rounds*(t*cost->commit + (t-c)*cost->open + c*cost->sum + cost->round);
+
+            // Ties go to the narrower round, it holds fewer copies
+            if (best.copies == 0 || p.cost < best.cost)
+                best = p;
+        }
+    }
+
+    return best;
+}
+
+void zkp_plan_print(const ZKP_plan* p){
+    printf("Plan: %d rounds of %d copies, %d summed, %.2f bits per round, cost %.0f\n",p->rounds,p->copies,p->summed,p->bits,p->cost);
+}
+
+/**
+ * Uniform integer below m, m at most 256
+ */
+int zkp_random_below(int m){
+
+    unsigned char b;
+    int limit = 256 - 256 % m;
+
+    do{
+        RAND_bytes(&b,1);
+        ZKP_COUNT(ZKP_CNT_RNG_BYTES,1);
+    } while (b >= limit);
+
+    return b % m;
+}
+
+/**
+ * Second step of a multi-challenge round: draws the subset of summed copies
+ * @param copies: Copies committed by the prover
+ * @param summed: Size of the subset
+ * @return Bit j set if copy j is proven through the sum
+ */
+uint32_t VERIFIER_multi_challenge(VERIFIER_data* V, int copies, int summed){
+
+    int order[ZKP_MAX_COPIES];
+    uint32_t mask = 0;
+
+    for(int j=0; j<copies;++j)
+        order[j] = j;
+
+    // The first summed positions of a partial Fisher-Yates shuffle
+    for(int i=0; i<summed;++i){
+
+        int j = i + zkp_random_below(copies-i);
+        int t = order[i];
+
+        order[i] = order[j];
+        order[j] = t;
+        mask |= (uint32_t) 1 << order[i];
+    }
+
+    V->index = -1;
+
+    return mask;
+}
+
+/**
+ * Creates the copies of a prover session
+ * @param copies: Copies per round, at most ZKP_MAX_COPIES
+ */
+PROVER_multi* PROVER_multi_new(PROVER_data* P, int copies){
+
+    PROVER_multi* M = (PROVER_multi*) malloc(sizeof(PROVER_multi));
+
+    M->P = P;
+    M->copies = copies;
+    M->arena = arena_new((size_t) copies*2*P->len*BN_num_bytes(P->params->p)+ARENA_DEFAULT_SIZE);
+    M->zeros = pedersen_zero_pool_new(copies*P->len/2);
+    M->perm = (permutation*) malloc(sizeof(permutation)*copies);
+    M->views = (BN_view*) malloc(sizeof(BN_view)*copies);
+    M->com = (PED_commit_vector**) calloc(copies,sizeof(PED_commit_vector*));
+
+    for(int j=0; j<copies;++j){
+        M->perm[j] = permutation_init(P->len);
+        M->views[j] = view_permute(&P->padded,M->perm[j]);
+    }
+
+    return M;
+}
+
+/**
+ * Offline work for the next round: refills the commitments to zero
+ */
+void PROVER_multi_precompute(PROVER_multi* M){
+    pedersen_zero_pool_fill(M->zeros,M->P->params,M->P->ctx);
+}
+
+/**
+ * First step: draws the permutations and commits to every permuted copy
+ */
+void PROVER_multi_commits(PROVER_multi* M){
+
+    PROVER_data* P = M->P;
+
+    ZKP_SPAN_BEGIN(span,"prover.multi_commit");
+
+    for(int j=0; j<M->copies;++j){
+
+        permutation_randomize(M->perm[j],P->len);
+
+        if (P->shards != NULL && P->len <= P->shards->capacity)
+            M->com[j] = PROVER_commits_sharded(P->shards,M->arena,&M->views[j]);
+        else
+            M->com[j] = PROVER_commits_variable(M->arena,&M->views[j],P->params,M->zeros,P->coupons,P->ctx);
+    }
+
+    ZKP_SPAN_END(span);
+}
+
+/**
+ * Third step, for an opened copy
+ */
+void PROVER_multi_opening(PROVER_multi* M, int copy, PED_commit_vector** com, BN_view** opened){
+    *com = M->com[copy];
+    *opened = &M->views[copy];
+}
+
+/**
+ * Fifth step, for a summed copy: the solution permuted like the copy
+ */
+BIT_solution* PROVER_multi_permuted_solution(PROVER_multi* M, int copy){
+    return permutation_apply_bitsol_into(M->P->permuted_solution,M->P->padded_solution,M->perm[copy]);
+}
+
+/**
+ * Seventh step, after PROVER_multi_permuted_solution of the same copy: sum of
+ * the randomnesses of its selected commitments
+ */
+BIGNUM* PROVER_multi_sum(PROVER_multi* M, int copy){
+
+    PROVER_data* P = M->P;
+    PED_commit_vector* com = M->com[copy];
+    int k = bitsol_indices(P->permuted_solution,P->selected);
+
+    lazy_acc_sum_indexed_words(P->acc,P->sum,com->s,com->words,P->selected,k,P->order,P->ctx);
+
+    return P->sum;
+}
+
+/**
+ * Ends a round: releases and wipes the commitments of the copies
+ */
+void PROVER_multi_reset(PROVER_multi* M){
+
+    arena_reset(M->arena);
+    BN_clear(M->P->sum);
+
+    for(int j=0; j<M->copies;++j)
+        M->com[j] = NULL;
+}
+
+void PROVER_multi_free(PROVER_multi* M){
+
+    arena_free(M->arena);
+    pedersen_zero_pool_free(M->zeros);
+
+    for(int j=0; j<M->copies;++j)
+        permutation_free(M->perm[j]);
+
+    free(M->perm);
+    free(M->views);
+    free(M->com);
+    free(M);
+}
+
+/**
+ * A round in memory
+ * @param summed: Size of the challenge subset
+ * @return Whether the verifier accepts every copy
+ */
+bool zkp_multi_round(PROVER_multi* M, VERIFIER_data* V, int summed){
+
+    PED_commit_vector* com;
+    BN_view* opened;
+    BIT_solution* sol;
+    uint32_t mask;
+    bool accepts = true;
+
+    PROVER_multi_commits(M);
+    mask = VERIFIER_multi_challenge(V,M->copies,summed);
+
+    for(int j=0; j<M->copies && accepts;++j){
+
+        if (mask >> j & 1){
+            sol = PROVER_multi_permuted_solution(M,j);
+            accepts = VERIFIER_homomorphic_sum_round(V,M->com[j],sol) != NULL
+                && VERIFIER_accepts(V,PROVER_multi_sum(M,j));
+        }
+        else{
+            PROVER_multi_opening(M,j,&com,&opened);
+            accepts = VERIFIER_checks_opening(V,com,opened);
+        }
+    }
+
+    PROVER_multi_reset(M);
+
+    return accepts;
+}
+
+#endif
@@ -0,0 +1,503 @@
+#ifndef ZKP_SESSION_H
+#define ZKP_SESSION_H
+
+#include <openssl/bn.h>
+#include <openssl/rand.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "commit_vector.h"
+#include "coupon_pool.h"
+#include "lazy_sum.h"
+#include "merkle.h"
+#include "multiset_hash.h"
+#include "pedersen.h"
+#include "zkp_fixed_size.h"
+#include "zkp_shard.h"
+#include "zkp_variable_size.h"
+
+/*
+Prover and verifier sessions for the variable-size protocol.
+
+A session is bound to a parameter set and an instance, and is reused for
+every proof of that statement. Everything whose size only depends on the
+instance (padded view, permutations, solution buffers, result BIGNUMs, the
+lazy accumulator, the BN_CTX) is allocated once when the session is created.
+The commitment vectors of a round live in the prover's arena, released by
+PROVER_reset. Proving the same statement again reuses all of it.
+
+A round, with index the verifier's challenge:
+    PROVER_round_commits, VERIFIER_challenge,
+    PROVER_opening + VERIFIER_checks_opening,
+    PROVER_permuted_solution + VERIFIER_homomorphic_sum_round,
+    PROVER_sum + VERIFIER_accepts,
+    PROVER_reset
+
+The prover does not send the permutation of the opened vector: the verifier
+checks it against the padded instance with a keyed multiset hash. The key
+is drawn by VERIFIER_new and the digest of the padded instance is cached in
+the session, so each check is one hashing pass over the opened values.
+
+With the Merkle transcript the first message is only the roots of both
+commitment vectors (PROVER_round_roots, VERIFIER_receives_roots). The
+opened vector is sent as values and randomnesses, and the verifier checks
+the root of the commitments it recomputes (VERIFIER_checks_opening_root).
+For the other vector, only the commitments selected by the permuted
+solution are sent, with one multiproof (PROVER_selected_commitments,
+VERIFIER_homomorphic_sum_root).
+
+With shards set (zkp_shard.h), the commitments of the prover, the opening
+check and the homomorphic sum of the verifier run on worker processes. The
+sessions do not own the shards. Several sessions can use the same ones only
+one after the other, from one thread, see zkp_shard.h.
+
+The instance modulus M does not have to be the group order p-1. The integer
+sum of the selected values is then S + carry*M, and carry depends on the
+solution. The instance is padded with bits = ceil(log2 n) carry entries M*2^j
+besides its zeros, and the prover also selects the entries of the bits of
+2^bits-1-carry: the selected commitments open to S + (2^bits-1)*M whatever
+the carry, which is never sent. n+bits of the 2(n+bits) values are selected.
+*/
+
+typedef struct PROVER_data
+{
+    /* data */
+    permutation p1;
+    permutation p2;
+    PED_commit_vector* commitment_1;
+    PED_commit_vector* commitment_2;
+    ZKP_merkle* tree_1;
+    ZKP_merkle* tree_2;
+    KSS_instance* instance;
+
+    PED_params* params;
+    PED_coupon_pool* coupons;
+    PED_zero_pool* zeros;
+    ZKP_shards* shards;
+    BN_CTX* ctx;
+    ZKP_arena* arena;
+    LAZY_acc* acc;
+
+    int len;
+    BN_view padded;
+    BN_view view_1;
+    BN_view view_2;
+    BIT_solution* padded_solution;
+    BIT_solution* permuted_solution;
+    int* selected;
+    BIGNUM** values;        // The instance and its carry entries
+    int carry_bits;
+    int width;              // Size of the padded values
+    BIGNUM* order;
+    BIGNUM* sum;
+} PROVER_data;
+
+typedef struct VERIFIER_data
+{
+    /* data */
+    KSS_instance* instance;
+    PED_params* params;
+    ZKP_shards* shards;
+    BN_CTX* ctx;
+
+    int len;
+    int index;
+    BIGNUM** values;
+    int carry_bits;
+    int width;
+    BN_view padded;
+    MSET_key* mset_key;
+    MSET_digest padded_digest;
+    BIGNUM* commitment_to_sum;
+    BIGNUM* target;
+    BIGNUM** gathered;      // Opening checks: the opened values,
+    BIGNUM** cs;            // the c then the s of their commitments
+
+    // Merkle transcript
+    unsigned char root[2][MERKLE_HASH_BYTES];
+    int words;
+    unsigned char* leaf_buf;
+    int* idx;
+    int* all;
+} VERIFIER_data;
+
+/**
+ * Creates a prover session
+ * @param params: Pedersen parameters, precomputed tables included
+ * @param inst: The instance whose solution is proven
+ * @param coupons: Shared coupon pool, may be NULL
+ */
+PROVER_data* PROVER_new(PED_params* params, KSS_instance* inst, PED_coupon_pool* coupons){
+
+    PROVER_data* P = (PROVER_data*) malloc(sizeof(PROVER_data));
+    int n = inst->n;
+    int bits = kss_carry_bits(inst,params->p);
+
+    P->instance = inst;
+    P->params = params;
+    P->coupons = coupons;
+    P->shards = NULL;
+    P->ctx = BN_CTX_new();
+    P->carry_bits = bits;
+    P->width = kss_padded_width(inst,bits);
+    P->len = 2*(n+bits);
+    // Two vectors of len commitments and their scratch
+    P->arena = arena_new(2*2*P->len*BN_num_bytes(params->p)+ARENA_DEFAULT_SIZE);
+
+    // Randomnesses add up modulo the group order, whatever the instance modulus
+    P->order = BN_dup(params->p);
+    BN_sub_word(P->order,1);
+    P->acc = lazy_acc_new(BN_num_bits(P->order));
+
+    P->zeros = pedersen_zero_pool_new(P->len);
+    P->values = pad_with_carries(inst->a,n,inst->M,bits);
+    P->padded = view_init(P->values,n+bits,NULL,P->len);
+    P->padded_solution = pad_with_carries_bitsol(inst->solution,n,inst->k,bits,bits > 0 ? kss_carry(inst,P->ctx) : 0);
+    P->permuted_solution = bitsol_new(P->len);
+    P->selected = (int*) malloc(sizeof(int)*P->len);
+    P->p1 = permutation_init(P->len);
+    P->p2 = permutation_init(P->len);
+    P->view_1 = view_permute(&P->padded,P->p1);
+    P->view_2 = view_permute(&P->padded,P->p2);
+    P->commitment_1 = NULL;
+    P->commitment_2 = NULL;
+    P->tree_1 = NULL;
+    P->tree_2 = NULL;
+    P->sum = BN_new();
+
+    return P;
+}
+
+/**
+ * Offline work for the next proof: refills the commitments to zero
+ */
+void PROVER_precompute(PROVER_data* P){
+    pedersen_zero_pool_fill(P->zeros,P->params,P->ctx);
+}
+
+/**
+ * First step: draws the two permutations and commits to both permuted instances
+ */
+void PROVER_round_commits(PROVER_data* P){
+
+    // The views keep pointing at p1 and p2, shuffled in place
+    permutation_randomize(P->p1,P->len);
+    permutation_randomize(P->p2,P->len);
+
+    if (P->shards != NULL && P->len <= P->shards->capacity){
+        P->commitment_1 = PROVER_commits_sharded(P->shards,P->arena,&P->view_1);
+        P->commitment_2 = PROVER_commits_sharded(P->shards,P->arena,&P->view_2);
+        return;
+    }
+
+    P->commitment_1 = PROVER_commits_variable(P->arena,&P->view_1,P->params,P->zeros,P->coupons,P->ctx);
+    P->commitment_2 = PROVER_commits_variable(P->arena,&P->view_2,P->params,P->zeros,P->coupons,P->ctx);
+}
+
+/**
+ * First step of the Merkle transcript, after PROVER_round_commits: the roots
+ * of both commitment vectors, sent instead of the vectors
+ */
+void PROVER_round_roots(PROVER_data* P, unsigned char* root_1, unsigned char* root_2){
+
+    size_t stride = P->commitment_1->words*8;
+
+    P->tree_1 = merkle_build(P->arena,(const unsigned char*) P->commitment_1->c,stride,stride,P->len);
+    P->tree_2 = merkle_build(P->arena,(const unsigned char*) P->commitment_2->c,stride,stride,P->len);
+
+    memcpy(root_1,merkle_root(P->tree_1),MERKLE_HASH_BYTES);
+    memcpy(root_2,merkle_root(P->tree_2),MERKLE_HASH_BYTES);
+}
+
+/**
+ * Third step: what the prover reveals for challenge index
+ * @param com: The commitments to open
+ * @param opened: The committed values, in committed order
+ */
+void PROVER_opening(PROVER_data* P, int index, PED_commit_vector** com, BN_view** opened){
+
+    *com = index == 0 ? P->commitment_1 : P->commitment_2;
+    *opened = index == 0 ? &P->view_1 : &P->view_2;
+}
+
+/**
+ * Fifth step: the solution permuted like the commitments that stay closed
+ */
+BIT_solution* PROVER_permuted_solution(PROVER_data* P, int index){
+    return permutation_apply_bitsol_into(P->permuted_solution,P->padded_solution,index == 0 ? P->p2 : P->p1);
+}
+
+/**
+ * Fifth step of the Merkle transcript, after PROVER_permuted_solution: the
+ * closed commitments selected by the solution and their multiproof
+ * @param selected: The selected commitments, only their c values are sent
+ * @param proof: The multiproof
+ * @return Number of hashes in the multiproof
+ */
+int PROVER_selected_commitments(PROVER_data* P, int index, PED_commit_vector** selected, unsigned char** proof){
+
+    PED_commit_vector* leftover = index == 0 ? P->commitment_2 : P->commitment_1;
+    ZKP_merkle* tree = index == 0 ? P->tree_2 : P->tree_1;
+    int* idx = P->selected;
+    int k = bitsol_indices(P->permuted_solution,idx);
+
+    *selected = commit_vector_new(P->arena,k,P->params->p);
+
+    for(int j=0; j<k;++j)
+        memcpy(commit_vector_c(*selected,j),commit_vector_c(leftover,idx[j]),leftover->words*8);
+
+    *proof = (unsigned char*) arena_alloc(P->arena,(size_t) merkle_multiproof_bound(tree,k)*MERKLE_HASH_BYTES+1);
+
+    return merkle_multiproof(tree,idx,k,*proof);
+}
+
+/**
+ * Seventh step: sum of the randomnesses of the selected closed commitments
+ */
+BIGNUM* PROVER_sum(PROVER_data* P, int index){
+
+    PED_commit_vector* leftover = index == 0 ? P->commitment_2 : P->commitment_1;
+    int k = bitsol_indices(P->permuted_solution,P->selected);
+
+    lazy_acc_sum_indexed_words(P->acc,P->sum,leftover->s,leftover->words,P->selected,k,P->order,P->ctx);
+
+    return P->sum;
+}
+
+/**
+ * Ends a proof: releases and wipes the commitments of the round
+ */
+void PROVER_reset(PROVER_data* P){
+
+    arena_reset(P->arena);
+    BN_clear(P->sum);
+    P->commitment_1 = NULL;
+    P->commitment_2 = NULL;
+    P->tree_1 = NULL;
+    P->tree_2 = NULL;
+}
+
+void PROVER_free(PROVER_data* P){
+
+    arena_free(P->arena);
+    lazy_acc_free(P->acc);
+    pedersen_zero_pool_free(P->zeros);
+    permutation_free(P->p1);
+    permutation_free(P->p2);
+    bitsol_free(P->padded_solution);
+    bitsol_free(P->permuted_solution);
+    free(P->selected);
+    pad_with_carries_free(P->values,P->instance->n,P->carry_bits);
+    BN_clear_free(P->sum);
+    BN_free(P->order);
+    BN_CTX_free(P->ctx);
+    free(P);
+}
+
+/**
+ * Creates a verifier session
+ * @param params: Pedersen parameters
+ * @param inst: The instance, only its public part (a, S, M) is read
+ */
+VERIFIER_data* VERIFIER_new(PED_params* params, KSS_instance* inst){
+
+    VERIFIER_data* V = (VERIFIER_data*) malloc(sizeof(VERIFIER_data));
+    int bits = kss_carry_bits(inst,params->p);
+
+    V->instance = inst;
+    V->params = params;
+    V->shards = NULL;
+    V->ctx = BN_CTX_new();
+    V->carry_bits = bits;
+    V->width = kss_padded_width(inst,bits);
+    V->len = 2*(inst->n+bits);
+    V->index = -1;
+    V->values = pad_with_carries(inst->a,inst->n,inst->M,bits);
+    V->padded = view_init(V->values,inst->n+bits,NULL,V->len);
+    V->commitment_to_sum = BN_new();
+    V->target = kss_padded_target(BN_new(),inst,bits,V->ctx);
+    V->gathered = (BIGNUM**) malloc(sizeof(BIGNUM*)*3*V->len);
+    V->cs = V->gathered + V->len;
+
+    // Padded values are smaller than 2^bits*M
+    V->mset_key = mset_key_new(V->width);
+    view_multiset_digest(V->mset_key,&V->padded_digest,&V->padded);
+
+    V->words = (BN_num_bytes(params->p)+7)/8;
+    V->leaf_buf = (unsigned char*) malloc((size_t) V->len*V->words*8);
+    V->idx = (int*) malloc(sizeof(int)*V->len);
+    V->all = (int*) malloc(sizeof(int)*V->len);
+
+    for(int i=0; i<V->len;++i)
+        V->all[i] = i;
+
+    return V;
+}
+
+/**
+ * Second step: draws the challenge. Unlike VERIFIER_selects_index it does not
+ * reseed rand, so concurrent sessions draw independent challenges.
+ */
+int VERIFIER_challenge(VERIFIER_data* V){
+
+    unsigned char bit;
+
+    RAND_bytes(&bit,1);
+    ZKP_COUNT(ZKP_CNT_RNG_BYTES,1);
+    V->index = bit & 1;
+
+    return V->index;
+}
+
+/**
+ * Fourth step: checks the opened commitments and that they hold a permutation
+ * of the padded instance
+ */
+bool VERIFIER_checks_opening(VERIFIER_data* V, PED_commit_vector* com, BN_view* opened){
+
+    bool opens;
+
+    if (com->count != V->len || opened->len != V->len)
+        return false;
+
+    if (V->shards != NULL && V->len <= V->shards->capacity)
+        opens = PROVER_opens_sharded(V->shards,com,opened);
+    else
+        opens = PROVER_opens_into(com,opened,V->gathered,V->cs,V->params,V->ctx);
+
+    return opens && VERIFIER_check_multiset(opened,V->mset_key,&V->padded_digest,V->len);
+}
+
+/**
+ * First step of the Merkle transcript: stores the roots sent by the prover
+ */
+void VERIFIER_receives_roots(VERIFIER_data* V, const unsigned char* root_1, const unsigned char* root_2){
+    memcpy(V->root[0],root_1,MERKLE_HASH_BYTES);
+    memcpy(V->root[1],root_2,MERKLE_HASH_BYTES);
+}
+
+/**
+ * Fourth step of the Merkle transcript: recomputes the opened commitments from
+ * the values and randomnesses, checks their root and that they hold a
+ * permutation of the padded instance
+ * @param com: The randomnesses, the c values are not read
+ * @param opened: The committed values
+ */
+bool VERIFIER_checks_opening_root(VERIFIER_data* V, PED_commit_vector* com, BN_view* opened){
+
+    size_t stride = V->words*8;
+    unsigned char root[MERKLE_HASH_BYTES];
+    BIGNUM** values = V->gathered;
+    BIGNUM** c = V->cs;
+    BIGNUM** s = V->cs + V->len;
+
+    if (com->count != V->len || opened->len != V->len || com->words != V->words)
+        return false;
+
+    if (!VERIFIER_check_multiset(opened,V->mset_key,&V->padded_digest,V->len))
+        return false;
+
+    view_gather_into(opened,values);
+
+    BN_CTX_start(V->ctx);
+
+    for(int i=0; i<V->len;++i){
+        c[i] = BN_CTX_get(V->ctx);
+        s[i] = commit_vector_get_s(com,i,BN_CTX_get(V->ctx));
+    }
+
+    pedersen_recommit_batch(c,s,values,V->len,V->params,V->ctx);
+
+    for(int i=0; i<V->len;++i){
+        BN_bn2lebinpad(c[i],V->leaf_buf + (size_t) i*stride,stride);
+        BN_clear(s[i]);
+    }
+
+    BN_CTX_end(V->ctx);
+
+    merkle_root_of(root,V->leaf_buf,stride,stride,V->len);
+
+    return memcmp(root,V->root[V->index],MERKLE_HASH_BYTES) == 0;
+}
+
+/**
+ * Sixth step of the Merkle transcript: checks the selected commitments against
+ * the root of the closed vector, then computes their homomorphic sum
+ * @param selected: The commitments selected by solution, in order
+ * @param solution: The permuted solution
+ * @param proof: Their multiproof
+ * @param nproof: Number of hashes in the multiproof
+ * @return The homomorphic sum, NULL if the multiproof is wrong
+ */
+BIGNUM* VERIFIER_homomorphic_sum_root(VERIFIER_data* V, PED_commit_vector* selected, const BIT_solution* solution, const unsigned char* proof, int nproof){
+
+    size_t stride = V->words*8;
+    unsigned char* leaf;
+    EVP_MD_CTX* md;
+    bool valid;
+    int k;
+
+    // The padded solution always selects n of the 2n elements
+    if (solution->n != V->len || bitsol_weight(solution) != V->len/2)
+        return NULL;
+
+    k = bitsol_indices(solution,V->idx);
+
+    if (selected->count != k || selected->words != V->words)
+        return NULL;
+
+    // The buffer of the opening check is free again, it holds the leaf hashes
+    leaf = V->leaf_buf;
+    md = EVP_MD_CTX_new();
+
+    for(int j=0; j<k;++j)
+        merkle_hash_leaf(md,leaf + (size_t) j*MERKLE_HASH_BYTES,(const unsigned char*) commit_vector_c(selected,j),stride);
+
+    EVP_MD_CTX_free(md);
+
+    valid = merkle_verify_multiproof(V->root[1-V->index],V->len,V->idx,leaf,k,proof,nproof);
+
+    if (!valid)
+        return NULL;
+
+    return VERIFIER_homomorphic_sum_indexed(V->commitment_to_sum,selected,V->all,k,V->params,V->ctx);
+}
+
+/**
+ * Sixth step: homomorphic sum of the closed commitments selected by solution
+ * @return The homomorphic sum, NULL if solution does not have weight n
+ */
+BIGNUM* VERIFIER_homomorphic_sum_round(VERIFIER_data* V, PED_commit_vector* com, const BIT_solution* solution){
+
+    // The padded solution always selects n of the 2n elements
+    if (com->count != V->len || solution->n != V->len || bitsol_weight(solution) != V->len/2)
+        return NULL;
+
+    if (V->shards != NULL && V->len <= V->shards->capacity)
+        return VERIFIER_homomorphic_sum_sharded(V->shards,V->commitment_to_sum,com,solution);
+
+    return VERIFIER_homomorphic_sum_bits(V->commitment_to_sum,com,solution,V->idx,V->params,V->ctx);
+}
+
+/**
+ * Last step: accepts iff sum opens the homomorphic sum to the target
+ */
+bool VERIFIER_accepts(VERIFIER_data* V, BIGNUM* sum){
+    return pedersen_unveil_params(V->commitment_to_sum,sum,V->target,V->params,V->ctx);
+}
+
+void VERIFIER_free(VERIFIER_data* V){
+
+    BN_free(V->commitment_to_sum);
+    BN_free(V->target);
+    pad_with_carries_free(V->values,V->instance->n,V->carry_bits);
+    mset_key_free(V->mset_key);
+    free(V->gathered);
+    free(V->leaf_buf);
+    free(V->idx);
+    free(V->all);
+    BN_CTX_free(V->ctx);
+    free(V);
+}
+
+#endif
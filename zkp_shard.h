@@ -0,0 +1,523 @@
+#ifndef ZKP_SHARD_H
+#define ZKP_SHARD_H
+
+#include <openssl/bn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "arena.h"
+#include "bitsol.h"
+#include "commit_vector.h"
+#include "pedersen.h"
+#include "pedersen_batch.h"
+#include "zkp_config.h"
+#include "zkp_fixed_size.h"
+
+/*
+Sharded commitments, opening checks and homomorphic sums over local worker
+processes.
+
+The coordinator forks the workers once, after the parameters are
+precomputed: the fixed-base and multi-buffer tables are only read from then
+on, so every worker reads the pages of the coordinator, never copied. The
+vectors of a job go through one shared anonymous mapping, sized for the
+largest vector: the coordinator writes the values (and commitments), sends
+each worker the range it owns over a socket, and the workers write back
+their commitments, their first failed opening or their partial product in
+the mapping. The coordinator merges the partial products.
+
+A worker that dies does not take the proof down: the coordinator notices
+the closed socket, computes the range of the worker itself, and does so for
+that range from then on. Workers are not forked again, forking once other
+threads run (the coupon threads) could deadlock the child on a lock they
+held.
+
+The mapping and the sockets hold one job at a time, and nothing locks them:
+the callers of shards_dispatch must run one after the other, from one thread.
+
+Create the shards before starting any thread. Commitments to zero are
+fresh, the workers do not see the pools of the coordinator. Without fork
+(Windows) or with 0 workers, jobs run in the coordinator.
+*/
+
+typedef enum zkp_shard_op
+{
+    ZKP_SHARD_COMMIT = 0,   // Commitments to m, into c and s
+    ZKP_SHARD_OPEN,         // First wrong opening of (c, s) to m
+    ZKP_SHARD_PRODUCT       // Product of the c selected by idx
+} ZKP_shard_op;
+
+typedef struct zkp_shard_job
+{
+    /* data */
+    int op;
+    int worker;             // Slot of the result
+    int lo;
+    int hi;
+} ZKP_shard_job;
+
+typedef struct zkp_shards
+{
+    /* data */
+    PED_params* params;
+    BN_CTX* ctx;
+    int workers;
+    int capacity;
+    int words;
+
+    int fd[ZKP_MAX_SHARDS];         // Coordinator end of each socket, -1 once the worker died
+    int pid[ZKP_MAX_SHARDS];
+
+    // Shared mapping
+    void* region;
+    size_t region_size;
+    uint64_t* m;                    // Values, capacity entries of words
+    uint64_t* c;
+    uint64_t* s;
+    uint64_t* partial;              // Partial product of each worker
+    int* failed;                    // First wrong opening of each worker
+    int* idx;                       // Selected positions of a product
+    unsigned char* zero;            // Padding positions of a commitment job
+} ZKP_shards;
+
+/**
+ * Runs the range of a job, in a worker or in the coordinator
+ */
+void shard_run(ZKP_shards* sh, const ZKP_shard_job* job, BN_CTX* ctx){
+
+    PED_params* params = sh->params;
+    int count = job->hi - job->lo;
+    size_t first = (size_t) job->lo*sh->words;
+    PED_commit_vector v;
+    BIGNUM** m;
+    BIGNUM** c;
+    BIGNUM** s;
+    BIGNUM* prod;
+    int* slots;
+    int nvalues = 0, failed;
+
+    // The range as a vector, over the mapping
+    v.count = count;
+    v.words = sh->words;
+    v.c = sh->c + first;
+    v.s = sh->s + first;
+
+    switch (job->op){
+
+        case ZKP_SHARD_COMMIT:
+            m = (BIGNUM**) malloc(sizeof(BIGNUM*)*count);
+            slots = (int*) malloc(sizeof(int)*count);
+
+            BN_CTX_start(ctx);
+
+            for(int i=0; i<count;++i){
+                if (sh->zero[job->lo+i])
+                    commit_vector_take(&v,i,pedersen_commit_zero_fresh(params,ctx));
+                else{
+                    m[nvalues] = BN_lebin2bn((const unsigned char*) (sh->m + first + (size_t) i*sh->words),sh->words*8,BN_CTX_get(ctx));
+                    slots[nvalues++] = i;
+                }
+            }
+
+            pedersen_commit_batch(&v,slots,m,nvalues,params,NULL,ctx);
+
+            BN_CTX_end(ctx);
+
+            free(m);
+            free(slots);
+            break;
+
+        case ZKP_SHARD_OPEN:
+            m = (BIGNUM**) malloc(sizeof(BIGNUM*)*count*3);
+            c = m + count;
+            s = c + count;
+
+            BN_CTX_start(ctx);
+
+            for(int i=0; i<count;++i){
+                m[i] = BN_lebin2bn((const unsigned char*) (sh->m + first + (size_t) i*sh->words),sh->words*8,BN_CTX_get(ctx));
+                c[i] = commit_vector_get_c(&v,i,BN_CTX_get(ctx));
+                s[i] = commit_vector_get_s(&v,i,BN_CTX_get(ctx));
+            }
+
+            failed = pederesen_unveil_batch(c,s,m,count,params,ctx);
+            sh->failed[job->worker] = failed < 0 ? -1 : job->lo + failed;
+
+            for(int i=0; i<count;++i)
+                BN_clear(s[i]);
+
+            BN_CTX_end(ctx);
+
+            free(m);
+            break;
+
+        case ZKP_SHARD_PRODUCT:
+            // The range is over idx, the commitments are the whole mapping
+            v.count = sh->capacity;
+            v.c = sh->c;
+            v.s = sh->s;
+
+            BN_CTX_start(ctx);
+            prod = BN_CTX_get(ctx);
+
+            VERIFIER_homomorphic_sum_indexed(prod,&v,sh->idx + job->lo,count,params,ctx);
+            BN_bn2lebinpad(prod,(unsigned char*) (sh->partial + (size_t) job->worker*sh->words),sh->words*8);
+
+            BN_CTX_end(ctx);
+            break;
+    }
+}
+
+#ifndef _WIN32
+
+bool shard_send(int fd, const void* buf, size_t len){
+
+    const char* p = (const char*) buf;
+    ssize_t r;
+
+    while (len > 0){
+
+        // A dead worker must not kill the coordinator with SIGPIPE
+        if ((r = send(fd,p,len,MSG_NOSIGNAL)) <= 0)
+            return false;
+
+        p += r;
+        len -= r;
+    }
+
+    return true;
+}
+
+bool shard_recv(int fd, void* buf, size_t len){
+
+    char* p = (char*) buf;
+    ssize_t r;
+
+    while (len > 0){
+
+        if ((r = recv(fd,p,len,0)) <= 0)
+            return false;
+
+        p += r;
+        len -= r;
+    }
+
+    return true;
+}
+
+/**
+ * Loop of a worker process: runs the jobs received until the coordinator
+ * closes its socket
+ */
+void shard_worker_main(ZKP_shards* sh, int fd){
+
+    BN_CTX* ctx = BN_CTX_new();
+    ZKP_shard_job job;
+    unsigned char done = 1;
+
+    while (shard_recv(fd,&job,sizeof(ZKP_shard_job))){
+
+        shard_run(sh,&job,ctx);
+
+        if (!shard_send(fd,&done,1))
+            break;
+    }
+
+    BN_CTX_free(ctx);
+    _exit(0);
+}
+
+#endif
+
+/**
+ * Maps the shared vectors and forks the workers
+ * @param params: Pedersen parameters, precomputed before the call
+ * @param workers: Number of worker processes, 0 to run the jobs in the caller
+ * @param capacity: Largest vector of a job, the length of the padded instance
+ * @return NULL if the mapping fails
+ */
+ZKP_shards* shards_new(PED_params* params, int workers, int capacity){
+
+    ZKP_shards* sh = (ZKP_shards*) malloc(sizeof(ZKP_shards));
+    size_t vec, off;
+    unsigned char* base;
+
+    sh->params = params;
+    sh->ctx = BN_CTX_new();
+    sh->words = (BN_num_bytes(params->p)+7)/8;
+    sh->capacity = capacity;
+    sh->workers = workers < 0 ? 0 : workers > ZKP_MAX_SHARDS ? ZKP_MAX_SHARDS : workers;
+
+#ifdef _WIN32
+    sh->workers = 0;
+#endif
+
+    vec = sizeof(uint64_t)*sh->words*capacity;
+    sh->region_size = 3*vec + sizeof(uint64_t)*sh->words*ZKP_MAX_SHARDS + sizeof(int)*ZKP_MAX_SHARDS + sizeof(int)*capacity + capacity;
+
+#ifdef _WIN32
+    sh->region = calloc(1,sh->region_size);
+#else
+    sh->region = mmap(NULL,sh->region_size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_ANONYMOUS,-1,0);
+
+    if (sh->region == MAP_FAILED)
+        sh->region = NULL;
+#endif
+
+    if (sh->region == NULL){
+        BN_CTX_free(sh->ctx);
+        free(sh);
+        return NULL;
+    }
+
+    base = (unsigned char*) sh->region;
+    sh->m = (uint64_t*) base;
+    sh->c = (uint64_t*) (base + vec);
+    sh->s = (uint64_t*) (base + 2*vec);
+    off = 3*vec;
+    sh->partial = (uint64_t*) (base + off);
+    off += sizeof(uint64_t)*sh->words*ZKP_MAX_SHARDS;
+    sh->failed = (int*) (base + off);
+    off += sizeof(int)*ZKP_MAX_SHARDS;
+    sh->idx = (int*) (base + off);
+    off += sizeof(int)*capacity;
+    sh->zero = base + off;
+
+#ifndef _WIN32
+    for(int w=0; w<sh->workers;++w){
+
+        int pair[2];
+
+        sh->fd[w] = -1;
+        sh->pid[w] = -1;
+
+        if (socketpair(AF_UNIX,SOCK_STREAM,0,pair) != 0)
+            continue;
+
+        fflush(stdout);
+
+        if ((sh->pid[w] = fork()) == 0){
+
+            // The sockets of the other workers belong to the coordinator
+            for(int j=0; j<w;++j){
+                if (sh->fd[j] >= 0)
+                    close(sh->fd[j]);
+            }
+
+            close(pair[0]);
+            shard_worker_main(sh,pair[1]);
+        }
+
+        close(pair[1]);
+
+        if (sh->pid[w] < 0)
+            close(pair[0]);
+        else
+            sh->fd[w] = pair[0];
+    }
+#endif
+
+    return sh;
+}
+
+/**
+ * Number of workers still running
+ */
+int shards_alive(const ZKP_shards* sh){
+
+    int alive = 0;
+
+    for(int w=0; w<sh->workers;++w)
+        alive += sh->fd[w] >= 0;
+
+    return alive;
+}
+
+/**
+ * Splits count items of a job between the workers and waits for all of them.
+ * The ranges of the dead workers are run by the caller.
+ */
+void shards_dispatch(ZKP_shards* sh, ZKP_shard_op op, int count){
+
+    int workers = sh->workers > 0 ? sh->workers : 1;
+    ZKP_shard_job job[ZKP_MAX_SHARDS];
+    bool sent[ZKP_MAX_SHARDS];
+
+    for(int w=0; w<workers;++w){
+
+        job[w].op = op;
+        job[w].worker = w;
+        job[w].lo = (int) ((long) count*w/workers);
+        job[w].hi = (int) ((long) count*(w+1)/workers);
+        sent[w] = false;
+
+#ifndef _WIN32
+        if (sh->workers > 0 && sh->fd[w] >= 0 && job[w].hi > job[w].lo)
+            sent[w] = shard_send(sh->fd[w],&job[w],sizeof(ZKP_shard_job));
+#endif
+    }
+
+    for(int w=0; w<workers;++w){
+
+#ifndef _WIN32
+        unsigned char done;
+
+        if (sent[w] && shard_recv(sh->fd[w],&done,1))
+            continue;
+
+        if (sent[w] || (sh->workers > 0 && sh->fd[w] >= 0 && job[w].hi > job[w].lo)){
+            printf("Shard worker %d died, its range runs in the coordinator\n",w);
+            close(sh->fd[w]);
+            waitpid(sh->pid[w],NULL,0);
+            sh->fd[w] = -1;
+        }
+#endif
+
+        if (job[w].hi > job[w].lo)
+            shard_run(sh,&job[w],sh->ctx);
+        else if (op == ZKP_SHARD_PRODUCT)
+            BN_bn2lebinpad(BN_value_one(),(unsigned char*) (sh->partial + (size_t) w*sh->words),sh->words*8);
+        else if (op == ZKP_SHARD_OPEN)
+            sh->failed[w] = -1;
+    }
+}
+
+/**
+ * Writes the values of a view to the mapping, with the padding positions
+ */
+void shards_load_values(ZKP_shards* sh, BN_view* a){
+
+    for(int i=0; i<a->len;++i){
+        sh->zero[i] = view_source(a,i) < 0;
+        BN_bn2lebinpad(view_get(a,i),(unsigned char*) (sh->m + (size_t) i*sh->words),sh->words*8);
+    }
+}
+
+/**
+ * PROVER_commits_variable on the workers
+ * @param arena: arena of the proof, owning the returned vector
+ * @param a: view of the padded instance, at most capacity values
+ */
+PED_commit_vector* PROVER_commits_sharded(ZKP_shards* sh, ZKP_arena* arena, BN_view* a){
+
+    PED_commit_vector* commitments = commit_vector_new(arena,a->len,sh->params->p);
+    size_t bytes = sizeof(uint64_t)*sh->words*a->len;
+
+    shards_load_values(sh,a);
+    shards_dispatch(sh,ZKP_SHARD_COMMIT,a->len);
+
+    memcpy(commitments->c,sh->c,bytes);
+    memcpy(commitments->s,sh->s,bytes);
+
+    // The randomnesses do not outlive the job in the mapping
+    memset(sh->s,0,bytes);
+
+    return commitments;
+}
+
+/**
+ * PROVER_opens_variable on the workers
+ * @param com: the commitments and their randomnesses, at most capacity
+ * @param a: view of the padded values the prover committed to
+ */
+bool PROVER_opens_sharded(ZKP_shards* sh, PED_commit_vector* com, BN_view* a){
+
+    size_t bytes = sizeof(uint64_t)*sh->words*com->count;
+    int workers = sh->workers > 0 ? sh->workers : 1;
+    int failed = -1;
+
+    if (com->count != a->len || com->words != sh->words)
+        return false;
+
+    shards_load_values(sh,a);
+    memcpy(sh->c,com->c,bytes);
+    memcpy(sh->s,com->s,bytes);
+
+    shards_dispatch(sh,ZKP_SHARD_OPEN,com->count);
+
+    memset(sh->s,0,bytes);
+
+    // Ranges are in order, the first failure is in the first failed range
+    for(int w=0; w<workers && failed < 0;++w)
+        failed = sh->failed[w];
+
+    if (failed >= 0){
+        printf("Failed opening %d-th commitment.\n",failed);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * VERIFIER_homomorphic_sum_bits on the workers: each multiplies its share of
+ * the selected commitments, the partial products are merged here
+ * @param prod: Where to store the result
+ * @param c: Commitments, only their c values are read
+ * @param solution: Permuted solution
+ */
+BIGNUM* VERIFIER_homomorphic_sum_sharded(ZKP_shards* sh, BIGNUM* prod, PED_commit_vector* c, const BIT_solution* solution){
+
+    int workers = sh->workers > 0 ? sh->workers : 1;
+    int k;
+
+    if (c->count > sh->capacity || c->words != sh->words)
+        return NULL;
+
+    k = bitsol_indices(solution,sh->idx);
+    memcpy(sh->c,c->c,sizeof(uint64_t)*sh->words*c->count);
+
+    shards_dispatch(sh,ZKP_SHARD_PRODUCT,k);
+
+    BN_CTX_start(sh->ctx);
+
+    BIGNUM* x = BN_CTX_get(sh->ctx);
+
+    BN_one(prod);
+
+    for(int w=0; w<workers;++w){
+        BN_lebin2bn((const unsigned char*) (sh->partial + (size_t) w*sh->words),sh->words*8,x);
+        pedersen_mod_mul(prod,prod,x,sh->params,sh->ctx);
+    }
+
+    BN_CTX_end(sh->ctx);
+
+    return prod;
+}
+
+/**
+ * Stops the workers and unmaps the shared vectors
+ */
+void shards_free(ZKP_shards* sh){
+
+#ifndef _WIN32
+    // Workers exit on the end of their socket
+    for(int w=0; w<sh->workers;++w){
+        if (sh->fd[w] >= 0){
+            close(sh->fd[w]);
+            waitpid(sh->pid[w],NULL,0);
+        }
+    }
+
+    memset(sh->region,0,sh->region_size);
+    munmap(sh->region,sh->region_size);
+#else
+    free(sh->region);
+#endif
+
+    BN_CTX_free(sh->ctx);
+    free(sh);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef ZKP_TIMER_H
+#define ZKP_TIMER_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+Portable monotonic clock, for timings that mean the same on every build.
+The cycle counter depends on the CPU frequency and does not exist on every
+target, nanoseconds of wall time do.
+*/
+
+/**
+ * Monotonic time in nanoseconds, from an arbitrary origin
+ */
+uint64_t zkp_now_ns(){
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+
+    QueryPerformanceCounter(&t);
+
+    // Split to keep the product from overflowing
+    return (uint64_t) (t.QuadPart / freq.QuadPart) * 1000000000ull
+        + (uint64_t) (t.QuadPart % freq.QuadPart) * 1000000000ull / (uint64_t) freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+
+    return (uint64_t) ts.tv_sec*1000000000ull + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+/**
+ * Milliseconds elapsed since start, a value of zkp_now_ns
+ */
+double zkp_elapsed_ms(uint64_t start){
+    return (zkp_now_ns() - start)/1e6;
+}
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef ZKP_TRACE_H
+#define ZKP_TRACE_H
+
+#include <openssl/crypto.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zkp_timer.h"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define ZKP_HAVE_MALLINFO2
+#endif
+
+/*
+Operation counters and tracing spans, compiled in with -DZKP_TRACE.
+
+Without ZKP_TRACE the ZKP_COUNT and ZKP_SPAN macros expand to nothing and
+the hot paths are unchanged. The functions stay available, so callers do not
+need #ifdefs: snapshots read zero and the trace file has no event.
+
+Counters are kept per thread, in a block registered on first use and never
+freed, so the counts of finished threads stay in the totals. Incrementing
+one is a thread-local add, without lock nor atomic.
+
+A span records its name, start, duration, thread and the counter deltas of
+its thread between begin and end:
+
+    ZKP_SPAN_BEGIN(s,"step.name");
+    ...
+    ZKP_SPAN_END(s);
+
+Spans are kept in memory, up to ZKP_TRACE_MAX_EVENTS, and written as Chrome
+trace JSON (chrome://tracing, ui.perfetto.dev) by zkp_trace_write_json.
+
+Allocations are counted by a hook on OpenSSL's allocator, which covers the
+BIGNUMs and their limbs. It must be installed by zkp_trace_init before
+OpenSSL allocates anything, that is first thing in main. The hook keeps the
+size of every block in a header, so each thread also knows the bytes it
+holds, live, and their highest value, peak. A span reports the live bytes
+it left behind and its peak above the bytes live at its start. A block
+freed by another thread than its own counts on the thread that frees it,
+whose live bytes can then go below zero: the coupon threads fill blocks
+the proof frees.
+
+The mallocs of the project do not go through OpenSSL. They are seen in the
+bytes in use of the whole heap, read from the C library where it tells
+them (glibc), with or without ZKP_TRACE. A memory window measures both
+over a proof or a step, see zkp_mem_begin.
+*/
+
+#define ZKP_TRACE_MAX_EVENTS 65536
+
+typedef enum zkp_counter
+{
+    ZKP_CNT_MODEXP = 0,     // Modular exponentiations
+    ZKP_CNT_MODMUL,         // Modular multiplications outside exponentiations
+    ZKP_CNT_ALLOC,          // OpenSSL heap allocations, BIGNUMs included
+    ZKP_CNT_ALLOC_BYTES,    // Bytes of these allocations, growths of reallocations included
+    ZKP_CNT_FREE,           // OpenSSL heap blocks freed
+    ZKP_CNT_RNG_BYTES,      // Bytes drawn from the OpenSSL RNG
+    ZKP_CNT_BYTES_SENT,     // Bytes of the protocol frames built
+    ZKP_CNT_BYTES_RECV,     // Bytes of the protocol frames parsed
+    ZKP_CNT_COUNT
+} ZKP_counter;
+
+const char* zkp_counter_names[ZKP_CNT_COUNT] = {"modexp","modmul","alloc","alloc_bytes","free","rng_bytes","bytes_sent","bytes_recv"};
+
+typedef struct zkp_trace_counters
+{
+    /* data */
+    uint64_t c[ZKP_CNT_COUNT];
+} ZKP_trace_counters;
+
+typedef struct zkp_trace_thread
+{
+    /* data */
+    ZKP_trace_counters counters;
+    int64_t live;           // OpenSSL bytes allocated minus freed by the thread
+    int64_t peak;           // Highest live since the innermost open window
+    int tid;
+    struct zkp_trace_thread* next;
+} ZKP_trace_thread;
+
+/*
+Memory used between zkp_mem_begin and zkp_mem_end, on the calling thread
+*/
+typedef struct zkp_mem_window
+{
+    /* data */
+    ZKP_trace_thread* thread;
+    ZKP_trace_counters at_start;
+    int64_t live;
+    int64_t saved_peak;
+    int64_t heap;
+} ZKP_mem_window;
+
+typedef struct zkp_mem_stats
+{
+    /* data */
+    uint64_t allocs;        // OpenSSL allocations
+    uint64_t frees;         // OpenSSL blocks freed
+    uint64_t bytes;         // Bytes allocated by OpenSSL
+    int64_t live;           // OpenSSL bytes left allocated
+    int64_t peak;           // Highest OpenSSL bytes held above the start
+    int64_t heap;           // Growth of the heap in use, mallocs of the project included
+    bool has_heap;          // False where the C library does not report the heap
+} ZKP_mem_stats;
+
+typedef struct zkp_span
+{
+    /* data */
+    const char* name;
+    uint64_t start;
+    ZKP_mem_window mem;
+} ZKP_span;
+
+typedef struct zkp_trace_event
+{
+    /* data */
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+    int tid;
+    ZKP_trace_counters delta;
+    int64_t live;
+    int64_t peak;
+} ZKP_trace_event;
+
+pthread_key_t zkp_trace_key;
+pthread_once_t zkp_trace_once = PTHREAD_ONCE_INIT;
+pthread_mutex_t zkp_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+ZKP_trace_thread* zkp_trace_threads = NULL;
+ZKP_trace_event* zkp_trace_events = NULL;
+int zkp_trace_nevents = 0;
+unsigned long zkp_trace_dropped = 0;
+uint64_t zkp_trace_origin = 0;
+
+#ifdef ZKP_TRACE
+#define ZKP_COUNT(counter,n) (zkp_trace_thread()->counters.c[counter] += (uint64_t) (n))
+#define ZKP_SPAN_BEGIN(s,name) ZKP_span s = zkp_span_begin(name)
+#define ZKP_SPAN_END(s) zkp_span_end(&s)
+#else
+#define ZKP_COUNT(counter,n) ((void) 0)
+#define ZKP_SPAN_BEGIN(s,name)
+#define ZKP_SPAN_END(s)
+#endif
+
+void zkp_trace_key_init(){
+    pthread_key_create(&zkp_trace_key,NULL);
+}
+
+/**
+ * Returns the counters of the calling thread, registered on first use
+ */
+ZKP_trace_thread* zkp_trace_thread(){
+
+    ZKP_trace_thread* t;
+
+    pthread_once(&zkp_trace_once,zkp_trace_key_init);
+
+    t = (ZKP_trace_thread*) pthread_getspecific(zkp_trace_key);
+
+    if (t == NULL){
+        // Plain calloc: the allocation hook counts into this block
+        t = (ZKP_trace_thread*) calloc(1,sizeof(ZKP_trace_thread));
+        pthread_setspecific(zkp_trace_key,t);
+
+        pthread_mutex_lock(&zkp_trace_lock);
+        t->tid = zkp_trace_threads != NULL ? zkp_trace_threads->tid+1 : 1;
+        t->next = zkp_trace_threads;
+        zkp_trace_threads = t;
+        pthread_mutex_unlock(&zkp_trace_lock);
+    }
+
+    return t;
+}
+
+// Size header in front of the OpenSSL blocks, keeping their alignment
+#define ZKP_MEM_HEADER 16
+
+void zkp_mem_account(int64_t bytes){
+
+    ZKP_trace_thread* t = zkp_trace_thread();
+
+    t->live += bytes;
+
+    if (t->live > t->peak)
+        t->peak = t->live;
+}
+
+void* zkp_trace_malloc(size_t n, const char* file, int line){
+
+    unsigned char* p = (unsigned char*) malloc(n+ZKP_MEM_HEADER);
+    ZKP_trace_thread* t = zkp_trace_thread();
+
+    // The call site OpenSSL passes is not recorded
+    (void) file;
+    (void) line;
+
+    if (p == NULL)
+        return NULL;
+
+    *(size_t*) p = n;
+
+    t->counters.c[ZKP_CNT_ALLOC]++;
+    t->counters.c[ZKP_CNT_ALLOC_BYTES] += n;
+    zkp_mem_account((int64_t) n);
+
+    return p+ZKP_MEM_HEADER;
+}
+
+void* zkp_trace_realloc(void* p, size_t n, const char* file, int line){
+
+    unsigned char* q;
+    size_t old;
+
+    (void) file;
+    (void) line;
+
+    if (p == NULL)
+        return zkp_trace_malloc(n,file,line);
+
+    q = (unsigned char*) p-ZKP_MEM_HEADER;
+    old = *(size_t*) q;
+
+    if ((q = (unsigned char*) realloc(q,n+ZKP_MEM_HEADER)) == NULL)
+        return NULL;
+
+    *(size_t*) q = n;
+
+    if (n > old)
+        zkp_trace_thread()->counters.c[ZKP_CNT_ALLOC_BYTES] += n-old;
+
+    zkp_mem_account((int64_t) n-(int64_t) old);
+
+    return q+ZKP_MEM_HEADER;
+}
+
+void zkp_trace_free(void* p, const char* file, int line){
+
+    unsigned char* q;
+
+    (void) file;
+    (void) line;
+
+    if (p == NULL)
+        return;
+
+    q = (unsigned char*) p-ZKP_MEM_HEADER;
+
+    zkp_trace_thread()->counters.c[ZKP_CNT_FREE]++;
+    zkp_mem_account(-(int64_t) *(size_t*) q);
+
+    free(q);
+}
+
+/**
+ * Bytes in use in the heap of the process, -1 where the C library does not
+ * report them
+ */
+int64_t zkp_heap_in_use(){
+#ifdef ZKP_HAVE_MALLINFO2
+    struct mallinfo2 mi = mallinfo2();
+
+    // Small blocks, and the large ones mapped on their own
+    return (int64_t) (mi.uordblks + mi.hblkhd);
+#else
+    return -1;
+#endif
+}
+
+/**
+ * Starts the clock of the trace and hooks the OpenSSL allocator. A no-op
+ * without ZKP_TRACE.
+ * @return false if OpenSSL already allocated, allocations are then not counted
+ */
+bool zkp_trace_init(){
+#ifdef ZKP_TRACE
+    zkp_trace_origin = zkp_now_ns();
+
+    return CRYPTO_set_mem_functions(zkp_trace_malloc,zkp_trace_realloc,zkp_trace_free) == 1;
+#else
+    return true;
+#endif
+}
+
+/**
+ * Opens a memory window on the calling thread. Windows of a thread must be
+ * closed in the reverse order they were opened.
+ * @param heap: Whether to read the heap in use, which locks the allocator
+ */
+void zkp_mem_begin(ZKP_mem_window* w, bool heap){
+
+    w->thread = zkp_trace_thread();
+    w->at_start = w->thread->counters;
+    w->live = w->thread->live;
+    w->saved_peak = w->thread->peak;
+    w->heap = heap ? zkp_heap_in_use() : -1;
+
+    w->thread->peak = w->thread->live;
+}
+
+/**
+ * Closes the window
+ * @param out: Memory used in the window. The OpenSSL figures are zero
+ * without ZKP_TRACE.
+ */
+void zkp_mem_end(ZKP_mem_window* w, ZKP_mem_stats* out){
+
+    ZKP_trace_thread* t = w->thread;
+    int64_t heap = w->heap >= 0 ? zkp_heap_in_use() : -1;
+
+    out->allocs = t->counters.c[ZKP_CNT_ALLOC] - w->at_start.c[ZKP_CNT_ALLOC];
+    out->frees = t->counters.c[ZKP_CNT_FREE] - w->at_start.c[ZKP_CNT_FREE];
+    out->bytes = t->counters.c[ZKP_CNT_ALLOC_BYTES] - w->at_start.c[ZKP_CNT_ALLOC_BYTES];
+    out->live = t->live - w->live;
+    out->peak = t->peak - w->live;
+    out->has_heap = heap >= 0;
+    out->heap = out->has_heap ? heap - w->heap : 0;
+
+    // The enclosing window saw this peak too
+    if (w->saved_peak > t->peak)
+        t->peak = w->saved_peak;
+}
+
+/**
+ * Prints the memory used in a window, on one line
+ */
+void zkp_mem_print(const char* label, const ZKP_mem_stats* m){
+
+    printf("%s:",label);
+
+#ifdef ZKP_TRACE
+    printf(" %llu allocs, %llu frees, peak %lld B, live %+lld B,",(unsigned long long) m->allocs,(unsigned long long) m->frees,(long long) m->peak,(long long) m->live);
+#endif
+
+    if (m->has_heap)
+        printf(" heap %+lld B",(long long) m->heap);
+    else
+        printf(" heap n/a");
+
+    puts("");
+}
+
+/**
+ * Sum of the counters of every thread so far
+ */
+void zkp_trace_snapshot(ZKP_trace_counters* out){
+
+    memset(out,0,sizeof(ZKP_trace_counters));
+
+    pthread_mutex_lock(&zkp_trace_lock);
+
+    for(ZKP_trace_thread* t = zkp_trace_threads; t != NULL; t = t->next){
+        for(int i=0; i<ZKP_CNT_COUNT;++i)
+            out->c[i] += t->counters.c[i];
+    }
+
+    pthread_mutex_unlock(&zkp_trace_lock);
+}
+
+/**
+ * Zeroes the counters and drops the recorded spans. Other threads must be
+ * idle.
+ */
+void zkp_trace_reset(){
+
+    pthread_mutex_lock(&zkp_trace_lock);
+
+    // Live bytes are not counters, blocks held stay held
+    for(ZKP_trace_thread* t = zkp_trace_threads; t != NULL; t = t->next)
+        memset(&t->counters,0,sizeof(ZKP_trace_counters));
+
+    zkp_trace_nevents = 0;
+    zkp_trace_dropped = 0;
+
+    pthread_mutex_unlock(&zkp_trace_lock);
+}
+
+ZKP_span zkp_span_begin(const char* name){
+
+    ZKP_span s;
+
+    s.name = name;
+    zkp_mem_begin(&s.mem,false);
+    s.start = zkp_now_ns();
+
+    return s;
+}
+
+void zkp_span_end(ZKP_span* s){
+
+    uint64_t end = zkp_now_ns();
+    ZKP_trace_thread* t = s->mem.thread;
+    ZKP_trace_event* e;
+    ZKP_mem_stats m;
+
+    zkp_mem_end(&s->mem,&m);
+
+    pthread_mutex_lock(&zkp_trace_lock);
+
+    if (zkp_trace_events == NULL)
+        zkp_trace_events = (ZKP_trace_event*) malloc(sizeof(ZKP_trace_event)*ZKP_TRACE_MAX_EVENTS);
+
+    if (zkp_trace_nevents == ZKP_TRACE_MAX_EVENTS){
+        zkp_trace_dropped++;
+        pthread_mutex_unlock(&zkp_trace_lock);
+        return;
+    }
+
+    e = &zkp_trace_events[zkp_trace_nevents++];
+    e->name = s->name;
+    e->start = s->start;
+    e->duration = end - s->start;
+    e->tid = t->tid;
+    e->live = m.live;
+    e->peak = m.peak;
+
+    for(int i=0; i<ZKP_CNT_COUNT;++i)
+        e->delta.c[i] = t->counters.c[i] - s->mem.at_start.c[i];
+
+    pthread_mutex_unlock(&zkp_trace_lock);
+}
+
+/**
+ * OpenSSL bytes allocated and not freed, every thread together
+ */
+int64_t zkp_mem_live(){
+
+    int64_t live = 0;
+
+    pthread_mutex_lock(&zkp_trace_lock);
+
+    for(ZKP_trace_thread* t = zkp_trace_threads; t != NULL; t = t->next)
+        live += t->live;
+
+    pthread_mutex_unlock(&zkp_trace_lock);
+
+    return live;
+}
+
+/**
+ * Prints the totals of the counters
+ */
+void zkp_trace_print(){
+
+    ZKP_trace_counters t;
+
+    zkp_trace_snapshot(&t);
+
+    for(int i=0; i<ZKP_CNT_COUNT;++i)
+        printf("%-12s %llu\n",zkp_counter_names[i],(unsigned long long) t.c[i]);
+
+    printf("%-12s %lld\n","live_bytes",(long long) zkp_mem_live());
+
+    if (zkp_trace_dropped > 0)
+        printf("%lu spans dropped\n",zkp_trace_dropped);
+}
+
+/**
+ * Writes the spans as Chrome trace events, with the counter totals as a
+ * final counter event
+ * @return false if the file cannot be written
+ */
+bool zkp_trace_write_json(const char* path){
+
+    FILE* out = fopen(path,"w");
+    ZKP_trace_counters t;
+    ZKP_trace_event* e;
+
+    if (out == NULL)
+        return false;
+
+    zkp_trace_snapshot(&t);
+
+    fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n",out);
+
+    pthread_mutex_lock(&zkp_trace_lock);
+
+    for(int i=0; i<zkp_trace_nevents;++i){
+
+        e = &zkp_trace_events[i];
+
+        fprintf(out,"  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+            e->name,e->tid,(e->start-zkp_trace_origin)/1e3,e->duration/1e3);
+
+        for(int j=0; j<ZKP_CNT_COUNT;++j)
+            fprintf(out,"%s\"%s\": %llu",j ? ", " : "",zkp_counter_names[j],(unsigned long long) e->delta.c[j]);
+
+        fprintf(out,", \"live_bytes\": %lld, \"peak_bytes\": %lld}},\n",(long long) e->live,(long long) e->peak);
+    }
+
+    pthread_mutex_unlock(&zkp_trace_lock);
+
+    fprintf(out,"  {\"name\": \"totals\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": %.3f, \"args\": {",(zkp_now_ns()-zkp_trace_origin)/1e3);
+
+    for(int j=0; j<ZKP_CNT_COUNT;++j)
+        fprintf(out,"%s\"%s\": %llu",j ? ", " : "",zkp_counter_names[j],(unsigned long long) t.c[j]);
+
+    fputs("}}\n]}\n",out);
+    fclose(out);
+
+    return true;
+}
+
+#endif
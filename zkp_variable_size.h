@@ -5,8 +5,6 @@
 #include "pedersen.h"
 #include "zkp_fixed_size.h"
 
-#define N_VAR 256
-
 BIGNUM** pad_with_zeros(BIGNUM** a, int n){
 
     BIGNUM** new_a = (BIGNUM**) malloc(sizeof(BIGNUM*)*(2*n));
@@ -21,14 +19,14 @@ BIGNUM** pad_with_zeros(BIGNUM** a, int n){
     return new_a;
 }
 
-char* pad_with_zeros_solution(char* a, int n){
+char* pad_with_zeros_solution(char* a, int n, int k){
 
     char* new_a = (char*) malloc(sizeof(char)*(2*n));
 
     for(int i=0; i<2*n;++i){
         new_a[i]= i<n? a[i] : 0;
 
-        if ( i >= n && i < n + (n-K) )
+        if ( i >= n && i < n + (n-k) )
             new_a[i]=1;
     }
     
@@ -36,67 +34,133 @@ char* pad_with_zeros_solution(char* a, int n){
     return new_a;
 }
 
-PED_commitment** PROVER_commits_variable(BIGNUM** a, PED_params* params, BN_CTX* ctx){
-
-    PED_commitment** commitments = (PED_commitment**) malloc(sizeof(PED_commitment*) * N_VAR*2);
+/**
+ * pad_with_zeros_solution, bit-packed
+ */
+BIT_solution* pad_with_zeros_bitsol(char* a, int n, int k){
 
+    BIT_solution* s = bitsol_new(2*n);
 
-    for (int i=0; i<N_VAR*2; ++i){
-        commitments[i] = pedersen_commit(a[i],params->p,params->g,params->h,ctx);
+    for(int i=0; i<n;++i){
+        if (a[i] == 1)
+            bitsol_set(s,i);
     }
 
-    return commitments;
+    for(int i=n; i<n+(n-k);++i)
+        bitsol_set(s,i);
+
+    return s;
 }
 
 /**
- * The prover opens one his two initial commitments
- * @param c: array of commitments
- * @param a: array of values the prover committed to
- * @param s: array of randomnesses used by the prover
- * @param p: the prime used to implement Pedersen commitments
- * @param g: first generator
- * @param h: second generator
+ * Creates a view of the instance a padded with n zeros, without copying it
  */
-bool PROVER_opens_variable(BIGNUM** c, BIGNUM** a, BIGNUM** s, BIGNUM* p, BIGNUM* g, BIGNUM* h, BN_CTX* ctx){
+BN_view pad_with_zeros_view(BIGNUM** a, int n){
+    return view_init(a,n,NULL,2*n);
+}
 
-    bool is_success;
+/**
+ * The values of an instance followed by its carry entries M*2^j, j < bits.
+ * The values are shared with a, the entries are new
+ */
+BIGNUM** pad_with_carries(BIGNUM** a, int n, const BIGNUM* M, int bits){
 
-    for(int i=0; i<N_VAR*2; ++i){
-        is_success = pederesen_unveil(c[i],s[i],a[i],p,g,h,ctx);
+    BIGNUM** v = (BIGNUM**) malloc(sizeof(BIGNUM*)*(n+bits));
 
-        if (!is_success){
-            printf("Failed opening %d-th commitment.\n",i);
-            return false;
-        }
+    for(int i=0; i<n;++i)
+        v[i] = a[i];
+
+    for(int j=0; j<bits;++j){
+        v[n+j] = BN_new();
+        BN_lshift(v[n+j],M,j);
     }
 
-    return true;
+    return v;
+}
+
+void pad_with_carries_free(BIGNUM** v, int n, int bits){
+
+    for(int j=0; j<bits;++j)
+        BN_free(v[n+j]);
+
+    free(v);
 }
 
 /**
- * Computes the homomorphic sum of elements included in the solution
- * @param c: Array of commitments
- * @param solution: Permuted solutions
- * @param mod: Modulus
- * @param ctx: OpenSSL context 
+ * Solution of an instance padded with bits carry entries and n+bits zeros:
+ * the entries of the bits of 2^bits-1-carry, then as many zeros as it takes
+ * to select n+bits values whatever the carry
  */
-BIGNUM* VERIFIER_homomorphic_sum_variable(BIGNUM** c, char* solution, BIGNUM* prime, BN_CTX* ctx){
+BIT_solution* pad_with_carries_bitsol(char* a, int n, int k, int bits, int carry){
 
-    BN_CTX_start(ctx);
+    int len = n+bits;
+    int zeros = n-k+bitsol_popcount64((uint64_t) carry);
+    BIT_solution* s = bitsol_new(2*len);
 
-    BIGNUM* prod = BN_new();
-    
-    BN_add(prod,prod,BN_value_one());
-    
-    for( int i=0; i<N_VAR*2;++i){
-        if (solution[i]==1){
-            BN_mod_mul(prod,prod,c[i],prime,ctx);
+    for(int i=0; i<n;++i){
+        if (a[i] == 1)
+            bitsol_set(s,i);
+    }
+
+    for(int j=0; j<bits;++j){
+        if (!(carry >> j & 1))
+            bitsol_set(s,n+j);
+    }
+
+    for(int i=len; i<len+zeros;++i)
+        bitsol_set(s,i);
+
+    return s;
+}
+
+/**
+ * Commits to the 2n values of a padded instance. Padding positions only cost h^s.
+ * @param arena: arena of the proof, owning the returned vector
+ * @param a: view of the padded instance, of size 2n
+ * @param params: Pedersen parameters
+ * @param pool: precomputed commitments to zero, may be NULL
+ * @param coupons: precomputed (s, h^s) pairs, may be NULL
+ */
+PED_commit_vector* PROVER_commits_variable(ZKP_arena* arena, BN_view* a, PED_params* params, PED_zero_pool* pool, PED_coupon_pool* coupons, BN_CTX* ctx){
+
+    PED_commit_vector* commitments = commit_vector_new(arena,a->len,params->p);
+    BIGNUM** values = (BIGNUM**) arena_alloc(arena,sizeof(BIGNUM*) * a->len);
+    int* slots = (int*) arena_alloc(arena,sizeof(int) * a->len);
+    int i, count=0;
+
+    for (i=0; i<a->len; ++i){
+        if (view_source(a,i) < 0)
+            commit_vector_take(commitments,i,pedersen_commit_zero_coupon(params,pool,coupons,ctx));
+        else{
+            values[count] = view_get(a,i);
+            slots[count++] = i;
         }
     }
 
-    BN_CTX_end(ctx);
+    pedersen_commit_batch(commitments,slots,values,count,params,coupons,ctx);
+
+    return commitments;
+}
 
-    return prod;
+/**
+ * The prover opens one his two initial commitments
+ * @param com: the commitments and their randomnesses
+ * @param a: view of the padded values the prover committed to
+ * @param params: Pedersen parameters
+ */
+bool PROVER_opens_variable(PED_commit_vector* com, BN_view* a, PED_params* params, BN_CTX* ctx){
+    return PROVER_opens(com,a,params,ctx);
+}
+
+/**
+ * Computes the homomorphic sum of elements included in the solution
+ * @param c: Commitments of the padded instance
+ * @param solution: Permuted solutions
+ * @param params: Pedersen parameters
+ * @param ctx: OpenSSL context 
+ */
+BIGNUM* VERIFIER_homomorphic_sum_variable(PED_commit_vector* c, char* solution, PED_params* params, BN_CTX* ctx){
+    return VERIFIER_homomorphic_sum(c,solution,params,ctx);
 }
 
 #endif
\ No newline at end of file